@@ -0,0 +1,261 @@
+#ifndef AGGREGATION_HPP
+#define AGGREGATION_HPP
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <cstdint>
+
+#include "records.hpp"
+#include "money.hpp"
+#include "time_index.hpp"
+
+using namespace std;
+
+// What the trades are grouped by. Days are UTC calendar days, keyed by the epoch second of their midnight.
+enum GroupBy
+{
+    GROUP_BY_STOCK,
+    GROUP_BY_CLIENT,
+    GROUP_BY_DAY
+};
+
+// Which trades go into an aggregation
+enum TradeSide
+{
+    BOTH_SIDES,
+    PURCHASES,
+    SALES
+};
+
+struct AggregateQuery
+{
+    GroupBy groupBy = GROUP_BY_STOCK;
+    TradeSide side = BOTH_SIDES;
+    int64_t from = INT64_MIN; // trades at from <= time < to, in epoch seconds
+    int64_t to = INT64_MAX;
+};
+
+// Totals of one group: trade count, volume (shares), turnover and the price range
+struct AggregateRow
+{
+    long long key; // stock id, client id or day
+    long long trades;
+    long long volume;
+    Money turnover;
+    Money minPrice;
+    Money maxPrice;
+};
+
+// The transaction history as columns of integers, the form the aggregations scan.
+// Rows are appended in the order the engine holds the history and never change.
+class TradeColumns
+{
+private:
+    vector<long long> clients, stocks;
+    vector<int64_t> times;
+    vector<int64_t> shares;
+    vector<int64_t> prices; // paisa
+    vector<int64_t> totals; // paisa
+    vector<uint8_t> sells;
+
+    struct Partial
+    {
+        long long key;
+        int64_t trades, volume, turnover, minPrice, maxPrice;
+    };
+
+    // Open addressing hash table of partial aggregates, one per thread. Keys are probed
+    // linearly from their hash, and the table doubles before it is half full. A free slot holds
+    // the EMPTY key, so a probe touches only the slot itself.
+    class PartialTable
+    {
+    private:
+        static constexpr long long EMPTY = INT64_MIN;
+
+        vector<Partial> slots;
+        size_t count = 0;
+        size_t mask = 0;
+
+        static size_t hashOf(long long key)
+        {
+            uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+            return (size_t)(h ^ (h >> 32));
+        }
+
+        void grow()
+        {
+            vector<Partial> old;
+            old.swap(slots);
+            size_t capacity = old.empty() ? 1024 : old.size() * 2;
+            slots.assign(capacity, Partial{EMPTY, 0, 0, 0, 0, 0});
+            mask = capacity - 1;
+            count = 0;
+            for (auto &partial : old)
+            {
+                if (partial.key != EMPTY)
+                    slot(partial.key) = partial;
+            }
+        }
+
+    public:
+        PartialTable() { grow(); }
+
+        // The partial of the key, a new one with nothing counted if the key is not in the table yet
+        Partial &slot(long long key)
+        {
+            size_t i = hashOf(key) & mask;
+            while (slots[i].key != EMPTY)
+            {
+                if (slots[i].key == key)
+                    return slots[i];
+                i = (i + 1) & mask;
+            }
+            if (2 * (count + 1) > slots.size())
+            {
+                grow();
+                return slot(key);
+            }
+            count++;
+            slots[i] = {key, 0, 0, 0, INT64_MAX, INT64_MIN};
+            return slots[i];
+        }
+
+        // Starts loading the slot of a key that will be needed shortly
+        void prefetch(long long key) const
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(&slots[hashOf(key) & mask], 1);
+#else
+            (void)key;
+#endif
+        }
+
+        void mergeFrom(const PartialTable &other)
+        {
+            for (auto &theirs : other.slots)
+            {
+                if (theirs.key == EMPTY)
+                    continue;
+                Partial &mine = slot(theirs.key);
+                mine.trades += theirs.trades;
+                mine.volume = checkedAdd(mine.volume, theirs.volume);
+                mine.turnover = checkedAdd(mine.turnover, theirs.turnover);
+                mine.minPrice = min(mine.minPrice, theirs.minPrice);
+                mine.maxPrice = max(mine.maxPrice, theirs.maxPrice);
+            }
+        }
+
+        vector<AggregateRow> rows() const
+        {
+            vector<AggregateRow> result;
+            result.reserve(count);
+            for (auto &p : slots)
+            {
+                if (p.key == EMPTY)
+                    continue;
+                result.push_back({p.key, p.trades, p.volume, Money::fromPaisa(p.turnover), Money::fromPaisa(p.minPrice),
+                                  Money::fromPaisa(p.maxPrice)});
+            }
+            sort(result.begin(), result.end(), [](const AggregateRow &a, const AggregateRow &b) { return a.key < b.key; });
+            return result;
+        }
+    };
+
+    // Folds the rows [first, last) that pass the query into the table
+    void scan(const AggregateQuery &query, size_t first, size_t last, PartialTable &table) const
+    {
+        const long long *keys = query.groupBy == GROUP_BY_STOCK ? stocks.data() : clients.data();
+        bool byDay = query.groupBy == GROUP_BY_DAY;
+        const size_t ahead = 16; // rows between a prefetch and the update that needs it
+        for (size_t row = first; row < last; row++)
+        {
+            if (!byDay && row + ahead < last)
+                table.prefetch(keys[row + ahead]);
+            int64_t time = times[row];
+            if (time < query.from || time >= query.to)
+                continue;
+            if (query.side != BOTH_SIDES && (query.side == SALES) != (sells[row] != 0))
+                continue;
+            long long key = byDay ? dayOf(time) : keys[row];
+            Partial &p = table.slot(key);
+            p.trades++;
+            p.volume = checkedAdd(p.volume, shares[row]);
+            p.turnover = checkedAdd(p.turnover, totals[row]);
+            p.minPrice = min(p.minPrice, prices[row]);
+            p.maxPrice = max(p.maxPrice, prices[row]);
+        }
+    }
+
+public:
+    // Rows a thread is given at least, smaller histories are aggregated on the calling thread
+    static constexpr size_t ROWS_PER_THREAD = 1 << 16;
+
+    size_t size() const { return times.size(); }
+
+    void reserve(size_t n)
+    {
+        clients.reserve(n);
+        stocks.reserve(n);
+        times.reserve(n);
+        shares.reserve(n);
+        prices.reserve(n);
+        totals.reserve(n);
+        sells.reserve(n);
+    }
+
+    void append(const Transaction &transaction)
+    {
+        clients.push_back(transaction.id);
+        stocks.push_back(transaction.stockId);
+        times.push_back(transaction.timestamp);
+        shares.push_back(transaction.numberOfShares);
+        prices.push_back(transaction.price.getPaisa());
+        totals.push_back(transaction.totalCost.getPaisa());
+        sells.push_back(transaction.type == "sell");
+    }
+
+    // Groups the trades that pass the query, ordered by key. The rows are split between threads,
+    // each folds its share into its own table, and the tables are merged at the end.
+    vector<AggregateRow> aggregate(const AggregateQuery &query, unsigned threads = thread::hardware_concurrency()) const
+    {
+        size_t n = size();
+        size_t parts = max<size_t>(1, min<size_t>(max(threads, 1u), n / ROWS_PER_THREAD));
+        vector<PartialTable> tables(parts);
+        if (parts == 1)
+            scan(query, 0, n, tables[0]);
+        else
+        {
+            // an overflow in a worker is rethrown here
+            vector<exception_ptr> errors(parts);
+            vector<thread> workers;
+            for (size_t part = 0; part < parts; part++)
+            {
+                workers.emplace_back([&, part]() {
+                    try
+                    {
+                        scan(query, n * part / parts, n * (part + 1) / parts, tables[part]);
+                    }
+                    catch (...)
+                    {
+                        errors[part] = current_exception();
+                    }
+                });
+            }
+            for (auto &worker : workers)
+                worker.join();
+            for (auto &error : errors)
+            {
+                if (error)
+                    rethrow_exception(error);
+            }
+        }
+
+        for (size_t part = 1; part < parts; part++)
+            tables[0].mergeFrom(tables[part]);
+        return tables[0].rows();
+    }
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef BINARY_RECORDS_HPP
+#define BINARY_RECORDS_HPP
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+#include "records.hpp"
+#include "storage.hpp"
+
+using namespace std;
+
+// A compact binary form of records, generated from the same fields() lists as the JSON reader and
+// writer. Fields are written in their listed order without names:
+//   signed integers and money (in paisa) as zigzag varints, unsigned integers as varints;
+//   doubles as their 8 bytes;
+//   strings as a varint length and the bytes;
+//   optionals as a presence byte and the value;
+//   vectors as a varint count and the elements;
+//   records as their fields.
+// There are no field names or separators to parse, so a file of millions of records loads several
+// times faster than its JSON and takes a fraction of the space. The layout depends on the field
+// lists, so files start with a magic string that names the format and its version.
+namespace binary
+{
+    inline void putVarint(string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += char((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+    inline int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+    // Reads values back from a buffer, throwing if it ends too soon
+    struct Reader
+    {
+        const char *at;
+        const char *end;
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (at == end)
+                    throw runtime_error("binary record ends in a number");
+                uint8_t byte = (uint8_t)*at++;
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            throw runtime_error("binary record has a number that is too long");
+        }
+
+        void bytes(void *out, size_t size)
+        {
+            if ((size_t)(end - at) < size)
+                throw runtime_error("binary record ends too soon");
+            memcpy(out, at, size);
+            at += size;
+        }
+    };
+
+    template <typename T>
+    void writeValue(string &out, const T &value)
+    {
+        if constexpr (is_same<T, string>::value)
+        {
+            putVarint(out, value.size());
+            out += value;
+        }
+        else if constexpr (is_same<T, Money>::value)
+            putVarint(out, zigzag(value.getPaisa()));
+        else if constexpr (is_same<T, double>::value)
+            out.append((const char *)&value, sizeof(value));
+        else if constexpr (is_integral<T>::value && is_signed<T>::value)
+            putVarint(out, zigzag((int64_t)value));
+        else if constexpr (is_integral<T>::value)
+            putVarint(out, (uint64_t)value);
+        else if constexpr (records::isOptional<T>::value)
+        {
+            out += char(value.has_value() ? 1 : 0);
+            if (value.has_value())
+                writeValue(out, *value);
+        }
+        else if constexpr (records::isVector<T>::value)
+        {
+            putVarint(out, value.size());
+            for (auto &element : value)
+                writeValue(out, element);
+        }
+        else
+        {
+            static const auto fields = T::fields();
+            apply([&](const auto &...f) { (writeValue(out, value.*(f.member)), ...); }, fields);
+        }
+    }
+
+    template <typename T>
+    void readValue(Reader &in, T &value)
+    {
+        if constexpr (is_same<T, string>::value)
+        {
+            uint64_t size = in.varint();
+            if (size > (uint64_t)(in.end - in.at))
+                throw runtime_error("binary record ends in a string");
+            value.assign(in.at, (size_t)size);
+            in.at += size;
+        }
+        else if constexpr (is_same<T, Money>::value)
+            value = Money::fromPaisa(unzigzag(in.varint()));
+        else if constexpr (is_same<T, double>::value)
+            in.bytes(&value, sizeof(value));
+        else if constexpr (is_integral<T>::value && is_signed<T>::value)
+            value = (T)unzigzag(in.varint());
+        else if constexpr (is_integral<T>::value)
+            value = (T)in.varint();
+        else if constexpr (records::isOptional<T>::value)
+        {
+            char present;
+            in.bytes(&present, 1);
+            value.reset();
+            if (present)
+            {
+                value.emplace();
+                readValue(in, *value);
+            }
+        }
+        else if constexpr (records::isVector<T>::value)
+        {
+            uint64_t count = in.varint();
+            if (count > (uint64_t)(in.end - in.at)) // every element takes a byte at least
+                throw runtime_error("binary record has a bad count");
+            value.clear();
+            value.resize((size_t)count);
+            for (auto &element : value)
+                readValue(in, element);
+        }
+        else
+        {
+            static const auto fields = T::fields();
+            apply([&](const auto &...f) { (readValue(in, value.*(f.member)), ...); }, fields);
+        }
+    }
+
+    // Writes the magic and then the record
+    template <typename T>
+    bool save(const string &path, const string &magic, const T &record)
+    {
+        ScopedLatency latency(OP_FILE_SAVE);
+        TraceSpan span("binarySave", "storage", path.c_str());
+        string text = magic;
+        writeValue(text, record);
+        return writeWholeFile(path, text);
+    }
+
+    // Reads a file written by save, false if it does not exist. A file of another format or one
+    // that ends too soon throws.
+    template <typename T>
+    bool load(const string &path, const string &magic, T &record)
+    {
+        ScopedLatency latency(OP_FILE_LOAD);
+        TraceSpan span("binaryLoad", "storage", path.c_str());
+        string text;
+        if (!readWholeFile(path, text))
+            return false;
+        if (text.compare(0, magic.size(), magic) != 0)
+            throw runtime_error(path + ": not a " + magic.substr(0, magic.find('\n')) + " file");
+        Reader in = {text.data() + magic.size(), text.data() + text.size()};
+        try
+        {
+            readValue(in, record);
+        }
+        catch (const runtime_error &e)
+        {
+            throw runtime_error(path + ": " + e.what());
+        }
+        return true;
+    }
+}
+
+#endif
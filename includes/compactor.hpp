@@ -0,0 +1,242 @@
+#ifndef COMPACTOR_HPP
+#define COMPACTOR_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+
+#include "records.hpp"
+#include "binary_records.hpp"
+#include "ledger.hpp"
+
+using namespace std;
+
+// What one compaction did
+struct CompactionReport
+{
+    bool compacted = false;
+    long long events = 0;      // the snapshot covers this many events
+    long long archived = 0;    // events moved out of events.json
+    long long kept = 0;        // events appended while it ran, left in events.json
+    long long snapshotBytes = 0;
+    double seconds = 0;
+};
+
+// Keeps events.json short: it writes a binary snapshot (see BookSnapshot) of the state the journal
+// gives, starts a new events.json after it and moves the old journal, with its checkpoints, to
+// archive/events-<first>-<end>. Rebuilds and as-of queries then start from the snapshot, so their
+// cost follows the events since the last compaction rather than the whole history.
+// Trading is not held up: the journal is append-only, so everything before its end when the run
+// starts never changes, and that prefix is copied and replayed without any lock, like a fork would
+// see it. The journal lock (ledger::journalLock) is only held to note that end with the stock
+// files, and at the close to carry the events appended meanwhile over to the new journal and swap
+// the files.
+// The swap is made safe against a crash by a marker file, see ledger::finishCompaction.
+// In the background, a run is given up between its stages once stop is called, so the app does
+// not wait for a whole compaction to exit; what it leaves behind is cleared by the next run.
+class Compactor
+{
+private:
+    string dir;
+    unsigned threads;
+    bool keepArchive;
+
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    atomic<bool> stopping{false};
+    string failure; // of the last background run
+
+    // Copies the first size bytes of a file of records and closes its array
+    static void copyPrefix(const string &from, long long size, const string &to)
+    {
+        FILE *out = fopen(to.c_str(), "wb");
+        if (out == nullptr)
+            throw runtime_error("cannot open " + to + " for writing");
+        string chunk;
+        for (long long offset = 0; offset < size; offset += (long long)chunk.size())
+        {
+            size_t length = (size_t)min<long long>(1 << 20, size - offset);
+            if (!readFileRange(from, offset, length, chunk) || fwrite(chunk.data(), 1, chunk.size(), out) != chunk.size())
+            {
+                fclose(out);
+                throw runtime_error("cannot copy " + from + " to " + to);
+            }
+        }
+        bool written = fputs("\n]\n", out) >= 0;
+        if (fclose(out) != 0 || !written)
+            throw runtime_error("cannot write " + to);
+    }
+
+    template <typename T>
+    vector<T> parseText(const string &text, const string &name) const
+    {
+        vector<T> parsed;
+        string error;
+        if (!text.empty() && !parseRecords(text, parsed, &error))
+            throw runtime_error(dir + "/" + name + ": " + error);
+        return parsed;
+    }
+
+    // True once stop has been called, after clearing what the run has written so far
+    bool givenUp()
+    {
+        if (!stopping)
+            return false;
+        ledger::finishCompaction(dir);
+        return true;
+    }
+
+public:
+    Compactor(const string &dir, unsigned threads = thread::hardware_concurrency(), bool keepArchive = true)
+        : dir(dir), threads(max(threads, 1u)), keepArchive(keepArchive)
+    {
+    }
+    ~Compactor() { stop(); }
+
+    // Compacts once if events.json holds any event
+    CompactionReport run()
+    {
+        auto start = chrono::steady_clock::now();
+        CompactionReport report;
+        ledger::finishCompaction(dir);
+        string journal = dir + "/events.json";
+
+        // The end of the journal now, and the stock files as they are with it
+        long long end;
+        string stocksText, removedText, symbolsText;
+        {
+            lock_guard<recursive_mutex> guard(ledger::journalLock());
+            end = endOfRecords(journal);
+            readWholeFile(dir + "/added_stocks.json", stocksText);
+            readWholeFile(dir + "/removed_stocks.json", removedText);
+            readWholeFile(dir + "/symbols.json", symbolsText);
+        }
+        auto live = ledger::checkpoints(dir);
+        if (end <= 1 || live.empty()) // no events after the "[", or no checkpoint to start from
+            return report;
+
+        // The journal up to that end and its checkpoints become the archive segment, and replaying
+        // it gives the state the snapshot holds
+        string staging = ledger::archiveDir(dir) + "/staging";
+        filesystem::remove_all(staging);
+        filesystem::create_directories(ledger::checkpointDir(staging));
+        copyPrefix(journal, end, staging + "/events.json");
+        for (auto &one : live)
+            filesystem::copy_file(one.second, ledger::checkpointDir(staging) + "/" + filesystem::path(one.second).filename().string());
+        if (givenUp())
+            return report;
+        BookSnapshot snapshot;
+        snapshot.ledger = LedgerRebuild(staging, threads).run();
+        if (givenUp())
+            return report;
+        ledger::saveCheckpoint(staging, snapshot.ledger, live.size() + 1);
+        report.events = snapshot.ledger.events;
+        report.archived = snapshot.ledger.events - live.front().first;
+
+        snapshot.ledger.offset = 1; // just past the "[" the new journal starts with
+        snapshot.stocks = parseText<StockList>(stocksText, "added_stocks.json");
+        snapshot.removedStocks = parseText<StockList>(removedText, "removed_stocks.json");
+        snapshot.symbols = parseText<SymbolRecord>(symbolsText, "symbols.json");
+        snapshot.time = (int64_t)::time(nullptr);
+        string snapshotPath = ledger::checkpointDir(dir) + "/ledger-" + to_string(report.events) + ".snap";
+        if (!binary::save(snapshotPath + ".tmp", ledger::SNAPSHOT_MAGIC, snapshot))
+            throw runtime_error("cannot write " + snapshotPath + ".tmp");
+        report.snapshotBytes = (long long)filesystem::file_size(snapshotPath + ".tmp");
+        if (givenUp())
+            return report;
+
+        // The events appended since go to the new journal, then the files are swapped
+        {
+            lock_guard<recursive_mutex> guard(ledger::journalLock());
+            vector<LedgerEvent> later;
+            scanRecordTexts(
+                journal,
+                [&](const string &text) {
+                    LedgerEvent event;
+                    string error;
+                    if (!parseRecord(text.data(), text.size(), event, &error))
+                        throw runtime_error(journal + ": " + error);
+                    later.push_back(move(event));
+                },
+                end);
+            if (!writeWholeFile(journal + ".tmp", "[]\n"))
+                throw runtime_error("cannot write " + journal + ".tmp");
+            appendRecords(journal + ".tmp", later, 0);
+            report.kept = (long long)later.size();
+
+            CompactionMarker marker;
+            marker.events = report.events;
+            marker.segment = "events-" + to_string(live.front().first) + "-" + to_string(report.events);
+            saveRecords(dir + "/compaction.json", vector<CompactionMarker>{marker}, 4);
+            ledger::finishCompaction(dir);
+            if (!keepArchive)
+                filesystem::remove_all(ledger::archiveDir(dir) + "/" + marker.segment);
+        }
+
+        report.compacted = true;
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    // Compacts in the background every interval once events.json has grown past minBytes
+    void start(int intervalSeconds, long long minBytes)
+    {
+        stop();
+        stopping = false;
+        chrono::seconds interval(intervalSeconds > 0 ? intervalSeconds : 3600);
+        worker = thread([this, interval, minBytes]() {
+            unique_lock<mutex> guard(lock);
+            while (!wake.wait_for(guard, interval, [this]() { return stopping.load(); }))
+            {
+                // the lock is only held to wait and to note the outcome, so lastError and stop
+                // never wait for a run
+                guard.unlock();
+                string outcome;
+                try
+                {
+                    if (endOfRecords(dir + "/events.json") >= max(minBytes, 2LL))
+                        run();
+                }
+                catch (const exception &e)
+                {
+                    outcome = e.what();
+                }
+                guard.lock();
+                failure = outcome;
+            }
+        });
+    }
+
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        stopping = false;
+    }
+
+    // Why the last background run failed, empty if it did not
+    string lastError()
+    {
+        lock_guard<mutex> guard(lock);
+        return failure;
+    }
+};
+
+#endif
@@ -0,0 +1,1119 @@
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+
+#include "extra.hpp"
+#include "storage.hpp"
+#include "records.hpp"
+#include "symbols.hpp"
+#include "slab.hpp"
+#include "stock_table.hpp"
+#include "id_allocator.hpp"
+#include "search_index.hpp"
+#include "time_index.hpp"
+#include "aggregation.hpp"
+#include "summaries.hpp"
+#include "price_history.hpp"
+#include "ledger.hpp"
+#include "point_in_time.hpp"
+#include "money.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+// Outcome of a purchase or a sale
+enum TradeStatus
+{
+    TRADE_OK,
+    CLIENT_NOT_FOUND,
+    PORTFOLIO_NOT_FOUND,
+    STOCK_NOT_FOUND,
+    INSUFFICIENT_BALANCE,
+    INSUFFICIENT_SHARES
+};
+
+struct TradeResult
+{
+    TradeStatus status;
+    string stockName;
+    Money price;     // market price the trade was done at
+    Money total;     // total cost of a purchase or total earnings of a sale
+    Money costRate;  // purchased rate of the holding, only set for sales
+    int64_t time;    // epoch seconds of the trade
+};
+
+// One line of a client's portfolio as shown by displayClientPortfolio
+struct PortfolioLine
+{
+    string stockName;
+    int numberOfShares;
+    Money value;
+};
+
+// Cash and holdings of the whole book, valued at the current market prices
+struct BookValue
+{
+    Money cash;
+    Money holdings;
+    long long positions;
+};
+
+// The stock engine performs every operation of the analyzer on the JSON files, without any console I/O.
+// The files are read into the typed records of records.hpp, so fields are accessed directly.
+// Holdings and transactions refer to stocks by interned symbol id; the names are kept once in symbols.json.
+// Clients, listed stocks and the transaction history are held in memory as the primary copy, and their
+// files are rewritten from it whenever they change. Transactions are indexed by client and by stock
+// in time order, so a date range of either is found without reading the rest. Daily summaries
+// per client and per stock, and the cash of the book, are kept as views in summaries.json and
+// updated by every operation that changes them. Registrations, removals, deposits, settlements and
+// trades are also appended to events.json as they happen, before the files they change are saved;
+// portfolios and the client registry can be rebuilt from it (see LedgerRebuild), and a Compactor
+// may snapshot and rotate it in the background, which is why it and the stock files are written
+// under ledger::journalLock.
+// The daily price history of the stocks is kept in price_history.json for backtests and
+// indicators.
+// NepalStockAnalyzer drives it from the menus and the tools drive it directly.
+// Every operation records its latency into the metrics registry, and trades are split into
+// trace spans (client lookup, balance check, portfolio mutate, persistence, history append).
+class StockEngine
+{
+private:
+    mt19937_64 random{random_device{}()};
+    SymbolTable symbols;
+    bool symbolsLoaded = false;
+    Slab<Client> clients;
+    StockTable listedStocks;
+    bool clientsLoaded = false, stocksLoaded = false;
+    IdAllocator idAllocator;
+    SearchIndex clientSearch, stockSearch; // built by the first search, then kept up to date
+    bool clientSearchBuilt = false, stockSearchBuilt = false;
+    vector<TransactionHistory> histories;
+    unordered_map<string, size_t> historyByName; // first entry of every client name
+    TimeIndex clientTrades, stockTrades;
+    bool historiesLoaded = false;
+    TradeColumns tradeColumns; // built by the first aggregation, then kept up to date
+    bool tradeColumnsBuilt = false;
+    DailySummaries summaries;
+    bool summariesLoaded = false;
+    PriceHistory priceHistory;
+    bool priceHistoryLoaded = false;
+    bool ledgerOpened = false;
+    PointInTime pointInTime{"."}; // indexes the ledger on the first as-of query
+
+public:
+    // The registered client with the id, nullptr if there is none
+    const Client *findClient(long long id) { return clientList().find(id); }
+
+    // The listed stock with the id, nothing if there is none
+    optional<StockList> findStock(long long stockId)
+    {
+        size_t row = stockList().find(stockId);
+        if (row == StockTable::NO_ROW)
+            return nullopt;
+        return listedStocks.record(row);
+    }
+
+    const Slab<Client> &allClients() { return clientList(); }
+    const StockTable &allStocks() { return stockList(); }
+
+    // Registers the client under a new id and returns the id
+    long long addClient(Client client)
+    {
+        openLedger();
+        client.setId(reserveClientIds(1));
+        clientList().insert(client);
+        if (clientSearchBuilt)
+            clientSearch.add(client.getId(), {client.getName(), client.getAddress()});
+        recordEvents({ledger::registration(client, (int64_t)::time(nullptr))});
+        saveRecords("added_clients.json", clients.toVector(), 4);
+        return client.getId();
+    }
+
+    // Registers a batch of clients under consecutive new ids and saves them once, returns the
+    // first id. The ids are reserved together, so the batch costs one sequences.json write.
+    long long importClients(vector<Client> batch)
+    {
+        ScopedLatency latency(OP_IMPORT);
+        TraceSpan span("importClients");
+        Slab<Client> &list = clientList();
+        if (batch.empty())
+            return 0;
+        openLedger();
+        long long first = reserveClientIds((long long)batch.size());
+        list.reserve(list.size() + batch.size());
+        vector<LedgerEvent> events;
+        events.reserve(batch.size());
+        int64_t now = (int64_t)::time(nullptr);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            batch[i].setId(first + (long long)i);
+            if (clientSearchBuilt)
+                clientSearch.add(batch[i].getId(), {batch[i].getName(), batch[i].getAddress()});
+            events.push_back(ledger::registration(batch[i], now));
+            list.insert(move(batch[i]));
+        }
+        recordEvents(events);
+        saveRecords("added_clients.json", clients.toVector(), 4);
+        return first;
+    }
+
+    // Lists a batch of stocks under consecutive new ids and saves them once, returns the first id
+    long long importStocks(vector<StockList> batch)
+    {
+        ScopedLatency latency(OP_IMPORT);
+        TraceSpan span("importStocks");
+        StockTable &table = stockList();
+        if (batch.empty())
+            return 0;
+        long long first = reserveStockIds((long long)batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            batch[i].setStockId(first + (long long)i);
+            uint32_t symbol = symbolTable().intern(batch[i].getStockName());
+            table.append(batch[i], symbol);
+            if (stockSearchBuilt)
+                stockSearch.add(batch[i].getId(), {batch[i].getStockName(), symbols.ticker(symbol).toString()});
+        }
+        saveStocks();
+        return first;
+    }
+
+    // Reserves count new client ids for a batch and returns the first, the ids run consecutively
+    long long reserveClientIds(long long count) { return reserveIds("clients", count); }
+    long long reserveStockIds(long long count) { return reserveIds("stocks", count); }
+
+    // Moves the client to removed_clients.json, false if there is no client with the id
+    bool removeClient(long long id)
+    {
+        const Client *client = clientList().find(id);
+        if (client == nullptr)
+            return false;
+        openLedger();
+        vector<Client> removedClients = loadRecords<Client>("removed_clients.json");
+        removedClients.push_back(*client);
+        clients.remove(id);
+        clientSearch.remove(id);
+
+        recordEvents({ledger::removal(id, (int64_t)::time(nullptr))});
+        saveRecords("added_clients.json", clients.toVector(), 4);
+        saveRecords("removed_clients.json", removedClients, 4);
+        return true;
+    }
+
+    // Lists the stock under a new id and returns the id
+    long long addStock(StockList stock)
+    {
+        stock.setStockId(reserveStockIds(1));
+        uint32_t symbol = symbolTable().intern(stock.getStockName());
+        stockList().append(stock, symbol);
+        if (stockSearchBuilt)
+            stockSearch.add(stock.getId(), {stock.getStockName(), symbols.ticker(symbol).toString()});
+        saveStocks();
+        return stock.getId();
+    }
+
+    // Moves the stock to removed_stocks.json, false if there is no stock with the id
+    bool removeStock(long long stockId)
+    {
+        size_t row = stockList().find(stockId);
+        if (row == StockTable::NO_ROW)
+            return false;
+        vector<StockList> removedStocks = loadRecords<StockList>("removed_stocks.json");
+        removedStocks.push_back(listedStocks.record(row));
+        listedStocks.remove(row);
+        stockSearch.remove(stockId);
+
+        saveStocks(&removedStocks);
+        return true;
+    }
+
+    // Id of the listed stock with the name or ticker, 0 if none is listed under it
+    long long findStockBySymbol(const string &name)
+    {
+        const StockTable &table = stockList(); // interns the listed names
+        uint32_t symbol = symbols.find(name);
+        for (size_t row = 0; symbol != NO_SYMBOL && row < table.size(); row++)
+        {
+            if (table.symbol(row) == symbol)
+                return table.id(row);
+        }
+        return 0;
+    }
+
+    // Daily bars of the stock with from <= day < to, oldest first
+    vector<PriceBar> priceBars(long long stockId, int64_t from, int64_t to)
+    {
+        ScopedLatency latency(OP_PRICE_HISTORY);
+        TraceSpan span("priceBars");
+        return priceHistoryStore().range(stockId, from, to);
+    }
+
+    // Merges daily bars into the price history, each series ordered by day with one bar per day,
+    // and saves it once. A bar replaces the one already kept for its day. The market price and the
+    // previous close of every stock in the batch become the last two closes of its history.
+    // Returns the number of days that were new.
+    size_t importPriceHistory(const vector<PriceSeries> &batch)
+    {
+        ScopedLatency latency(OP_IMPORT);
+        TraceSpan span("importPriceHistory");
+        PriceHistory &history = priceHistoryStore();
+        StockTable &table = stockList();
+        size_t added = 0;
+        bool pricesChanged = false;
+        for (auto &one : batch)
+        {
+            added += history.merge(one.stockId, one.bars);
+            const vector<PriceBar> *bars = history.find(one.stockId);
+            size_t row = table.find(one.stockId);
+            if (bars == nullptr || bars->empty() || row == StockTable::NO_ROW)
+                continue;
+            Money close = bars->back().close;
+            Money previousClose = bars->size() > 1 ? (*bars)[bars->size() - 2].close : close;
+            table.setPrice(row, close, previousClose);
+            pricesChanged = true;
+        }
+        if (history.isDirty())
+            history.save("price_history.json");
+        if (pricesChanged)
+            saveStocks();
+        return added;
+    }
+
+    // Ids of the clients whose name or address matches the query, best matches first. Words of
+    // the query match the start of words ("sit sha"), and misspelt words match close words.
+    vector<long long> searchClients(const string &query, size_t limit)
+    {
+        ScopedLatency latency(OP_SEARCH);
+        TraceSpan span("searchClients");
+        if (!clientSearchBuilt)
+        {
+            for (auto &client : clientList())
+                clientSearch.add(client.getId(), {client.getName(), client.getAddress()});
+            clientSearchBuilt = true;
+        }
+        return clientSearch.search(query, limit);
+    }
+
+    // Ids of the stocks whose name or ticker matches the query
+    vector<long long> searchStocks(const string &query, size_t limit)
+    {
+        ScopedLatency latency(OP_SEARCH);
+        TraceSpan span("searchStocks");
+        if (!stockSearchBuilt)
+        {
+            const StockTable &table = stockList();
+            for (size_t row = 0; row < table.size(); row++)
+                stockSearch.add(table.id(row), {table.name(row), symbols.ticker(table.symbol(row)).toString()});
+            stockSearchBuilt = true;
+        }
+        return stockSearch.search(query, limit);
+    }
+
+    // Loads portfolio.json, giving holdings written with a stock name a symbol id
+    vector<Portfolio> loadPortfolios()
+    {
+        vector<Portfolio> portfolios = loadRecords<Portfolio>("portfolio.json");
+        for (auto &entry : portfolios)
+            for (auto &stock : entry.stocks)
+                internName(stock.stockName, stock.symbol);
+        return portfolios;
+    }
+
+    // Loads transactions.json, giving transactions written with a stock name a symbol id and
+    // transactions written with a ctime() text an epoch timestamp
+    vector<TransactionHistory> loadHistories()
+    {
+        vector<TransactionHistory> loaded = loadRecords<TransactionHistory>("transactions.json");
+        for (auto &entry : loaded)
+        {
+            for (auto &transaction : entry.transactions)
+            {
+                internName(transaction.stockName, transaction.symbol);
+                if (transaction.time.has_value())
+                {
+                    transaction.timestamp = parseCtime(*transaction.time);
+                    transaction.time.reset();
+                }
+            }
+        }
+        return loaded;
+    }
+
+    // Name of an interned symbol, empty for NO_SYMBOL
+    string symbolName(uint32_t symbol)
+    {
+        SymbolTable &table = symbolTable();
+        return symbol < table.size() ? table.name(symbol) : "";
+    }
+
+    // Adds money to the balance of the client, creating their portfolio entry if needed
+    bool depositMoney(long long id, Money amount)
+    {
+        ScopedLatency latency(OP_DEPOSIT_MONEY);
+        TraceSpan span("depositMoney");
+        const Client *client = findClient(id);
+        if (client == nullptr)
+        {
+            return false;
+        }
+        openLedger();
+
+        vector<Portfolio> portfolios = loadPortfolios();
+        LedgerEvent event = ledger::cash("deposit", id, amount, (int64_t)::time(nullptr));
+
+        // Update the balance if the client already has an entry in the portfolio.json file,
+        // otherwise add a new entry
+        Portfolio *entry = findEntry(portfolios, id);
+        if (entry == nullptr)
+        {
+            Portfolio newEntry;
+            newEntry.name = client->getName();
+            newEntry.id = id;
+            portfolios.push_back(newEntry);
+            entry = &portfolios.back();
+        }
+        ledger::apply(*entry, event);
+
+        DailySummaries &views = summaryViews(); // a rebuild reads the saved ledger, so before this change
+        recordEvents({event});
+        savePortfolios(portfolios, 3);
+        appendCashMovements({{amount, id, event.time, "deposit"}});
+        views.recordCash(amount);
+        saveSummaries();
+        return true;
+    }
+
+    // Buys numStocks shares of the stock at its market price and records the transaction
+    TradeResult purchaseStock(long long id, long long stockId, int numStocks)
+    {
+        ScopedLatency latency(OP_PURCHASE_STOCK);
+        TraceSpan span("purchaseStock");
+        TradeResult result = {TRADE_OK, "", Money(), Money(), Money(), 0};
+
+        if (!clientExists(id))
+        {
+            result.status = CLIENT_NOT_FOUND;
+            return result;
+        }
+        openLedger();
+
+        vector<Portfolio> portfolios = loadPortfolios();
+
+        size_t row = lookupStock(stockId, result);
+        if (row == StockTable::NO_ROW)
+        {
+            result.status = STOCK_NOT_FOUND;
+            return result;
+        }
+
+        // Calculate the total cost of the purchase
+        result.total = result.price * numStocks;
+
+        Portfolio *entry;
+        {
+            TraceSpan phase("balanceCheck");
+            entry = findEntry(portfolios, id);
+        }
+        if (entry == nullptr || entry->balance < result.total)
+        {
+            result.status = INSUFFICIENT_BALANCE;
+            return result;
+        }
+
+        TraceSpan mutate("portfolioMutate");
+
+        // Take the total from the balance and add the shares to the holding; buying more of a
+        // stock already held averages its cost rate
+        result.time = (int64_t)::time(nullptr);
+        LedgerEvent event = ledger::trade("buy", id, stockId, symbolTable().intern(result.stockName), numStocks,
+                                          result.price, result.total, result.time);
+        ledger::apply(*entry, event);
+        listedStocks.recordTrade(row, numStocks);
+        mutate.finish();
+
+        DailySummaries &views = summaryViews();
+        {
+            TraceSpan phase("persist");
+            recordEvents({event});
+            savePortfolios(portfolios, 4);
+        }
+        views.recordCash(-result.total);
+
+        // Store the purchase transaction in the transactions.json file
+        buyHistory(id, stockId, result.stockName, numStocks, result.price, result.total, result.time);
+        return result;
+    }
+
+    // Sells numStocks shares of the stock at its market price and records the transaction
+    TradeResult sellStock(long long id, long long stockId, int numStocks)
+    {
+        ScopedLatency latency(OP_SELL_STOCK);
+        TraceSpan span("sellStock");
+        TradeResult result = {TRADE_OK, "", Money(), Money(), Money(), 0};
+
+        if (!clientExists(id))
+        {
+            result.status = CLIENT_NOT_FOUND;
+            return result;
+        }
+        openLedger();
+
+        vector<Portfolio> portfolios = loadPortfolios();
+        Portfolio *entry = findEntry(portfolios, id);
+        if (entry == nullptr)
+        {
+            result.status = PORTFOLIO_NOT_FOUND;
+            return result;
+        }
+
+        size_t row = lookupStock(stockId, result);
+        if (row == StockTable::NO_ROW)
+        {
+            result.status = STOCK_NOT_FOUND;
+            return result;
+        }
+
+        // Check if the client has enough of the stock in their portfolio
+        vector<Holding> &stocks = entry->stocks;
+        int stockIndex = -1;
+        long long numberOfShares = 0;
+        {
+            TraceSpan phase("holdingCheck");
+            for (int i = 0; i < (int)stocks.size(); i++)
+            {
+                if (stocks[i].stockId == stockId)
+                {
+                    stockIndex = i;
+                    numberOfShares = stocks[i].numberOfShares;
+                    result.costRate = stocks[i].purchasedRate;
+                    break;
+                }
+            }
+        }
+        if (stockIndex < 0 || numStocks > numberOfShares)
+        {
+            result.status = INSUFFICIENT_SHARES;
+            return result;
+        }
+
+        TraceSpan mutate("portfolioMutate");
+
+        // Calculate the total earnings from the sale and add them to the client's balance; the
+        // holding goes once the client has no shares of the stock left
+        result.total = result.price * numStocks;
+        result.time = (int64_t)::time(nullptr);
+        LedgerEvent event = ledger::trade("sell", id, stockId, stocks[stockIndex].symbol, numStocks, result.price,
+                                          result.total, result.time);
+        ledger::apply(*entry, event);
+        listedStocks.recordTrade(row, numStocks);
+        mutate.finish();
+
+        DailySummaries &views = summaryViews();
+        {
+            TraceSpan phase("persist");
+            recordEvents({event});
+            savePortfolios(portfolios, 4);
+        }
+        views.recordCash(result.total);
+
+        // Store the transaction in the transactions.json file
+        sellHistory(id, stockId, result.stockName, numStocks, result.price, result.total, result.time);
+        return result;
+    }
+
+    // Every purchase is recorded as a new entry of transactions.json, unlike sales which are grouped by client name
+    void buyHistory(long long id, long long stockId, string stockName, int numStocks, Money price, Money totalCost, int64_t time)
+    {
+        ScopedLatency latency(OP_BUY_HISTORY);
+        TraceSpan span("buyHistory");
+        historyList();
+
+        TransactionHistory entry;
+        entry.name = findClientName(id);
+        histories.push_back(entry);
+        historyByName.emplace(entry.name, histories.size() - 1);
+        appendTransaction(histories.size() - 1, makeTransaction(id, stockId, stockName, numStocks, price, totalCost, "purchase", time));
+
+        saveHistories(histories);
+        saveSummaries();
+    }
+
+    void sellHistory(long long id, long long stockId, string stockName, int numStocks, Money price, Money totalCost, int64_t time)
+    {
+        ScopedLatency latency(OP_SELL_HISTORY);
+        TraceSpan span("sellHistory");
+        historyList();
+        string clientName = findClientName(id);
+        Transaction transaction = makeTransaction(id, stockId, stockName, numStocks, price, totalCost, "sell", time);
+
+        // Add the sale to the client's entry, or create a new entry for them
+        auto found = historyByName.find(clientName);
+        if (found == historyByName.end())
+        {
+            TransactionHistory entry;
+            entry.name = clientName;
+            histories.push_back(entry);
+            found = historyByName.emplace(clientName, histories.size() - 1).first;
+        }
+        appendTransaction(found->second, transaction);
+
+        saveHistories(histories);
+        saveSummaries();
+    }
+
+    // Moves every market price by a random fluctuation of up to 10%, the old prices become the previous close
+    void updateStockPrices()
+    {
+        ScopedLatency latency(OP_UPDATE_STOCK_PRICES);
+        TraceSpan span("updateStockPrices");
+        const StockTable &table = stockList();
+
+        // A random fluctuation of up to 10% of the market price, in whole paisa
+        const int64_t *prices = table.priceColumn();
+        vector<int64_t> deltas(table.size());
+        for (size_t row = 0; row < deltas.size(); row++)
+        {
+            uniform_int_distribution<int64_t> fluctuation(-prices[row] / 10, prices[row] / 10);
+            deltas[row] = fluctuation(random);
+        }
+        if (!listedStocks.tick(deltas.data()))
+            return;
+
+        saveStocks();
+    }
+
+    // Listed stocks that pass the screen
+    vector<StockList> screenStocks(const StockScreen &criteria)
+    {
+        ScopedLatency latency(OP_SCREEN_STOCKS);
+        TraceSpan span("screenStocks");
+        const StockTable &table = stockList();
+        vector<StockList> matches;
+        for (size_t row : table.screen(criteria))
+            matches.push_back(table.record(row));
+        return matches;
+    }
+
+    // The price weighted index of the listed stocks
+    MarketIndex marketIndex()
+    {
+        ScopedLatency latency(OP_MARKET_INDEX);
+        TraceSpan span("marketIndex");
+        return stockList().index();
+    }
+
+    // Collects the holdings of the client valued at the current market price
+    bool clientPortfolio(long long id, string &clientName, vector<PortfolioLine> &lines)
+    {
+        ScopedLatency latency(OP_CLIENT_PORTFOLIO);
+        TraceSpan span("clientPortfolio");
+        vector<Portfolio> portfolios = loadPortfolios();
+
+        Portfolio *entry = findEntry(portfolios, id);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+
+        // Market prices indexed by symbol id, stocks that are not listed any more are worth nothing
+        vector<int64_t> prices = stockList().pricesBySymbol(symbolTable().size());
+
+        clientName = entry->name;
+        for (auto &stock : entry->stocks)
+        {
+            PortfolioLine line = {symbolName(stock.symbol), (int)stock.numberOfShares, Money()};
+            if (stock.symbol < prices.size())
+                line.value = Money::fromPaisa(prices[stock.symbol]) * line.numberOfShares;
+            lines.push_back(line);
+        }
+        return true;
+    }
+
+    // Close of the stock on the day of the time, or on the latest day before it with a close
+    optional<Money> priceAsOf(long long stockId, int64_t time)
+    {
+        ScopedLatency latency(OP_AS_OF);
+        TraceSpan span("priceAsOf");
+        const PriceBar *bar = priceHistoryStore().onOrBefore(stockId, dayOf(time));
+        if (bar == nullptr)
+            return nullopt;
+        return bar->close;
+    }
+
+    // The client's balance and holdings as they were at the time, each holding valued at its close
+    // on that day (see priceAsOf); a stock without a close by then is worth nothing. Served from the
+    // latest ledger checkpoint before the time and the client's own events after it. Returns false
+    // if the ledger does not go back that far or the client had neither registered nor traded.
+    bool clientPortfolioAsOf(long long id, int64_t time, string &clientName, Money &balance,
+                             vector<PortfolioLine> &lines)
+    {
+        ScopedLatency latency(OP_AS_OF);
+        TraceSpan span("clientPortfolioAsOf");
+        ClientAsOf state;
+        lock_guard<recursive_mutex> guard(ledger::journalLock()); // compaction may be swapping the journal
+        if (!pointInTime.query(id, time, state) || (!state.client.has_value() && !state.portfolio.has_value()))
+            return false;
+
+        clientName = state.client.has_value() ? state.client->getName() : state.portfolio->name;
+        balance = state.portfolio.has_value() ? state.portfolio->balance : Money();
+        if (!state.portfolio.has_value())
+            return true;
+        PriceHistory &history = priceHistoryStore();
+        for (auto &stock : state.portfolio->stocks)
+        {
+            PortfolioLine line = {symbolName(stock.symbol), (int)stock.numberOfShares, Money()};
+            const PriceBar *bar = history.onOrBefore(stock.stockId, dayOf(time));
+            if (bar != nullptr)
+                line.value = bar->close * line.numberOfShares;
+            lines.push_back(line);
+        }
+        return true;
+    }
+
+    // Values every portfolio at the current market prices. The shares and prices are gathered into
+    // flat arrays of paisa so that the totals are computed by the integer bulk kernels.
+    BookValue bookValue()
+    {
+        ScopedLatency latency(OP_BOOK_VALUE);
+        TraceSpan span("bookValue");
+        vector<Portfolio> portfolios = loadPortfolios();
+        const StockTable &listed = stockList();
+
+        vector<int64_t> balances, shares, holdingPrices;
+        balances.reserve(portfolios.size());
+        for (auto &entry : portfolios)
+        {
+            balances.push_back(entry.balance.getPaisa());
+            for (auto &stock : entry.stocks)
+            {
+                size_t row = listed.find(stock.stockId);
+                shares.push_back(stock.numberOfShares);
+                holdingPrices.push_back(row != StockTable::NO_ROW ? listed.priceColumn()[row] : 0);
+            }
+        }
+
+        BookValue book;
+        book.cash = Money::fromPaisa(moneykernels::sum(balances.data(), balances.size()));
+        book.holdings = Money::fromPaisa(moneykernels::dot(shares.data(), holdingPrices.data(), shares.size()));
+        book.positions = shares.size();
+        return book;
+    }
+
+    // Credits (or debits, for negative amounts) many balances in one pass and one save. Clients
+    // without a portfolio entry are skipped. Either every change is applied or, if a balance would
+    // overflow, none is.
+    bool settleBalances(const vector<pair<long long, Money>> &changes)
+    {
+        ScopedLatency latency(OP_SETTLE_BALANCES);
+        TraceSpan span("settleBalances");
+        openLedger();
+        vector<Portfolio> portfolios = loadPortfolios();
+
+        unordered_map<long long, size_t> rows;
+        for (size_t i = 0; i < portfolios.size(); i++)
+            rows.emplace(portfolios[i].id, i);
+
+        vector<int64_t> balances(portfolios.size()), deltas(portfolios.size(), 0);
+        for (size_t i = 0; i < portfolios.size(); i++)
+            balances[i] = portfolios[i].balance.getPaisa();
+        for (auto &change : changes)
+        {
+            auto row = rows.find(change.first);
+            if (row != rows.end())
+                deltas[row->second] = checkedAdd(deltas[row->second], change.second.getPaisa());
+        }
+
+        if (!moneykernels::settle(balances.data(), deltas.data(), balances.size()))
+            return false;
+        for (size_t i = 0; i < portfolios.size(); i++)
+            portfolios[i].balance = Money::fromPaisa(balances[i]);
+
+        vector<CashMovement> movements;
+        vector<LedgerEvent> events;
+        int64_t now = (int64_t)::time(nullptr);
+        for (size_t i = 0; i < portfolios.size(); i++)
+        {
+            if (deltas[i] == 0)
+                continue;
+            movements.push_back({Money::fromPaisa(deltas[i]), portfolios[i].id, now, "settlement"});
+            events.push_back(ledger::cash("settle", portfolios[i].id, Money::fromPaisa(deltas[i]), now));
+        }
+
+        DailySummaries &views = summaryViews();
+        recordEvents(events);
+        savePortfolios(portfolios, 3);
+        appendCashMovements(movements);
+        views.recordCash(Money::fromPaisa(moneykernels::sum(deltas.data(), deltas.size())));
+        saveSummaries();
+        return true;
+    }
+
+    // Trade count, volume, turnover and price range of the trades that pass the query, by stock,
+    // client or day
+    vector<AggregateRow> aggregateTrades(const AggregateQuery &query)
+    {
+        ScopedLatency latency(OP_AGGREGATE_TRADES);
+        TraceSpan span("aggregateTrades");
+        if (!tradeColumnsBuilt)
+        {
+            size_t count = 0;
+            for (auto &entry : historyList())
+                count += entry.transactions.size();
+            tradeColumns.reserve(count);
+            for (auto &entry : histories)
+                for (auto &transaction : entry.transactions)
+                    tradeColumns.append(transaction);
+            tradeColumnsBuilt = true;
+        }
+        return tradeColumns.aggregate(query);
+    }
+
+    // Cash held by every client of the book together
+    Money bookCash()
+    {
+        ScopedLatency latency(OP_DAILY_SUMMARY);
+        return summaryViews().bookCash();
+    }
+
+    // What the client bought and sold on the day of the time (epoch seconds)
+    ClientFlow clientDailyFlow(long long id, int64_t time)
+    {
+        ScopedLatency latency(OP_DAILY_SUMMARY);
+        return summaryViews().clientFlow(id, time);
+    }
+
+    // Trades, volume and turnover of the stock on the day of the time
+    StockActivity stockDailyActivity(long long stockId, int64_t time)
+    {
+        ScopedLatency latency(OP_DAILY_SUMMARY);
+        return summaryViews().stockActivity(stockId, time);
+    }
+
+    // Recomputes the views from the ledger: the trades from transactions.json and the cash from
+    // the balances in portfolio.json
+    void rebuildSummaries()
+    {
+        TraceSpan span("rebuildSummaries");
+        summaries.clear();
+        for (auto &entry : historyList())
+            for (auto &transaction : entry.transactions)
+                summaries.recordTrade(transaction);
+        vector<int64_t> balances;
+        for (auto &entry : loadPortfolios())
+            balances.push_back(entry.balance.getPaisa());
+        summaries.recordCash(Money::fromPaisa(moneykernels::sum(balances.data(), balances.size())));
+        summariesLoaded = true;
+        saveSummaries();
+    }
+
+    // Collects every transaction made by the client, oldest first
+    bool clientTransactions(long long id, string &clientName, vector<Transaction> &transactions)
+    {
+        ScopedLatency latency(OP_CLIENT_TRANSACTIONS);
+        TraceSpan span("clientTransactions");
+        bool clientFound = false;
+        clientName = findClientName(id, &clientFound);
+
+        historyList();
+        collect(clientTrades.range(id, INT64_MIN, INT64_MAX), transactions);
+        return clientFound;
+    }
+
+    // Transactions of the client made at from <= time < to (epoch seconds), oldest first
+    vector<Transaction> clientTransactionsBetween(long long id, int64_t from, int64_t to)
+    {
+        ScopedLatency latency(OP_TRANSACTION_RANGE);
+        TraceSpan span("clientTransactionsBetween");
+        vector<Transaction> transactions;
+        historyList();
+        collect(clientTrades.range(id, from, to), transactions);
+        return transactions;
+    }
+
+    // Trades in the stock made at from <= time < to, by every client, oldest first
+    vector<Transaction> stockTransactionsBetween(long long stockId, int64_t from, int64_t to)
+    {
+        ScopedLatency latency(OP_TRANSACTION_RANGE);
+        TraceSpan span("stockTransactionsBetween");
+        vector<Transaction> transactions;
+        historyList();
+        collect(stockTrades.range(stockId, from, to), transactions);
+        return transactions;
+    }
+
+private:
+    // The symbol table is read on first use, from the directory the engine works in
+    SymbolTable &symbolTable()
+    {
+        if (!symbolsLoaded)
+        {
+            symbols.load("symbols.json");
+            symbolsLoaded = true;
+        }
+        return symbols;
+    }
+
+    // The client and stock files are read on first use, like the symbol table
+    Slab<Client> &clientList()
+    {
+        if (!clientsLoaded)
+        {
+            vector<Client> records = loadRecords<Client>("added_clients.json");
+            clients.reserve(records.size());
+            for (auto &client : records)
+                clients.insert(move(client));
+            clientsLoaded = true;
+        }
+        return clients;
+    }
+
+    StockTable &stockList()
+    {
+        if (!stocksLoaded)
+        {
+            for (auto &stock : loadRecords<StockList>("added_stocks.json"))
+                listedStocks.append(stock, symbolTable().intern(stock.getStockName()));
+            stocksLoaded = true;
+        }
+        return listedStocks;
+    }
+
+    PriceHistory &priceHistoryStore()
+    {
+        if (!priceHistoryLoaded)
+        {
+            priceHistory.load("price_history.json");
+            priceHistoryLoaded = true;
+        }
+        return priceHistory;
+    }
+
+    // The transaction history is read on first use and indexed by client and by stock
+    vector<TransactionHistory> &historyList()
+    {
+        if (!historiesLoaded)
+        {
+            histories = loadHistories();
+            vector<TimeIndex::Posting> byClient, byStock;
+            for (size_t e = 0; e < histories.size(); e++)
+            {
+                historyByName.emplace(histories[e].name, e);
+                const vector<Transaction> &transactions = histories[e].transactions;
+                for (size_t k = 0; k < transactions.size(); k++)
+                {
+                    byClient.push_back({transactions[k].id, transactions[k].timestamp, (uint32_t)e, (uint32_t)k});
+                    byStock.push_back({transactions[k].stockId, transactions[k].timestamp, (uint32_t)e, (uint32_t)k});
+                }
+            }
+            clientTrades.build(move(byClient));
+            stockTrades.build(move(byStock));
+            historiesLoaded = true;
+        }
+        return histories;
+    }
+
+    // The views are read on first use, and rebuilt from the ledger if summaries.json is missing
+    DailySummaries &summaryViews()
+    {
+        if (!summariesLoaded)
+        {
+            if (summaries.load("summaries.json"))
+                summariesLoaded = true;
+            else
+                rebuildSummaries();
+        }
+        return summaries;
+    }
+
+    void saveSummaries()
+    {
+        if (summariesLoaded && summaries.isDirty())
+            summaries.save("summaries.json");
+    }
+
+    void appendTransaction(size_t entry, const Transaction &transaction)
+    {
+        DailySummaries &views = summaryViews(); // a rebuild must not see the transaction yet
+        vector<Transaction> &transactions = histories[entry].transactions;
+        transactions.push_back(transaction);
+        uint32_t position = (uint32_t)transactions.size() - 1;
+        clientTrades.add({transaction.id, transaction.timestamp, (uint32_t)entry, position});
+        stockTrades.add({transaction.stockId, transaction.timestamp, (uint32_t)entry, position});
+        if (tradeColumnsBuilt)
+            tradeColumns.append(transaction);
+        views.recordTrade(transaction);
+    }
+
+    void collect(const vector<TimeIndex::Posting> &postings, vector<Transaction> &transactions) const
+    {
+        transactions.reserve(transactions.size() + postings.size());
+        for (auto &posting : postings)
+            transactions.push_back(histories[posting.entry].transactions[posting.position]);
+    }
+
+    // The sequences start above every id in use the first time they are needed; after that ids
+    // come from sequences.json alone
+    long long reserveIds(const string &sequence, long long count)
+    {
+        if (!idAllocator.has(sequence))
+        {
+            long long highest = 0;
+            if (sequence == "clients")
+            {
+                for (auto &client : clientList())
+                    highest = max(highest, client.getId());
+                for (auto &client : loadRecords<Client>("removed_clients.json"))
+                    highest = max(highest, client.getId());
+            }
+            else
+            {
+                for (size_t row = 0; row < stockList().size(); row++)
+                    highest = max(highest, listedStocks.id(row));
+                for (auto &stock : loadRecords<StockList>("removed_stocks.json"))
+                    highest = max(highest, stock.getId());
+            }
+            idAllocator.create(sequence, highest + 1);
+        }
+        return idAllocator.reserve(sequence, count);
+    }
+
+    void internName(optional<string> &stockName, uint32_t &symbol)
+    {
+        if (!stockName.has_value())
+            return;
+        symbol = symbolTable().intern(*stockName);
+        stockName.reset();
+    }
+
+    // Books from before events were recorded get a first checkpoint of how they are, so that
+    // replay starts from there. Called before an operation changes anything.
+    void openLedger()
+    {
+        if (ledgerOpened)
+            return;
+        ledger::finishCompaction(".");
+        lock_guard<recursive_mutex> guard(ledger::journalLock());
+        if (endOfRecords("events.json") < 0)
+        {
+            LedgerCheckpoint first;
+            first.clients = clientList().toVector();
+            first.removed = loadRecords<Client>("removed_clients.json");
+            first.portfolios = loadPortfolios();
+            saveSymbols();
+            if (!writeWholeFile("events.json", "[]\n"))
+                throw runtime_error("cannot write events.json");
+            first.offset = endOfRecords("events.json");
+            ledger::saveCheckpoint(".", first);
+        }
+        ledgerOpened = true;
+    }
+
+    void recordEvents(const vector<LedgerEvent> &events)
+    {
+        lock_guard<recursive_mutex> guard(ledger::journalLock());
+        saveSymbols();
+        appendRecords("events.json", events, 0);
+    }
+
+    // New symbols are saved before any record that refers to them
+    void saveSymbols()
+    {
+        lock_guard<recursive_mutex> guard(ledger::journalLock());
+        if (symbolsLoaded && symbols.isDirty())
+            symbols.save("symbols.json");
+    }
+
+    // The stock lists are written under the journal lock, so a compaction snapshot sees them whole
+    void saveStocks(const vector<StockList> *removedStocks = nullptr)
+    {
+        lock_guard<recursive_mutex> guard(ledger::journalLock());
+        saveRecords("added_stocks.json", listedStocks.toRecords(), 3);
+        if (removedStocks != nullptr)
+            saveRecords("removed_stocks.json", *removedStocks, 3);
+    }
+
+    void savePortfolios(const vector<Portfolio> &portfolios, int indent)
+    {
+        saveSymbols();
+        saveRecords("portfolio.json", portfolios, indent);
+    }
+
+    // Deposits and settlements are kept in cash_movements.json, so statements can tell them from
+    // trades. They are appended like the events, so a deposit costs the same however long the
+    // history is.
+    void appendCashMovements(const vector<CashMovement> &movements)
+    {
+        lock_guard<recursive_mutex> guard(ledger::journalLock());
+        appendRecords("cash_movements.json", movements, 4);
+    }
+
+    void saveHistories(const vector<TransactionHistory> &histories)
+    {
+        saveSymbols();
+        saveRecords("transactions.json", histories, 4);
+    }
+
+    bool clientExists(long long id)
+    {
+        TraceSpan phase("clientLookup");
+        bool found = false;
+        findClientName(id, &found);
+        return found;
+    }
+
+    string findClientName(long long id, bool *found = nullptr)
+    {
+        const Client *client = findClient(id);
+        if (found != nullptr)
+            *found = client != nullptr;
+        return client != nullptr ? client->getName() : "";
+    }
+
+    // Fills in the name and market price of the stock and gives its row, NO_ROW if it is not listed
+    size_t lookupStock(long long stockId, TradeResult &result)
+    {
+        TraceSpan phase("stockLookup");
+        size_t row = stockList().find(stockId);
+        if (row == StockTable::NO_ROW)
+            return row;
+        result.price = listedStocks.price(row);
+        result.stockName = listedStocks.name(row);
+        return row;
+    }
+
+    Portfolio *findEntry(vector<Portfolio> &portfolios, long long id)
+    {
+        for (auto &entry : portfolios)
+        {
+            if (entry.id == id)
+            {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    Transaction makeTransaction(long long id, long long stockId, const string &stockName, int numStocks, Money price,
+                                Money totalCost, const string &type, int64_t time)
+    {
+        Transaction transaction;
+        transaction.id = id;
+        transaction.stockId = stockId;
+        transaction.symbol = symbolTable().intern(stockName);
+        transaction.numberOfShares = numStocks;
+        transaction.price = price;
+        transaction.totalCost = totalCost;
+        transaction.type = type;
+        transaction.timestamp = time;
+        return transaction;
+    }
+};
+
+#endif
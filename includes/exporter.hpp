@@ -0,0 +1,542 @@
+#ifndef EXPORTER_HPP
+#define EXPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+
+#include "records.hpp"
+#include "parallel_scan.hpp"
+#include "symbols.hpp"
+#include "time_index.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+enum ExportFormat
+{
+    CSV_FORMAT,
+    COLUMNAR_FORMAT
+};
+
+enum ColumnType
+{
+    INTEGER_COLUMN,
+    MONEY_COLUMN, // paisa, written to CSV in rupees
+    TEXT_COLUMN
+};
+
+struct ExportColumn
+{
+    const char *name;
+    ColumnType type;
+};
+
+// The values of a batch of rows, column by column. Integer and money columns fill numbers,
+// text columns fill texts.
+struct RowGroup
+{
+    vector<vector<int64_t>> numbers;
+    vector<vector<string>> texts;
+    size_t rows = 0;
+
+    RowGroup(size_t columns) : numbers(columns), texts(columns) {}
+};
+
+// Throughput of one exported table
+struct ExportReport
+{
+    string table;
+    long long rows;
+    long long bytes;
+    double seconds;
+};
+
+// Encoding of row groups. Columnar files ("NSAC1") are laid out as:
+//   the magic "NSAC1\n";
+//   the schema: a varint column count, then per column a type byte and a length prefixed name;
+//   the row groups, each a varint row count followed by one chunk per column;
+//   a varint 0 in place of the next row count.
+// A chunk is the column's statistics, the varint byte length of its data, and the data, so a
+// reader can skip a column or a whole row group from the statistics alone.
+// Integer and money columns hold the first value and then the differences between neighbours,
+// as zigzag varints; ids and times that grow slowly take a byte or two each. Their statistics are
+// the minimum and the maximum, as zigzag varints.
+// Text columns are dictionary encoded: a varint count of distinct values, the values length
+// prefixed in order of first use, then a varint index per row. Their statistics are the smallest
+// and the largest value, length prefixed.
+// decode reads such a file back into row groups.
+namespace columnar
+{
+    inline void putVarint(string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out += char((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    inline uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+    inline void putText(string &out, const string &text)
+    {
+        putVarint(out, text.size());
+        out += text;
+    }
+
+    inline void putNumbers(string &out, const vector<int64_t> &values)
+    {
+        string data;
+        int64_t low = values.empty() ? 0 : values[0], high = low, previous = 0;
+        for (int64_t value : values)
+        {
+            low = min(low, value);
+            high = max(high, value);
+            putVarint(data, zigzag((int64_t)((uint64_t)value - (uint64_t)previous)));
+            previous = value;
+        }
+        putVarint(out, zigzag(low));
+        putVarint(out, zigzag(high));
+        putVarint(out, data.size());
+        out += data;
+    }
+
+    inline void putTexts(string &out, const vector<string> &values)
+    {
+        unordered_map<string, uint64_t> codes;
+        vector<const string *> dictionary;
+        string indexes;
+        const string *low = nullptr, *high = nullptr;
+        for (const string &value : values)
+        {
+            auto code = codes.emplace(value, dictionary.size());
+            if (code.second)
+            {
+                dictionary.push_back(&code.first->first);
+                if (low == nullptr || value < *low)
+                    low = &code.first->first;
+                if (high == nullptr || value > *high)
+                    high = &code.first->first;
+            }
+            putVarint(indexes, code.first->second);
+        }
+
+        string data;
+        putVarint(data, dictionary.size());
+        for (const string *value : dictionary)
+            putText(data, *value);
+        data += indexes;
+
+        putText(out, low != nullptr ? *low : "");
+        putText(out, high != nullptr ? *high : "");
+        putVarint(out, data.size());
+        out += data;
+    }
+
+    inline string header(const vector<ExportColumn> &columns)
+    {
+        string out = "NSAC1\n";
+        putVarint(out, columns.size());
+        for (auto &column : columns)
+        {
+            out += char(column.type);
+            putText(out, column.name);
+        }
+        return out;
+    }
+
+    inline string encode(const vector<ExportColumn> &columns, const RowGroup &group)
+    {
+        string out;
+        putVarint(out, group.rows);
+        for (size_t c = 0; c < columns.size(); c++)
+        {
+            if (columns[c].type == TEXT_COLUMN)
+                putTexts(out, group.texts[c]);
+            else
+                putNumbers(out, group.numbers[c]);
+        }
+        return out;
+    }
+
+    // Reads values back from encoded bytes, throwing if they end too soon
+    struct Reader
+    {
+        const char *at;
+        const char *end;
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (at == end)
+                    throw runtime_error("columnar data ends in a number");
+                uint8_t byte = (uint8_t)*at++;
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                    return value;
+            }
+            throw runtime_error("columnar data has a number that is too long");
+        }
+
+        int64_t zigzagVarint()
+        {
+            uint64_t value = varint();
+            return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        }
+
+        // The next size bytes, as a reader of their own
+        Reader take(uint64_t size)
+        {
+            if (size > (uint64_t)(end - at))
+                throw runtime_error("columnar data ends too soon");
+            Reader part = {at, at + size};
+            at += size;
+            return part;
+        }
+
+        string text()
+        {
+            Reader part = take(varint());
+            return string(part.at, part.end);
+        }
+    };
+
+    // Reads a columnar file back, handing visit(columns, group) every row group in file order.
+    // Statistics are read past. Throws if the bytes are not NSAC1 or end too soon.
+    template <typename Visitor>
+    void decode(const string &data, Visitor visit)
+    {
+        if (data.compare(0, 6, "NSAC1\n") != 0)
+            throw runtime_error("not an NSAC1 file");
+        Reader in = {data.data() + 6, data.data() + data.size()};
+
+        vector<string> names;
+        vector<ExportColumn> columns;
+        uint64_t count = in.varint();
+        if (count > (uint64_t)(in.end - in.at))
+            throw runtime_error("columnar schema has a bad column count");
+        for (uint64_t c = 0; c < count; c++)
+        {
+            ColumnType type = (ColumnType)(uint8_t)*in.take(1).at;
+            if (type != INTEGER_COLUMN && type != MONEY_COLUMN && type != TEXT_COLUMN)
+                throw runtime_error("columnar schema has an unknown column type");
+            names.push_back(in.text());
+            columns.push_back({nullptr, type});
+        }
+        for (size_t c = 0; c < columns.size(); c++)
+            columns[c].name = names[c].c_str();
+
+        for (uint64_t rows = in.varint(); rows != 0; rows = in.varint())
+        {
+            if (!columns.empty() && rows > (uint64_t)(in.end - in.at)) // every value takes a byte at least
+                throw runtime_error("columnar row group has a bad row count");
+            RowGroup group(columns.size());
+            group.rows = (size_t)rows;
+            for (size_t c = 0; c < columns.size(); c++)
+            {
+                if (columns[c].type == TEXT_COLUMN)
+                {
+                    in.text(); // the statistics
+                    in.text();
+                    Reader chunk = in.take(in.varint());
+                    uint64_t distinct = chunk.varint();
+                    if (distinct > (uint64_t)(chunk.end - chunk.at))
+                        throw runtime_error("columnar text column has a bad dictionary");
+                    vector<string> dictionary((size_t)distinct);
+                    for (auto &value : dictionary)
+                        value = chunk.text();
+                    vector<string> &values = group.texts[c];
+                    values.reserve(group.rows);
+                    for (size_t row = 0; row < group.rows; row++)
+                    {
+                        uint64_t index = chunk.varint();
+                        if (index >= dictionary.size())
+                            throw runtime_error("columnar text column has a bad index");
+                        values.push_back(dictionary[(size_t)index]);
+                    }
+                }
+                else
+                {
+                    in.varint(); // the statistics
+                    in.varint();
+                    Reader chunk = in.take(in.varint());
+                    int64_t value = 0;
+                    vector<int64_t> &values = group.numbers[c];
+                    values.reserve(group.rows);
+                    for (size_t row = 0; row < group.rows; row++)
+                    {
+                        value = (int64_t)((uint64_t)value + (uint64_t)chunk.zigzagVarint());
+                        values.push_back(value);
+                    }
+                }
+            }
+            visit(columns, group);
+        }
+    }
+}
+
+namespace csv
+{
+    // Quotes the field only if it holds a separator, a quote or a line break
+    inline void putField(string &out, const string &field)
+    {
+        if (field.find_first_of(",\"\r\n") == string::npos)
+        {
+            out += field;
+            return;
+        }
+        out += '"';
+        for (char ch : field)
+        {
+            if (ch == '"')
+                out += '"';
+            out += ch;
+        }
+        out += '"';
+    }
+
+    inline string header(const vector<ExportColumn> &columns)
+    {
+        string out;
+        for (size_t c = 0; c < columns.size(); c++)
+        {
+            if (c > 0)
+                out += ',';
+            putField(out, columns[c].name);
+        }
+        out += "\r\n";
+        return out;
+    }
+
+    inline string encode(const vector<ExportColumn> &columns, const RowGroup &group)
+    {
+        string out;
+        char buffer[24];
+        for (size_t row = 0; row < group.rows; row++)
+        {
+            for (size_t c = 0; c < columns.size(); c++)
+            {
+                if (c > 0)
+                    out += ',';
+                if (columns[c].type == TEXT_COLUMN)
+                    putField(out, group.texts[c][row]);
+                else if (columns[c].type == MONEY_COLUMN)
+                    out += Money::fromPaisa(group.numbers[c][row]).toString();
+                else
+                    out.append(buffer, to_chars(buffer, buffer + sizeof(buffer), (long long)group.numbers[c][row]).ptr);
+            }
+            out += "\r\n";
+        }
+        return out;
+    }
+}
+
+// Checks that a columnar export holds the same rows as the CSV export of the same table: the
+// columnar file is decoded and every row group written as CSV again, which must give the CSV
+// file byte for byte. Returns the number of rows; on a difference, says where in what.
+inline long long compareExports(const string &columnarPath, const string &csvPath, string &what)
+{
+    string data, written;
+    if (!readWholeFile(columnarPath, data))
+        throw runtime_error("cannot read " + columnarPath);
+    long long rows = 0, offset = 0;
+    what.clear();
+    columnar::decode(data, [&](const vector<ExportColumn> &columns, const RowGroup &group) {
+        if (!what.empty())
+            return;
+        written = offset == 0 ? csv::header(columns) : "";
+        written += csv::encode(columns, group);
+        string expected;
+        if (!readFileRange(csvPath, offset, written.size(), expected) || expected != written)
+        {
+            what = csvPath + " differs in the rows after row " + to_string(rows);
+            return;
+        }
+        offset += (long long)written.size();
+        rows += (long long)group.rows;
+    });
+    if (what.empty() && offset != (long long)filesystem::file_size(csvPath))
+        what = csvPath + " has more rows than " + columnarPath;
+    return rows;
+}
+
+// Streams the ledger files of a book into CSV or columnar files for outside analysis.
+// The source file is read in parallel batches (see parallelRecords): each thread fills row groups
+// from the records of its batch and encodes them, and the results are written in file order.
+// Memory is bounded by the batches in flight, whatever the size of the book.
+class Exporter
+{
+private:
+    string dir;
+    ExportFormat format;
+    unsigned threads;
+    size_t rowGroupRows;
+    SymbolTable symbols;
+
+    // Name of the stock of a holding or transaction, from the record if it was written before symbols
+    string stockName(const optional<string> &name, uint32_t symbol) const
+    {
+        if (name.has_value())
+            return *name;
+        return symbol < symbols.size() ? symbols.name(symbol) : "";
+    }
+
+    string encode(const vector<ExportColumn> &columns, const RowGroup &group) const
+    {
+        return format == CSV_FORMAT ? csv::encode(columns, group) : columnar::encode(columns, group);
+    }
+
+    void write(FILE *file, const string &data, ExportReport &report)
+    {
+        if (fwrite(data.data(), 1, data.size(), file) != data.size())
+            throw runtime_error("cannot write " + report.table);
+        report.bytes += data.size();
+    }
+
+    // Streams the records of the source file through fill, which adds their rows to a row group.
+    // fill runs on the worker threads and must only touch the group it is given.
+    template <typename T, typename Fill>
+    ExportReport run(const string &table, const string &source, const vector<ExportColumn> &columns, const string &outPath,
+                     Fill fill)
+    {
+        ScopedLatency latency(OP_EXPORT);
+        TraceSpan span("export", "storage", table.c_str());
+        auto start = chrono::steady_clock::now();
+        ExportReport report = {table, 0, 0, 0};
+        FILE *file = fopen(outPath.c_str(), "wb");
+        if (file == nullptr)
+            throw runtime_error("cannot open " + outPath + " for writing");
+        try
+        {
+            write(file, format == CSV_FORMAT ? csv::header(columns) : columnar::header(columns), report);
+
+            // Each batch becomes its rows encoded, a row group every rowGroupRows rows
+            auto convert = [&](vector<T> &records) {
+                pair<long long, string> encoded(0, "");
+                RowGroup group(columns.size());
+                for (auto &record : records)
+                {
+                    fill(record, group);
+                    if (group.rows >= rowGroupRows)
+                    {
+                        encoded.first += group.rows;
+                        encoded.second += encode(columns, group);
+                        group = RowGroup(columns.size());
+                    }
+                }
+                if (group.rows > 0)
+                {
+                    encoded.first += group.rows;
+                    encoded.second += encode(columns, group);
+                }
+                return encoded;
+            };
+            parallelRecords<T>(dir + "/" + source, threads, convert, [&](pair<long long, string> &encoded) {
+                report.rows += encoded.first;
+                write(file, encoded.second, report);
+            });
+            if (format == COLUMNAR_FORMAT)
+                write(file, string(1, '\0'), report);
+        }
+        catch (...)
+        {
+            fclose(file);
+            throw;
+        }
+        if (fclose(file) != 0)
+            throw runtime_error("cannot write " + outPath);
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+public:
+    Exporter(const string &dir, ExportFormat format, unsigned threads = thread::hardware_concurrency(),
+             size_t rowGroupRows = 65536)
+        : dir(dir), format(format), threads(max(threads, 1u)), rowGroupRows(max<size_t>(rowGroupRows, 1))
+    {
+        symbols.load(dir + "/symbols.json");
+    }
+
+    // One row per transaction of transactions.json
+    ExportReport exportTransactions(const string &outPath)
+    {
+        static const vector<ExportColumn> columns = {
+            {"clientId", INTEGER_COLUMN}, {"client", TEXT_COLUMN}, {"stockId", INTEGER_COLUMN}, {"stock", TEXT_COLUMN},
+            {"type", TEXT_COLUMN},        {"shares", INTEGER_COLUMN}, {"price", MONEY_COLUMN},  {"total", MONEY_COLUMN},
+            {"time", INTEGER_COLUMN}};
+        return run<TransactionHistory>("transactions", "transactions.json", columns, outPath,
+                                       [&](const TransactionHistory &entry, RowGroup &group) {
+                                           for (auto &t : entry.transactions)
+                                           {
+                                               group.numbers[0].push_back(t.id);
+                                               group.texts[1].push_back(entry.name);
+                                               group.numbers[2].push_back(t.stockId);
+                                               group.texts[3].push_back(stockName(t.stockName, t.symbol));
+                                               group.texts[4].push_back(t.type);
+                                               group.numbers[5].push_back(t.numberOfShares);
+                                               group.numbers[6].push_back(t.price.getPaisa());
+                                               group.numbers[7].push_back(t.totalCost.getPaisa());
+                                               group.numbers[8].push_back(t.time.has_value() ? parseCtime(*t.time) : t.timestamp);
+                                               group.rows++;
+                                           }
+                                       });
+    }
+
+    // One row per client of portfolio.json
+    ExportReport exportBalances(const string &outPath)
+    {
+        static const vector<ExportColumn> columns = {{"clientId", INTEGER_COLUMN}, {"client", TEXT_COLUMN}, {"balance", MONEY_COLUMN}};
+        return run<Portfolio>("balances", "portfolio.json", columns, outPath, [&](const Portfolio &entry, RowGroup &group) {
+            group.numbers[0].push_back(entry.id);
+            group.texts[1].push_back(entry.name);
+            group.numbers[2].push_back(entry.balance.getPaisa());
+            group.rows++;
+        });
+    }
+
+    // One row per holding of portfolio.json
+    ExportReport exportHoldings(const string &outPath)
+    {
+        static const vector<ExportColumn> columns = {{"clientId", INTEGER_COLUMN}, {"stockId", INTEGER_COLUMN},
+                                                     {"stock", TEXT_COLUMN},       {"shares", INTEGER_COLUMN},
+                                                     {"purchasedRate", MONEY_COLUMN}};
+        return run<Portfolio>("holdings", "portfolio.json", columns, outPath, [&](const Portfolio &entry, RowGroup &group) {
+            for (auto &holding : entry.stocks)
+            {
+                group.numbers[0].push_back(entry.id);
+                group.numbers[1].push_back(holding.stockId);
+                group.texts[2].push_back(stockName(holding.stockName, holding.symbol));
+                group.numbers[3].push_back(holding.numberOfShares);
+                group.numbers[4].push_back(holding.purchasedRate.getPaisa());
+                group.rows++;
+            }
+        });
+    }
+
+    // One row per listed stock of added_stocks.json
+    ExportReport exportPrices(const string &outPath)
+    {
+        static const vector<ExportColumn> columns = {{"stockId", INTEGER_COLUMN}, {"stock", TEXT_COLUMN},
+                                                     {"price", MONEY_COLUMN},     {"previousClose", MONEY_COLUMN}};
+        return run<StockList>("prices", "added_stocks.json", columns, outPath, [&](const StockList &stock, RowGroup &group) {
+            group.numbers[0].push_back(stock.getId());
+            group.texts[1].push_back(stock.getStockName());
+            group.numbers[2].push_back(stock.getMarketPrice().getPaisa());
+            group.numbers[3].push_back(stock.getPreviousClose().getPaisa());
+            group.rows++;
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,500 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sysinfo.hpp"
+#include "symbols.hpp"
+
+using namespace std;
+
+// Settings for a synthetic population of stocks, clients and trades
+struct GeneratorConfig
+{
+    long long clients = 1000;       // number of registered clients
+    int stocks = 50;                // number of listed symbols
+    long long trades = 100000;      // target number of trades over the whole book
+    unsigned long long seed = 2023; // same seed, same data set
+    double symbolSkew = 1.1;        // Zipf exponent of symbol popularity
+    double activityShape = 1.2;     // Pareto shape of client activity, lower means heavier tail
+    double fundedRatio = 0.85;      // share of clients that ever deposit money
+    int watchlistSize = 8;          // distinct symbols a single client trades in
+    long long startTime = 1672531200; // first trading day (01/01/2023 UTC)
+    int days = 365;                 // length of the trading window in days
+    string outDir = ".";            // directory the storage files are written to
+};
+
+// Throughput and memory figures of one generation stage
+struct StageReport
+{
+    string stage;
+    long long records;
+    long long bytes;
+    double seconds;
+    long long memoryKB;
+    long long peakMemoryKB;
+};
+
+// Buffered writer used to stream the storage files without building a JSON document
+class StreamWriter
+{
+private:
+    FILE *file;
+    string buffer;
+    long long written;
+
+public:
+    StreamWriter(const string &path) : file(fopen(path.c_str(), "wb")), written(0)
+    {
+        if (file == nullptr)
+            throw runtime_error("cannot open " + path + " for writing");
+        buffer.reserve(1 << 20);
+    }
+
+    ~StreamWriter() { close(); }
+
+    void put(const string &s) { buffer += s; spill(); }
+    void put(const char *s) { buffer += s; spill(); }
+    void put(char ch) { buffer += ch; }
+
+    // Appends s as a quoted JSON string
+    void quoted(const string &s)
+    {
+        buffer += '"';
+        for (char ch : s)
+        {
+            switch (ch)
+            {
+            case '"': buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\t': buffer += "\\t"; break;
+            default: buffer += ch;
+            }
+        }
+        buffer += '"';
+    }
+
+    // Appends an amount held in paisa as a decimal rupee value
+    void money(long long paisa)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%s%lld.%02lld", paisa < 0 ? "-" : "", llabs(paisa) / 100, llabs(paisa) % 100);
+        buffer += text;
+    }
+
+    void number(long long value) { buffer += to_string(value); }
+
+    long long bytes() const { return written + buffer.size(); }
+
+    void close()
+    {
+        if (file == nullptr)
+            return;
+        flush();
+        fclose(file);
+        file = nullptr;
+    }
+
+private:
+    void spill()
+    {
+        if (buffer.size() >= (1 << 20))
+            flush();
+    }
+
+    void flush()
+    {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        written += buffer.size();
+        buffer.clear();
+    }
+};
+
+// Formats an epoch time the way ctime() does, including the trailing newline
+inline string formatCtime(long long epoch)
+{
+    static const char *weekdays[] = {"Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed"};
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    long long days = epoch / 86400;
+    long long secs = epoch % 86400;
+
+    // Civil date from days since 01/01/1970
+    long long z = days + 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    long long doe = z - era * 146097;
+    long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long long mp = (5 * doy + 2) / 153;
+    long long day = doy - (153 * mp + 2) / 5 + 1;
+    long long month = mp < 10 ? mp + 3 : mp - 9;
+    long long year = yoe + era * 400 + (month <= 2);
+
+    char text[64];
+    snprintf(text, sizeof(text), "%s %s %2d %02d:%02d:%02d %d\n", weekdays[((days % 7) + 7) % 7], months[month - 1],
+             int(day), int(secs / 3600), int((secs / 60) % 60), int(secs % 60), int(year));
+    return text;
+}
+
+// Produces a realistic synthetic book in the storage format read by the analyzer
+class LoadGenerator
+{
+private:
+    GeneratorConfig config;
+    mt19937_64 gen;
+    vector<long long> pricePaisa; // market price of every symbol
+    vector<string> symbols;       // stock name of every symbol
+    vector<double> symbolCdf;     // cumulative Zipf weights used to draw symbols
+    vector<StageReport> reports;
+
+public:
+    LoadGenerator(const GeneratorConfig &config) : config(config), gen(config.seed)
+    {
+        if (config.clients < 1)
+            throw invalid_argument("clients must be positive");
+        if (config.stocks < 1)
+            throw invalid_argument("stocks must be positive");
+        if (config.trades < 0)
+            throw invalid_argument("trades must not be negative");
+    }
+
+    const vector<StageReport> &getReports() const { return reports; }
+
+    void run()
+    {
+        generateStocks();
+        generateClients();
+        generateTrades();
+    }
+
+    // Writes added_stocks.json with lognormally distributed prices and Zipf popularity
+    void generateStocks()
+    {
+        Stopwatch sw;
+        StreamWriter out(config.outDir + "/added_stocks.json");
+
+        static const char *listed[] = {"NABIL", "NICA", "SCB", "HBL", "EBL", "NMB", "SBI", "KBL", "PRVU", "GBIME",
+                                       "ADBL", "CZBIL", "MBL", "SANIMA", "NTC", "NIFRA", "UPPER", "CHCL", "HIDCL", "NLIC",
+                                       "LICN", "NLG", "SHL", "OHL", "BPCL", "API", "NHPC", "SICL", "PCBL", "CIT"};
+        const int listedCount = sizeof(listed) / sizeof(listed[0]);
+
+        lognormal_distribution<> priceDis(log(500.0), 0.9);
+        out.put("[\n");
+        double total = 0;
+        for (int i = 0; i < config.stocks; i++)
+        {
+            string name;
+            if (i < listedCount)
+            {
+                name = listed[i];
+            }
+            else
+            {
+                // Synthetic four letter ticker followed by the symbol number to keep it unique
+                for (int k = 0; k < 4; k++)
+                    name += char('A' + gen() % 26);
+                name += to_string(i);
+            }
+            double price = min(20000.0, max(100.0, priceDis(gen)));
+            long long paisa = llround(price * 100);
+
+            symbols.push_back(name);
+            pricePaisa.push_back(paisa);
+            total += 1.0 / pow(i + 1, config.symbolSkew);
+            symbolCdf.push_back(total);
+
+            out.put(i == 0 ? "   {" : ",\n   {");
+            out.put("\"marketPrice\":");
+            out.money(paisa);
+            out.put(",\"stockId\":");
+            out.number(i + 1);
+            out.put(",\"stockName\":");
+            out.quoted(name);
+            out.put('}');
+        }
+        out.put("\n]\n");
+        out.close();
+
+        // The symbol id of a stock is its position in the list
+        StreamWriter symbolsOut(config.outDir + "/symbols.json");
+        symbolsOut.put("[\n");
+        for (size_t i = 0; i < symbols.size(); i++)
+        {
+            symbolsOut.put(i == 0 ? "   {\"id\":" : ",\n   {\"id\":");
+            symbolsOut.number(i);
+            symbolsOut.put(",\"name\":");
+            symbolsOut.quoted(symbols[i]);
+            symbolsOut.put(",\"ticker\":");
+            symbolsOut.quoted(Ticker::fromString(symbols[i]).toString());
+            symbolsOut.put('}');
+        }
+        symbolsOut.put("\n]\n");
+        symbolsOut.close();
+
+        report("stocks", config.stocks, out.bytes() + symbolsOut.bytes(), sw.seconds());
+    }
+
+    // Writes added_clients.json with sequential ids and generated names, addresses and birth dates
+    void generateClients()
+    {
+        Stopwatch sw;
+        StreamWriter out(config.outDir + "/added_clients.json");
+
+        out.put("[\n");
+        for (long long id = 1; id <= config.clients; id++)
+        {
+            // Every field is derived from one hash of the id, which is much cheaper than seeding a generator per client
+            static const char *cities[] = {"Kathmandu", "Lalitpur", "Bhaktapur", "Pokhara", "Biratnagar", "Birgunj",
+                                           "Butwal", "Dharan", "Hetauda", "Nepalgunj", "Itahari", "Janakpur"};
+            unsigned long long h = mix(-id);
+            string address = cities[h % 12];
+            char dob[16];
+            snprintf(dob, sizeof(dob), "%02d/%02d/%04d", int((h >> 8) % 28 + 1), int((h >> 16) % 12 + 1), int((h >> 24) % 55 + 1950));
+
+            out.put(id == 1 ? "    {" : ",\n    {");
+            out.put("\"address\":");
+            out.quoted(address);
+            out.put(",\"dob\":");
+            out.quoted(dob);
+            out.put(",\"id\":");
+            out.number(id);
+            out.put(",\"name\":");
+            out.quoted(clientName(id));
+            out.put('}');
+        }
+        out.put("\n]");
+        out.close();
+
+        report("clients", config.clients, out.bytes(), sw.seconds());
+    }
+
+    // Writes portfolio.json, transactions.json and cash_movements.json, one client at a time so
+    // memory stays flat. Every funded client gets an opening deposit at the start of the window,
+    // so their balance is what the deposit and their trades add up to.
+    void generateTrades()
+    {
+        Stopwatch sw;
+        StreamWriter portfolio(config.outDir + "/portfolio.json");
+        StreamWriter transactions(config.outDir + "/transactions.json");
+        StreamWriter movements(config.outDir + "/cash_movements.json");
+
+        // Pareto activity weights decide how the trade budget is split between funded clients
+        uniform_real_distribution<> unit(0.0, 1.0);
+        vector<float> weights(config.clients);
+        double totalWeight = 0;
+        for (long long i = 0; i < config.clients; i++)
+        {
+            bool funded = unit(gen) < config.fundedRatio;
+            weights[i] = funded ? float(pow(1.0 - unit(gen), -1.0 / config.activityShape)) : 0.0f;
+            totalWeight += weights[i];
+        }
+
+        long long tradeCount = 0;
+        bool firstPortfolio = true, firstTransactions = true;
+        portfolio.put("[\n");
+        transactions.put("[\n");
+        movements.put("[\n");
+
+        vector<long long> times;
+        vector<pair<int, long long>> holdings;        // symbol, shares
+        vector<pair<long long, long long>> costBasis; // paisa spent, last purchase time
+        for (long long id = 1; id <= config.clients; id++)
+        {
+            if (weights[id - 1] == 0.0f)
+                continue;
+
+            double expected = totalWeight > 0 ? config.trades * weights[id - 1] / totalWeight : 0;
+            long long count = (long long)expected + (unit(gen) < expected - floor(expected) ? 1 : 0);
+
+            // Watch list of symbols this client trades in, drawn by popularity
+            vector<int> watchlist;
+            for (int k = 0; k < config.watchlistSize; k++)
+            {
+                int symbol = drawSymbol();
+                if (find(watchlist.begin(), watchlist.end(), symbol) == watchlist.end())
+                    watchlist.push_back(symbol);
+            }
+
+            // Trades happen on random days between 11:00 and 15:00 NPT (05:15 to 09:15 UTC)
+            times.resize(count);
+            for (auto &t : times)
+                t = config.startTime + (long long)(gen() % config.days) * 86400 + 18900 + (long long)(gen() % 14400);
+            sort(times.begin(), times.end());
+
+            // Capital grows with activity so that busy clients can actually afford their trades
+            lognormal_distribution<> depositDis(log(100000.0 * (1.0 + count / 10.0)), 1.0);
+            long long balance = llround(depositDis(gen) * 100);
+            movements.put(firstPortfolio ? "    {\"amount\":" : ",\n    {\"amount\":");
+            movements.money(balance);
+            movements.put(",\"clientId\":");
+            movements.number(id);
+            movements.put(",\"time\":");
+            movements.number(config.startTime);
+            movements.put(",\"type\":\"deposit\"}");
+            holdings.clear();
+            costBasis.clear();
+
+            string name = clientName(id);
+            bool firstTrade = true;
+            for (long long t : times)
+            {
+                int symbol = watchlist[gen() % watchlist.size()];
+                long long price = pricePaisa[symbol] + (long long)((unit(gen) - 0.5) * 0.1 * pricePaisa[symbol]);
+                price = max(price, 100LL);
+
+                size_t slot = 0;
+                while (slot < holdings.size() && holdings[slot].first != symbol)
+                    slot++;
+
+                bool sell = slot < holdings.size() && unit(gen) < 0.35;
+                long long shares;
+                if (sell)
+                {
+                    shares = max(1LL, (long long)(holdings[slot].second * unit(gen)));
+                }
+                else
+                {
+                    shares = 10 * (1 + (long long)(-log(1.0 - unit(gen)) / 0.35));
+                    shares = min(shares, balance / price);
+                    if (shares <= 0)
+                    {
+                        // Out of cash, so raise some by selling part of the first holding instead
+                        if (holdings.empty())
+                            continue;
+                        sell = true;
+                        slot = 0;
+                        symbol = holdings[0].first;
+                        shares = max(1LL, holdings[0].second / 2);
+                    }
+                }
+
+                long long total = price * shares;
+                if (sell)
+                {
+                    balance += total;
+                    long long remaining = holdings[slot].second - shares;
+                    costBasis[slot].first -= costBasis[slot].first * shares / holdings[slot].second;
+                    holdings[slot].second = remaining;
+                    if (remaining == 0)
+                    {
+                        holdings.erase(holdings.begin() + slot);
+                        costBasis.erase(costBasis.begin() + slot);
+                    }
+                }
+                else
+                {
+                    balance -= total;
+                    if (slot == holdings.size())
+                    {
+                        holdings.push_back({symbol, 0});
+                        costBasis.push_back({0, 0});
+                    }
+                    holdings[slot].second += shares;
+                    costBasis[slot].first += total;
+                    costBasis[slot].second = t;
+                }
+
+                if (firstTrade)
+                {
+                    transactions.put(firstTransactions ? "    {\"name\":" : ",\n    {\"name\":");
+                    transactions.quoted(name);
+                    transactions.put(",\"transactions\":[\n");
+                    firstTransactions = false;
+                }
+                transactions.put(firstTrade ? "        {\"id\":" : ",\n        {\"id\":");
+                transactions.number(id);
+                transactions.put(",\"numberOfShares\":");
+                transactions.number(shares);
+                transactions.put(",\"price\":");
+                transactions.money(price);
+                transactions.put(",\"stockId\":");
+                transactions.number(symbol + 1);
+                transactions.put(",\"symbol\":");
+                transactions.number(symbol);
+                transactions.put(",\"timestamp\":");
+                transactions.number(t);
+                transactions.put(",\"totalCost\":");
+                transactions.money(total);
+                transactions.put(sell ? ",\"type\":\"sell\"}" : ",\"type\":\"purchase\"}");
+                firstTrade = false;
+                tradeCount++;
+            }
+            if (!firstTrade)
+                transactions.put("\n    ]}");
+
+            portfolio.put(firstPortfolio ? "   {\"balance\":" : ",\n   {\"balance\":");
+            portfolio.money(balance);
+            portfolio.put(",\"id\":");
+            portfolio.number(id);
+            portfolio.put(",\"name\":");
+            portfolio.quoted(name);
+            portfolio.put(",\"stocks\":[");
+            for (size_t k = 0; k < holdings.size(); k++)
+            {
+                int symbol = holdings[k].first;
+                portfolio.put(k == 0 ? "\n      {\"numberOfShares\":" : ",\n      {\"numberOfShares\":");
+                portfolio.number(holdings[k].second);
+                portfolio.put(",\"purchaseTime\":");
+                portfolio.quoted(formatCtime(costBasis[k].second));
+                portfolio.put(",\"purchasedRate\":");
+                portfolio.money(costBasis[k].first / holdings[k].second);
+                portfolio.put(",\"stockId\":");
+                portfolio.number(symbol + 1);
+                portfolio.put(",\"symbol\":");
+                portfolio.number(symbol);
+                portfolio.put('}');
+            }
+            portfolio.put(holdings.empty() ? "]}" : "\n   ]}");
+            firstPortfolio = false;
+        }
+        portfolio.put("\n]\n");
+        transactions.put("\n]");
+        movements.put("\n]\n");
+        portfolio.close();
+        transactions.close();
+        movements.close();
+
+        report("trades", tradeCount, portfolio.bytes() + transactions.bytes() + movements.bytes(), sw.seconds());
+    }
+
+    // Deterministic client name so every stage agrees without keeping names in memory
+    string clientName(long long id) const
+    {
+        static const char *first[] = {"Aman", "Sita", "Ram", "Hari", "Gita", "Bishal", "Anisha", "Suman", "Kiran", "Pooja",
+                                      "Rajesh", "Sarita", "Prakash", "Sunita", "Bikash", "Manisha", "Dipak", "Asmita"};
+        static const char *last[] = {"Khadka", "Sharma", "Shrestha", "Thapa", "Gurung", "Adhikari", "Karki", "Rai",
+                                     "Tamang", "Magar", "Maharjan", "Poudel", "Bhandari", "Koirala", "Joshi", "Basnet"};
+        unsigned long long h = mix(id);
+        return string(first[h % 18]) + " " + last[(h >> 20) % 16];
+    }
+
+private:
+    int drawSymbol()
+    {
+        uniform_real_distribution<> dis(0.0, symbolCdf.back());
+        return int(lower_bound(symbolCdf.begin(), symbolCdf.end(), dis(gen)) - symbolCdf.begin());
+    }
+
+    // splitmix64 of the id and the seed
+    unsigned long long mix(long long id) const
+    {
+        unsigned long long z = config.seed + 0x9E3779B97F4A7C15ULL * (unsigned long long)id;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    void report(const string &stage, long long records, long long bytes, double seconds)
+    {
+        reports.push_back({stage, records, bytes, seconds, currentMemoryKB(), peakMemoryKB()});
+    }
+};
+
+#endif
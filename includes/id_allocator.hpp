@@ -0,0 +1,105 @@
+#ifndef ID_ALLOCATOR_HPP
+#define ID_ALLOCATOR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+
+#include "records.hpp"
+
+using namespace std;
+
+// A named sequence as stored in sequences.json: every id below next has been handed out
+struct SequenceRecord
+{
+    string name;
+    long long next = 1;
+
+    static auto fields() { return make_tuple(field("name", &SequenceRecord::name), field("next", &SequenceRecord::next)); }
+};
+
+// Hands out 64-bit ids from persistent monotonic sequences, so an id is never given twice and
+// nothing has to be searched to prove it. Ids are leased from the file in blocks: the file records
+// the end of the lease, and ids inside it are handed out from memory. A restart skips what was left
+// of the lease, which leaves a gap but never a duplicate.
+class IdAllocator
+{
+private:
+    struct Sequence
+    {
+        long long next;     // next id to hand out
+        long long leaseEnd; // first id not covered by the saved lease
+    };
+
+    string path;
+    long long blockSize;
+    map<string, Sequence> sequences;
+    bool loaded = false;
+
+    void load()
+    {
+        if (loaded)
+            return;
+        for (auto &record : loadRecords<SequenceRecord>(path))
+            sequences[record.name] = {record.next, record.next};
+        loaded = true;
+    }
+
+    void save()
+    {
+        vector<SequenceRecord> records;
+        for (auto &sequence : sequences)
+            records.push_back({sequence.first, sequence.second.leaseEnd});
+        saveRecords(path, records, 4);
+    }
+
+    // Makes sure the ids [next, next + count) are covered by a saved lease
+    void lease(Sequence &sequence, long long count)
+    {
+        if (sequence.next + count <= sequence.leaseEnd)
+            return;
+        sequence.leaseEnd = checkedAdd(sequence.next, max(count, blockSize));
+        save();
+    }
+
+public:
+    IdAllocator(const string &path = "sequences.json", long long blockSize = 64) : path(path), blockSize(blockSize) {}
+
+    // True if the sequence has ever been used or saved
+    bool has(const string &name)
+    {
+        load();
+        return sequences.count(name) != 0;
+    }
+
+    // Starts a new sequence at the first id, nothing happens if it already exists
+    void create(const string &name, long long first)
+    {
+        load();
+        if (sequences.count(name) == 0)
+            sequences[name] = {first, first};
+    }
+
+    // The next id of the sequence
+    long long allocate(const string &name) { return reserve(name, 1); }
+
+    // Reserves count consecutive ids with at most one write and returns the first one
+    long long reserve(const string &name, long long count)
+    {
+        if (count <= 0)
+            throw invalid_argument("id reservation must be positive");
+        load();
+        auto it = sequences.find(name);
+        if (it == sequences.end())
+            it = sequences.emplace(name, Sequence{1, 1}).first;
+
+        Sequence &sequence = it->second;
+        lease(sequence, count);
+        long long first = sequence.next;
+        sequence.next += count;
+        return first;
+    }
+};
+
+#endif
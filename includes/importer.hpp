@@ -0,0 +1,665 @@
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+#include <atomic>
+#include <filesystem>
+#include <charconv>
+#include <cstring>
+#include <cctype>
+#include <ctime>
+
+#include "engine.hpp"
+#include "storage.hpp"
+#include "time_index.hpp"
+#include "price_history.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// A row that failed validation, by its file and its line in the file counted from 1
+struct ImportError
+{
+    string file;
+    size_t line;
+    string message;
+};
+
+// Outcome of one import. Nothing is written unless every row is valid.
+struct ImportReport
+{
+    string table;
+    size_t rows;
+    long long firstId; // ids run consecutively from here, 0 if nothing was imported
+    double seconds;
+    vector<ImportError> errors; // the first MAX_ERRORS of them
+    size_t errorCount;
+    size_t skipped;                // valid rows left out: repeated days, symbols that are not listed
+    vector<string> unknownSymbols; // the first MAX_ERRORS of them
+};
+
+namespace csvimport
+{
+    constexpr size_t MAX_FIELD = 200;
+
+    // One line of a CSV file, split into fields. Fields may be quoted ("Kathmandu, Nepal") with
+    // doubled quotes inside; a field cannot span lines. Unquoted fields are trimmed.
+    inline bool splitLine(const char *begin, const char *end, vector<string> &fields, string &error)
+    {
+        fields.clear();
+        if (end > begin && end[-1] == '\r')
+            end--;
+        const char *p = begin;
+        while (true)
+        {
+            string field;
+            while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+            if (p < end && *p == '"')
+            {
+                p++;
+                while (true)
+                {
+                    const char *quote = (const char *)memchr(p, '"', end - p);
+                    if (quote == nullptr)
+                    {
+                        error = "unterminated quoted field";
+                        return false;
+                    }
+                    field.append(p, quote);
+                    p = quote + 1;
+                    if (p < end && *p == '"')
+                    {
+                        field += '"';
+                        p++;
+                    }
+                    else
+                        break;
+                }
+                while (p < end && (*p == ' ' || *p == '\t'))
+                    p++;
+                if (p < end && *p != ',')
+                {
+                    error = "text after a quoted field";
+                    return false;
+                }
+            }
+            else
+            {
+                const char *comma = (const char *)memchr(p, ',', end - p);
+                const char *last = comma != nullptr ? comma : end;
+                const char *trimmed = last;
+                while (trimmed > p && (trimmed[-1] == ' ' || trimmed[-1] == '\t'))
+                    trimmed--;
+                field.assign(p, trimmed);
+                p = last;
+            }
+            fields.push_back(move(field));
+            if (p >= end)
+                return true;
+            p++; // the comma
+        }
+    }
+
+    // Days in the month of the year, months counted from 1
+    inline int daysInMonth(int year, int month)
+    {
+        static const int daysIn[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return daysIn[month - 1] + (month == 2 && leap);
+    }
+
+    // A DD/MM/YYYY date of birth that is a real, past date
+    inline bool validBirthDate(const string &text, int64_t today)
+    {
+        int day = 0, month = 0, year = 0;
+        const char *p = text.data(), *end = text.data() + text.size();
+        auto part = [&](int &value, size_t digits, bool last) {
+            auto parsed = from_chars(p, end, value);
+            if (parsed.ec != errc() || (size_t)(parsed.ptr - p) != digits)
+                return false;
+            p = parsed.ptr;
+            if (last)
+                return p == end;
+            if (p == end || *p != '/')
+                return false;
+            p++;
+            return true;
+        };
+        if (!part(day, 2, false) || !part(month, 2, false) || !part(year, 4, true))
+            return false;
+        if (month < 1 || month > 12 || day < 1 || year < 1900 || day > daysInMonth(year, month))
+            return false;
+        return epochOfDate(year, month, day) <= today;
+    }
+
+    // A real YYYY-MM-DD or YYYY/MM/DD date as the epoch second of its UTC midnight; a day past the
+    // end of its month ("2023-02-30") is refused. A time after the date ("2023-01-02 00:00:00")
+    // is ignored.
+    inline bool parseDate(const string &text, int64_t &day)
+    {
+        int year = 0, month = 0, date = 0;
+        const char *p = text.data(), *end = text.data() + text.size();
+        auto parsed = from_chars(p, end, year);
+        if (parsed.ec != errc() || parsed.ptr - p != 4 || parsed.ptr == end)
+            return false;
+        char separator = *parsed.ptr;
+        if (separator != '-' && separator != '/')
+            return false;
+        p = parsed.ptr + 1;
+        parsed = from_chars(p, end, month);
+        if (parsed.ec != errc() || parsed.ptr - p < 1 || parsed.ptr - p > 2 || parsed.ptr == end || *parsed.ptr != separator)
+            return false;
+        p = parsed.ptr + 1;
+        parsed = from_chars(p, end, date);
+        if (parsed.ec != errc() || parsed.ptr - p < 1 || parsed.ptr - p > 2)
+            return false;
+        if (parsed.ptr != end && *parsed.ptr != ' ' && *parsed.ptr != 'T')
+            return false;
+        if (month < 1 || month > 12 || date < 1 || date > daysInMonth(year, month))
+            return false;
+        day = epochOfDate(year, month, date);
+        return true;
+    }
+
+    // An amount such as "1,234.50"; thousands separators are dropped
+    inline bool parseAmount(string text, Money &amount)
+    {
+        text.erase(remove(text.begin(), text.end(), ','), text.end());
+        return Money::parse(text, amount);
+    }
+
+    // A whole count such as "12,500" or "12500.00"
+    inline bool parseCount(string text, long long &count)
+    {
+        text.erase(remove(text.begin(), text.end(), ','), text.end());
+        const char *end = text.data() + text.size();
+        auto parsed = from_chars(text.data(), end, count);
+        if (parsed.ec != errc() || parsed.ptr == text.data())
+            return false;
+        const char *p = parsed.ptr;
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && *p == '0'; p++)
+                ;
+        }
+        return p == end;
+    }
+
+    inline string lower(string text)
+    {
+        for (char &ch : text)
+            ch = (char)tolower((unsigned char)ch);
+        return text;
+    }
+}
+
+// Imports clients, stocks and daily price history from CSV files into the books of an engine.
+// The file is mapped into memory and cut at line ends into one chunk per thread; each thread
+// splits, converts and validates the rows of its chunk on its own, and the chunks are joined in
+// file order. Every row is checked before anything is written, so a file with a bad row
+// changes nothing. The rows then get consecutive ids from one reservation and are saved with
+// a single write of the records file.
+// Clients need the columns name, address and dob (DD/MM/YYYY); stocks need name and price.
+// The first line names the columns, in any order, and other columns such as id are ignored.
+// Price files are daily OHLCV dumps of NEPSE symbols (see importPrices).
+class Importer
+{
+public:
+    static constexpr size_t MAX_ERRORS = 20;
+
+private:
+    StockEngine &engine;
+    unsigned threads;
+
+    // The rows of one chunk and what was wrong with them, lines counted from the chunk start
+    template <typename T>
+    struct Chunk
+    {
+        const char *begin;
+        const char *end;
+        vector<T> rows;
+        vector<size_t> rowLines;
+        vector<ImportError> errors;
+        size_t errorCount = 0;
+        size_t lines = 0;
+    };
+
+    // A row of a price file, before its symbol is looked up
+    struct PriceRow
+    {
+        string symbol;
+        PriceBar bar;
+    };
+
+    // Column positions of the header, -1 for a missing column. A name may list other names the
+    // column goes by, as "close|ltp".
+    static vector<int> columnsOf(const vector<string> &header, const vector<string> &names)
+    {
+        vector<int> columns;
+        for (auto &name : names)
+        {
+            int found = -1;
+            for (size_t c = 0; c < header.size(); c++)
+            {
+                string key = "|" + csvimport::lower(header[c]) + "|";
+                if (("|" + name + "|").find(key) != string::npos)
+                    found = (int)c;
+            }
+            columns.push_back(found);
+        }
+        return columns;
+    }
+
+    static string columnName(const string &name) { return name.substr(0, name.find('|')); }
+
+    // Splits the file into chunks, parses them on up to parts threads with convert(fields, row,
+    // error) and joins the rows in file order, with the line of each row in rowLines if it is
+    // given. The first required columns must be in the file; the others are empty when missing.
+    template <typename T, typename Convert>
+    ImportReport parse(const string &path, const string &table, const vector<string> &names, size_t required,
+                       Convert convert, vector<T> &rows, vector<size_t> *rowLines, unsigned parts)
+    {
+        ImportReport report = {table, 0, 0, 0, {}, 0, 0, {}};
+        MappedFile file;
+        if (!file.open(path))
+            throw runtime_error("cannot open " + path);
+        const char *data = file.data(), *end = data + file.size();
+        if (end - data >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+            data += 3; // the byte order mark spreadsheets write
+        if (data == end)
+            throw runtime_error(path + ": no header line");
+
+        // The header line
+        const char *newline = (const char *)memchr(data, '\n', end - data);
+        const char *bodyStart = newline != nullptr ? newline + 1 : end;
+        vector<string> header;
+        string error;
+        if (!csvimport::splitLine(data, newline != nullptr ? newline : end, header, error))
+            throw runtime_error(path + ": line 1: " + error);
+        vector<int> columns = columnsOf(header, names);
+        for (size_t c = 0; c < required; c++)
+        {
+            if (columns[c] < 0)
+                throw runtime_error(path + ": no " + columnName(names[c]) + " column");
+        }
+
+        // Chunks end at a line end near an even share of the file
+        size_t count = max<size_t>(1, min<size_t>(max(parts, 1u), (end - bodyStart) / (1 << 16) + 1));
+        vector<Chunk<T>> chunks(count);
+        const char *begin = bodyStart;
+        for (size_t k = 0; k < count; k++)
+        {
+            const char *cut = k + 1 == count ? end : bodyStart + (end - bodyStart) * (k + 1) / count;
+            if (cut < begin)
+                cut = begin;
+            if (cut < end)
+            {
+                const char *lineEnd = (const char *)memchr(cut, '\n', end - cut);
+                cut = lineEnd != nullptr ? lineEnd + 1 : end;
+            }
+            chunks[k].begin = begin;
+            chunks[k].end = cut;
+            begin = cut;
+        }
+
+        auto parseChunk = [&](Chunk<T> &chunk) {
+            vector<string> fields;
+            vector<string> picked(names.size());
+            string message;
+            chunk.rows.reserve((chunk.end - chunk.begin) / 48);
+            for (const char *p = chunk.begin; p < chunk.end;)
+            {
+                const char *lineEnd = (const char *)memchr(p, '\n', chunk.end - p);
+                if (lineEnd == nullptr)
+                    lineEnd = chunk.end;
+                chunk.lines++;
+                const char *next = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+                bool blank = lineEnd == p || (lineEnd == p + 1 && *p == '\r');
+                if (blank)
+                {
+                    p = next;
+                    continue;
+                }
+
+                T row;
+                bool valid = csvimport::splitLine(p, lineEnd, fields, message);
+                if (valid)
+                {
+                    for (size_t c = 0; c < names.size() && valid; c++)
+                    {
+                        if (columns[c] < 0)
+                            picked[c].clear();
+                        else if ((size_t)columns[c] >= fields.size())
+                        {
+                            message = "missing " + columnName(names[c]);
+                            valid = false;
+                        }
+                        else if (fields[columns[c]].size() > csvimport::MAX_FIELD)
+                        {
+                            message = columnName(names[c]) + " is too long";
+                            valid = false;
+                        }
+                        else
+                            picked[c] = move(fields[columns[c]]);
+                    }
+                }
+                if (valid)
+                    valid = convert(picked, row, message);
+                if (valid)
+                {
+                    chunk.rows.push_back(move(row));
+                    if (rowLines != nullptr)
+                        chunk.rowLines.push_back(chunk.lines);
+                }
+                else
+                {
+                    if (chunk.errors.size() < MAX_ERRORS)
+                        chunk.errors.push_back({path, chunk.lines, message});
+                    chunk.errorCount++;
+                }
+                p = next;
+            }
+        };
+
+        if (count == 1)
+            parseChunk(chunks[0]);
+        else
+        {
+            // an error in a worker is rethrown here
+            vector<exception_ptr> failures(count);
+            vector<thread> workers;
+            for (size_t k = 0; k < count; k++)
+            {
+                workers.emplace_back([&, k]() {
+                    try
+                    {
+                        parseChunk(chunks[k]);
+                    }
+                    catch (...)
+                    {
+                        failures[k] = current_exception();
+                    }
+                });
+            }
+            for (auto &worker : workers)
+                worker.join();
+            for (auto &failure : failures)
+            {
+                if (failure)
+                    rethrow_exception(failure);
+            }
+        }
+
+        // Line numbers become file lines; the header is line 1
+        size_t total = 0, linesBefore = 1;
+        for (auto &chunk : chunks)
+        {
+            total += chunk.rows.size();
+            for (auto &failure : chunk.errors)
+            {
+                if (report.errors.size() < MAX_ERRORS)
+                    report.errors.push_back({path, linesBefore + failure.line, failure.message});
+            }
+            report.errorCount += chunk.errorCount;
+            linesBefore += chunk.lines;
+        }
+        if (report.errorCount > 0)
+            return report;
+
+        rows.reserve(total);
+        linesBefore = 1;
+        for (auto &chunk : chunks)
+        {
+            move(chunk.rows.begin(), chunk.rows.end(), back_inserter(rows));
+            vector<T>().swap(chunk.rows);
+            if (rowLines != nullptr)
+            {
+                for (size_t line : chunk.rowLines)
+                    rowLines->push_back(linesBefore + line);
+            }
+            linesBefore += chunk.lines;
+        }
+        return report;
+    }
+
+public:
+    Importer(StockEngine &engine, unsigned threads = thread::hardware_concurrency())
+        : engine(engine), threads(max(threads, 1u))
+    {
+    }
+
+    ImportReport importClients(const string &path)
+    {
+        auto start = chrono::steady_clock::now();
+        int64_t today = (int64_t)time(nullptr);
+        vector<Client> rows;
+        ImportReport report = parse<Client>(
+            path, "clients", {"name", "address", "dob"}, 3,
+            [today](vector<string> &fields, Client &client, string &message) {
+                if (fields[0].empty())
+                    message = "name is empty";
+                else if (fields[1].empty())
+                    message = "address is empty";
+                else if (!csvimport::validBirthDate(fields[2], today))
+                    message = "dob is not a past date as DD/MM/YYYY: " + fields[2];
+                else
+                {
+                    client = Client(move(fields[0]), 0, move(fields[1]), move(fields[2]));
+                    return true;
+                }
+                return false;
+            },
+            rows, nullptr, threads);
+
+        if (report.errorCount == 0)
+        {
+            report.rows = rows.size();
+            report.firstId = engine.importClients(move(rows));
+        }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    // Stock names must be new: listed stocks and the rest of the file may not have them
+    ImportReport importStocks(const string &path)
+    {
+        auto start = chrono::steady_clock::now();
+        vector<StockList> rows;
+        vector<size_t> lines;
+        ImportReport report = parse<StockList>(
+            path, "stocks", {"name", "price"}, 2,
+            [](vector<string> &fields, StockList &stock, string &message) {
+                Money price;
+                if (fields[0].empty())
+                    message = "name is empty";
+                else if (!csvimport::parseAmount(fields[1], price) || price <= Money())
+                    message = "price is not a positive amount: " + fields[1];
+                else
+                {
+                    stock = StockList(0, move(fields[0]), price);
+                    return true;
+                }
+                return false;
+            },
+            rows, &lines, threads);
+
+        // Names are checked against each other on this thread, the files are small
+        if (report.errorCount == 0)
+        {
+            const StockTable &listed = engine.allStocks();
+            unordered_set<string> names;
+            for (size_t row = 0; row < listed.size(); row++)
+                names.insert(csvimport::lower(listed.name(row)));
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+                if (!names.insert(csvimport::lower(rows[i].getStockName())).second)
+                {
+                    if (report.errors.size() < MAX_ERRORS)
+                        report.errors.push_back({path, lines[i], "stock " + rows[i].getStockName() + " is already listed"});
+                    report.errorCount++;
+                }
+            }
+        }
+
+        if (report.errorCount == 0)
+        {
+            report.rows = rows.size();
+            report.firstId = engine.importStocks(move(rows));
+        }
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    // Loads daily OHLCV files into the price history and sets every stock in them to its last
+    // close. The columns are date, open, high, low, close (or ltp) and volume (or qty), as in
+    // the NEPSE dumps; a file without a symbol column holds the symbol its name says
+    // (NABIL.csv). Files are parsed one per thread, or in chunks when there is only one.
+    // Files may overlap: a day repeated for a symbol keeps the bar of the file listed last.
+    // Rows of symbols that are not listed are left out and named in the report.
+    ImportReport importPrices(const vector<string> &paths)
+    {
+        auto start = chrono::steady_clock::now();
+        const vector<string> names = {"date|business_date", "open|open_price", "high|high_price", "low|low_price",
+                                      "close|ltp|close_price", "volume|qty|total_traded_quantity", "symbol|stock_symbol"};
+        vector<vector<PriceRow>> perFile(paths.size());
+        vector<ImportReport> reports(paths.size());
+
+        auto parseFile = [&](size_t f, unsigned parts) {
+            string fileSymbol = filesystem::path(paths[f]).stem().string();
+            reports[f] = parse<PriceRow>(
+                paths[f], "prices", names, 6,
+                [&fileSymbol](vector<string> &fields, PriceRow &row, string &message) {
+                    PriceBar &bar = row.bar;
+                    if (!csvimport::parseDate(fields[0], bar.day))
+                        message = "date is not a real YYYY-MM-DD date: " + fields[0];
+                    else if (!csvimport::parseAmount(fields[1], bar.open) || !csvimport::parseAmount(fields[2], bar.high) ||
+                             !csvimport::parseAmount(fields[3], bar.low) || !csvimport::parseAmount(fields[4], bar.close))
+                        message = "a price is not an amount";
+                    else if (bar.low <= Money() || bar.low > bar.high || bar.open < bar.low || bar.open > bar.high ||
+                             bar.close < bar.low || bar.close > bar.high)
+                        message = "prices are not positive with low <= open, close <= high";
+                    else if (!csvimport::parseCount(fields[5], bar.volume) || bar.volume < 0)
+                        message = "volume is not a whole number: " + fields[5];
+                    else
+                    {
+                        row.symbol = fields[6].empty() ? fileSymbol : move(fields[6]);
+                        return true;
+                    }
+                    return false;
+                },
+                perFile[f], nullptr, parts);
+        };
+
+        if (paths.size() == 1 || threads == 1)
+        {
+            for (size_t f = 0; f < paths.size(); f++)
+                parseFile(f, threads);
+        }
+        else
+        {
+            // an error in a worker is rethrown here
+            size_t count = min<size_t>(threads, paths.size());
+            atomic<size_t> next(0);
+            vector<exception_ptr> failures(count);
+            vector<thread> workers;
+            for (size_t k = 0; k < count; k++)
+            {
+                workers.emplace_back([&, k]() {
+                    try
+                    {
+                        for (size_t f = next++; f < paths.size(); f = next++)
+                            parseFile(f, 1);
+                    }
+                    catch (...)
+                    {
+                        failures[k] = current_exception();
+                    }
+                });
+            }
+            for (auto &worker : workers)
+                worker.join();
+            for (auto &failure : failures)
+            {
+                if (failure)
+                    rethrow_exception(failure);
+            }
+        }
+
+        ImportReport report = {"prices", 0, 0, 0, {}, 0, 0, {}};
+        for (auto &one : reports)
+        {
+            for (auto &error : one.errors)
+            {
+                if (report.errors.size() < MAX_ERRORS)
+                    report.errors.push_back(error);
+            }
+            report.errorCount += one.errorCount;
+        }
+        if (report.errorCount > 0)
+        {
+            report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            return report;
+        }
+
+        // Bars by stock in file order, each symbol looked up once
+        unordered_map<string, long long> stockOf;
+        unordered_map<long long, vector<PriceBar>> barsOf;
+        for (auto &rows : perFile)
+        {
+            for (auto &row : rows)
+            {
+                auto found = stockOf.find(row.symbol);
+                if (found == stockOf.end())
+                {
+                    found = stockOf.emplace(row.symbol, engine.findStockBySymbol(row.symbol)).first;
+                    if (found->second == 0 && report.unknownSymbols.size() < MAX_ERRORS)
+                        report.unknownSymbols.push_back(row.symbol);
+                }
+                if (found->second == 0)
+                    report.skipped++;
+                else
+                    barsOf[found->second].push_back(row.bar);
+            }
+            vector<PriceRow>().swap(rows);
+        }
+
+        // One bar per day, the last one read
+        vector<PriceSeries> batch;
+        batch.reserve(barsOf.size());
+        for (auto &entry : barsOf)
+        {
+            vector<PriceBar> &bars = entry.second;
+            stable_sort(bars.begin(), bars.end(), [](const PriceBar &a, const PriceBar &b) { return a.day < b.day; });
+            size_t kept = 0;
+            for (size_t i = 0; i < bars.size(); i++)
+            {
+                if (kept > 0 && bars[kept - 1].day == bars[i].day)
+                {
+                    bars[kept - 1] = bars[i];
+                    report.skipped++;
+                }
+                else
+                    bars[kept++] = bars[i];
+            }
+            bars.resize(kept);
+            report.rows += kept;
+            batch.push_back({move(bars), entry.first});
+        }
+        sort(batch.begin(), batch.end(), [](const PriceSeries &a, const PriceSeries &b) { return a.stockId < b.stockId; });
+        engine.importPriceHistory(batch);
+
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+};
+
+#endif
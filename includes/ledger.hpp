@@ -0,0 +1,559 @@
+#ifndef LEDGER_HPP
+#define LEDGER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <filesystem>
+#include <mutex>
+#include <cstdint>
+
+#include "records.hpp"
+#include "binary_records.hpp"
+#include "parallel_scan.hpp"
+#include "symbols.hpp"
+#include "time_index.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// One change to the book, an entry of events.json. Events are only ever appended; balances,
+// holdings and the client registry are what replaying them gives.
+struct LedgerEvent
+{
+    optional<string> address; // register
+    Money amount;             // deposit and settle: the change to the balance; buy and sell: the total
+    long long clientId = 0;
+    optional<string> dob;     // register
+    string kind;              // "register", "remove", "deposit", "settle", "buy" or "sell"
+    optional<string> name;    // register
+    optional<Money> price;    // buy and sell
+    optional<long long> shares;
+    optional<long long> stockId;
+    optional<uint32_t> symbol; // buy and sell
+    int64_t time = 0;
+
+    static auto fields()
+    {
+        return make_tuple(field("address", &LedgerEvent::address), field("amount", &LedgerEvent::amount),
+                          field("clientId", &LedgerEvent::clientId), field("dob", &LedgerEvent::dob),
+                          field("kind", &LedgerEvent::kind), field("name", &LedgerEvent::name),
+                          field("price", &LedgerEvent::price), field("shares", &LedgerEvent::shares),
+                          field("stockId", &LedgerEvent::stockId), field("symbol", &LedgerEvent::symbol),
+                          field("time", &LedgerEvent::time));
+    }
+};
+
+// The state of the book after the first events of events.json: the single record of a
+// checkpoint file. offset is where events.json closed its array then, so replay starts there.
+struct LedgerCheckpoint
+{
+    vector<Client> clients; // registered, in registration order
+    long long events = 0;
+    long long offset = 0;
+    vector<Portfolio> portfolios; // in the order they were opened
+    vector<Client> removed;       // in removal order
+
+    static auto fields()
+    {
+        return make_tuple(field("clients", &LedgerCheckpoint::clients), field("events", &LedgerCheckpoint::events),
+                          field("offset", &LedgerCheckpoint::offset), field("portfolios", &LedgerCheckpoint::portfolios),
+                          field("removed", &LedgerCheckpoint::removed));
+    }
+};
+
+// A checkpoint written by compaction, in the binary form of binary_records.hpp: the ledger state
+// plus the stock lists and the symbol table as they were, so the book can be restored from it
+// alone. Its file, checkpoints/ledger-<events>.snap, starts with "NSAS1\n".
+struct BookSnapshot
+{
+    LedgerCheckpoint ledger;
+    vector<StockList> removedStocks;
+    vector<StockList> stocks;
+    vector<SymbolRecord> symbols;
+    int64_t time = 0; // when it was taken
+
+    static auto fields()
+    {
+        return make_tuple(field("ledger", &BookSnapshot::ledger), field("removedStocks", &BookSnapshot::removedStocks),
+                          field("stocks", &BookSnapshot::stocks), field("symbols", &BookSnapshot::symbols),
+                          field("time", &BookSnapshot::time));
+    }
+};
+
+// Written by compaction just before it swaps the journal, and removed once it is done, so an
+// interrupted swap is finished on the next start (see ledger::finishCompaction)
+struct CompactionMarker
+{
+    long long events = 0; // the snapshot the new journal starts after
+    string segment;       // the archive directory of the events before it
+
+    static auto fields()
+    {
+        return make_tuple(field("events", &CompactionMarker::events), field("segment", &CompactionMarker::segment));
+    }
+};
+
+namespace ledger
+{
+    const string SNAPSHOT_MAGIC = "NSAS1\n";
+
+    // Held while events.json, the stock lists or the symbol table are written, and by compaction
+    // while it takes their state and while it swaps the journal
+    inline recursive_mutex &journalLock()
+    {
+        static recursive_mutex lock;
+        return lock;
+    }
+
+    inline LedgerEvent registration(const Client &client, int64_t time)
+    {
+        LedgerEvent event;
+        event.kind = "register";
+        event.clientId = client.getId();
+        event.name = client.getName();
+        event.address = client.getAddress();
+        event.dob = client.getDoB();
+        event.time = time;
+        return event;
+    }
+
+    inline LedgerEvent removal(long long clientId, int64_t time)
+    {
+        LedgerEvent event;
+        event.kind = "remove";
+        event.clientId = clientId;
+        event.time = time;
+        return event;
+    }
+
+    inline LedgerEvent cash(const string &kind, long long clientId, Money amount, int64_t time)
+    {
+        LedgerEvent event;
+        event.kind = kind;
+        event.clientId = clientId;
+        event.amount = amount;
+        event.time = time;
+        return event;
+    }
+
+    inline LedgerEvent trade(const string &kind, long long clientId, long long stockId, uint32_t symbol, long long shares,
+                             Money price, Money total, int64_t time)
+    {
+        LedgerEvent event = cash(kind, clientId, total, time);
+        event.stockId = stockId;
+        event.shares = shares;
+        event.price = price;
+        if (symbol != NO_SYMBOL)
+            event.symbol = symbol;
+        return event;
+    }
+
+    // Cost rate of a holding after buying more: what the shares cost on average, to the nearest paisa
+    inline Money averageRate(Money rate, long long shares, Money price, long long bought)
+    {
+        int64_t cost = checkedAdd(checkedMul(rate.getPaisa(), shares), checkedMul(price.getPaisa(), bought));
+        int64_t total = checkedAdd(shares, bought);
+        return Money::fromPaisa(total > 0 ? (cost + total / 2) / total : price.getPaisa());
+    }
+
+    // Applies a deposit, settlement, purchase or sale to the client's portfolio. The engine changes
+    // portfolios through this and replay repeats it, so both give the same state.
+    inline void apply(Portfolio &entry, const LedgerEvent &event)
+    {
+        if (event.kind == "deposit" || event.kind == "settle")
+        {
+            entry.balance += event.amount;
+            return;
+        }
+        long long stockId = event.stockId.value_or(0), shares = event.shares.value_or(0);
+        auto holding = find_if(entry.stocks.begin(), entry.stocks.end(),
+                               [&](const Holding &one) { return one.stockId == stockId; });
+        if (event.kind == "buy")
+        {
+            entry.balance -= event.amount;
+            Money price = event.price.value_or(Money());
+            string purchaseTime = formatTime(event.time) + "\n"; // holdings keep the ctime() text
+            if (holding != entry.stocks.end())
+            {
+                holding->purchasedRate = averageRate(holding->purchasedRate, holding->numberOfShares, price, shares);
+                holding->purchaseRate.reset();
+                holding->numberOfShares += shares;
+                holding->purchaseTime = purchaseTime;
+                return;
+            }
+            Holding bought;
+            bought.stockId = stockId;
+            bought.symbol = event.symbol.value_or(NO_SYMBOL);
+            bought.numberOfShares = shares;
+            bought.purchasedRate = price;
+            bought.purchaseTime = purchaseTime;
+            entry.stocks.push_back(bought);
+        }
+        else if (event.kind == "sell")
+        {
+            entry.balance += event.amount;
+            if (holding == entry.stocks.end())
+                return;
+            holding->numberOfShares -= shares;
+            if (holding->numberOfShares <= 0)
+                entry.stocks.erase(holding);
+        }
+    }
+
+    inline string checkpointDir(const string &dir) { return dir + "/checkpoints"; }
+    inline string archiveDir(const string &dir) { return dir + "/archive"; }
+
+    // Checkpoint files (.json, or .snap from compaction) by the number of events they cover,
+    // oldest first
+    inline vector<pair<long long, string>> checkpoints(const string &dir)
+    {
+        vector<pair<long long, string>> found;
+        error_code error;
+        for (auto &entry : filesystem::directory_iterator(checkpointDir(dir), error))
+        {
+            string name = entry.path().filename().string();
+            string extension = entry.path().extension().string();
+            long long events = 0;
+            if (name.rfind("ledger-", 0) != 0 || (extension != ".json" && extension != ".snap"))
+                continue;
+            auto parsed = from_chars(name.data() + 7, name.data() + name.size() - 5, events);
+            if (parsed.ec == errc() && parsed.ptr == name.data() + name.size() - 5)
+                found.push_back({events, entry.path().string()});
+        }
+        sort(found.begin(), found.end());
+        return found;
+    }
+
+    // Reads a checkpoint file of either kind
+    inline LedgerCheckpoint loadCheckpoint(const string &path)
+    {
+        if (filesystem::path(path).extension() == ".snap")
+        {
+            BookSnapshot snapshot;
+            if (!binary::load(path, SNAPSHOT_MAGIC, snapshot))
+                throw runtime_error("missing checkpoint " + path);
+            return move(snapshot.ledger);
+        }
+        vector<LedgerCheckpoint> loaded = loadRecords<LedgerCheckpoint>(path);
+        if (loaded.size() != 1)
+            throw runtime_error("bad checkpoint " + path);
+        return move(loaded[0]);
+    }
+
+    // Time of the first event of the journal in dir at or after the offset, nothing if there is none
+    inline optional<int64_t> firstEventTime(const string &dir, long long offset)
+    {
+        optional<int64_t> time;
+        string path = dir + "/events.json";
+        scanRecordTexts(
+            path,
+            [&](const string &text) {
+                LedgerEvent event;
+                string error;
+                if (!parseRecord(text.data(), text.size(), event, &error))
+                    throw runtime_error(path + ": " + error);
+                time = event.time;
+                return false;
+            },
+            offset);
+        return time;
+    }
+
+    // Archived journal segments by the number of events before their first, oldest first. A
+    // segment, archive/events-<first>-<end>, is a ledger directory of its own: the events.json of
+    // the events from first to end and the checkpoints it had.
+    inline vector<pair<long long, string>> archives(const string &dir)
+    {
+        vector<pair<long long, string>> found;
+        error_code error;
+        for (auto &entry : filesystem::directory_iterator(archiveDir(dir), error))
+        {
+            string name = entry.path().filename().string();
+            long long first = 0;
+            if (name.rfind("events-", 0) != 0 || !entry.is_directory())
+                continue;
+            auto parsed = from_chars(name.data() + 7, name.data() + name.size(), first);
+            if (parsed.ec == errc() && parsed.ptr != name.data() + name.size() && *parsed.ptr == '-')
+                found.push_back({first, entry.path().string()});
+        }
+        sort(found.begin(), found.end());
+        return found;
+    }
+
+    // Completes a journal swap that compaction committed to (it wrote its marker) but did not
+    // finish, and clears what an uncommitted one left behind. Safe to call at any time; the
+    // engine calls it before the first change to the book.
+    inline void finishCompaction(const string &dir)
+    {
+        lock_guard<recursive_mutex> guard(journalLock());
+        string markerPath = dir + "/compaction.json";
+        vector<CompactionMarker> marker = loadRecords<CompactionMarker>(markerPath);
+        string staging = archiveDir(dir) + "/staging";
+        error_code error;
+        if (marker.empty())
+        {
+            filesystem::remove(dir + "/events.json.tmp", error);
+            filesystem::remove_all(staging, error);
+            for (auto &entry : filesystem::directory_iterator(checkpointDir(dir), error))
+            {
+                if (entry.path().extension() == ".tmp")
+                    filesystem::remove(entry.path(), error);
+            }
+            return;
+        }
+
+        long long events = marker[0].events;
+        string snapshot = checkpointDir(dir) + "/ledger-" + to_string(events) + ".snap";
+        if (filesystem::exists(dir + "/events.json.tmp"))
+            filesystem::rename(dir + "/events.json.tmp", dir + "/events.json");
+        if (filesystem::exists(snapshot + ".tmp"))
+            filesystem::rename(snapshot + ".tmp", snapshot);
+        for (auto &one : checkpoints(dir))
+        {
+            if (one.second != snapshot) // their offsets are into the old journal
+                filesystem::remove(one.second);
+        }
+        if (filesystem::exists(staging))
+            filesystem::rename(staging, archiveDir(dir) + "/" + marker[0].segment);
+        filesystem::remove(markerPath);
+    }
+
+    // Ids of the records of two lists that differ, or that only one of them has
+    template <typename T, typename Id>
+    vector<long long> differences(const vector<T> &stored, const vector<T> &rebuilt, Id idOf)
+    {
+        map<long long, pair<string, string>> texts;
+        for (auto &record : stored)
+            records::writeValue(texts[idOf(record)].first, record, 0, 0);
+        for (auto &record : rebuilt)
+            records::writeValue(texts[idOf(record)].second, record, 0, 0);
+        vector<long long> ids;
+        for (auto &entry : texts)
+        {
+            if (entry.second.first != entry.second.second)
+                ids.push_back(entry.first);
+        }
+        return ids;
+    }
+
+    // Writes the checkpoint and removes the older ones, except the first, which holds the book as
+    // it was before the events of events.json
+    inline void saveCheckpoint(const string &dir, const LedgerCheckpoint &checkpoint, size_t keep = 3)
+    {
+        filesystem::create_directories(checkpointDir(dir));
+        saveRecords(checkpointDir(dir) + "/ledger-" + to_string(checkpoint.events) + ".json",
+                    vector<LedgerCheckpoint>{checkpoint}, 0);
+        auto all = checkpoints(dir);
+        for (size_t i = 1; i + keep < all.size(); i++)
+            filesystem::remove(all[i].second);
+    }
+}
+
+// Derives the client registry and every portfolio from a checkpoint and the events after it.
+// The events are parsed in parallel batches (see parallelRecords) and dealt out by client id to
+// one partition per thread; each thread replays the events of its clients in log order, so a
+// client's events are applied in the order they happened while the clients are replayed side by
+// side. Events are replayed a round at a time, which bounds the memory whatever the log size.
+class LedgerRebuild
+{
+private:
+    static constexpr size_t EVENTS_PER_ROUND = 1 << 18;
+
+    // A client as replay sees it; the orders are positions in the checkpoint and then the log
+    struct ClientState
+    {
+        optional<Client> client;
+        long long registered = 0;
+        bool removed = false;
+        long long removedAt = 0;
+        optional<Portfolio> portfolio;
+        long long opened = 0;
+    };
+
+    struct Partition
+    {
+        unordered_map<long long, ClientState> clients;
+        vector<pair<long long, LedgerEvent>> pending; // position in the log and event
+    };
+
+    string dir;
+    unsigned threads;
+    vector<Partition> partitions;
+
+    ClientState &state(long long clientId)
+    {
+        size_t p = (size_t)(((unsigned long long)clientId) % partitions.size());
+        return partitions[p].clients[clientId];
+    }
+
+    static void replay(Partition &partition)
+    {
+        for (auto &entry : partition.pending)
+        {
+            long long position = entry.first;
+            LedgerEvent &event = entry.second;
+            ClientState &one = partition.clients[event.clientId];
+            if (event.kind == "register")
+            {
+                one.client = Client(event.name.value_or(""), event.clientId, event.address.value_or(""),
+                                    event.dob.value_or(""));
+                one.registered = position;
+                one.removed = false;
+            }
+            else if (event.kind == "remove")
+            {
+                one.removed = true;
+                one.removedAt = position;
+            }
+            else
+            {
+                if (!one.portfolio.has_value())
+                {
+                    Portfolio opened;
+                    opened.id = event.clientId;
+                    opened.name = one.client.has_value() ? one.client->getName() : "";
+                    one.portfolio = opened;
+                    one.opened = position;
+                }
+                ledger::apply(*one.portfolio, event);
+            }
+        }
+        partition.pending.clear();
+    }
+
+    // Replays the pending events, a partition per thread
+    void replayRound()
+    {
+        if (partitions.size() == 1)
+        {
+            replay(partitions[0]);
+            return;
+        }
+        // an error in a worker is rethrown here
+        vector<exception_ptr> errors(partitions.size());
+        vector<thread> workers;
+        for (size_t p = 0; p < partitions.size(); p++)
+        {
+            workers.emplace_back([&, p]() {
+                try
+                {
+                    replay(partitions[p]);
+                }
+                catch (...)
+                {
+                    errors[p] = current_exception();
+                }
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        for (auto &error : errors)
+        {
+            if (error)
+                rethrow_exception(error);
+        }
+    }
+
+public:
+    LedgerRebuild(const string &dir, unsigned threads = thread::hardware_concurrency())
+        : dir(dir), threads(max(threads, 1u))
+    {
+    }
+
+    // The state after every event in events.json, starting from the latest checkpoint, or from the
+    // first one if full is set
+    LedgerCheckpoint run(bool full = false)
+    {
+        auto all = ledger::checkpoints(dir);
+        LedgerCheckpoint start;
+        if (!all.empty())
+        {
+            start = ledger::loadCheckpoint(full ? all.front().second : all.back().second);
+        }
+
+        // The checkpoint comes before every event
+        partitions.assign(threads, Partition());
+        long long order = -(long long)(start.clients.size() + start.removed.size() + start.portfolios.size()) - 1;
+        for (auto &client : start.clients)
+        {
+            ClientState &one = state(client.getId());
+            one.registered = order++;
+            one.client = move(client);
+        }
+        for (auto &client : start.removed)
+        {
+            ClientState &one = state(client.getId());
+            one.registered = order;
+            one.removedAt = order++;
+            one.removed = true;
+            one.client = move(client);
+        }
+        for (auto &portfolio : start.portfolios)
+        {
+            ClientState &one = state(portfolio.id);
+            one.opened = order++;
+            one.portfolio = move(portfolio);
+        }
+
+        // Events are dealt out in log order and replayed a round at a time
+        string path = dir + "/events.json";
+        long long position = start.events;
+        size_t queued = 0;
+        parallelRecords<LedgerEvent>(
+            path, threads, [](vector<LedgerEvent> &events) { return move(events); },
+            [&](vector<LedgerEvent> &events) {
+                for (auto &event : events)
+                {
+                    size_t p = (size_t)(((unsigned long long)event.clientId) % partitions.size());
+                    partitions[p].pending.push_back({position++, move(event)});
+                }
+                queued += events.size();
+                if (queued >= EVENTS_PER_ROUND)
+                {
+                    replayRound();
+                    queued = 0;
+                }
+            },
+            start.offset);
+        replayRound();
+
+        // The state in registration, removal and opening order
+        LedgerCheckpoint result;
+        result.events = position;
+        result.offset = max(endOfRecords(path), 0LL);
+        vector<pair<long long, ClientState *>> registered, removed, opened;
+        for (auto &partition : partitions)
+        {
+            for (auto &entry : partition.clients)
+            {
+                ClientState &one = entry.second;
+                if (one.client.has_value())
+                    (one.removed ? removed : registered).push_back({one.removed ? one.removedAt : one.registered, &one});
+                if (one.portfolio.has_value())
+                    opened.push_back({one.opened, &one});
+            }
+        }
+        auto byOrder = [](const pair<long long, ClientState *> &a, const pair<long long, ClientState *> &b) {
+            return a.first < b.first;
+        };
+        sort(registered.begin(), registered.end(), byOrder);
+        sort(removed.begin(), removed.end(), byOrder);
+        sort(opened.begin(), opened.end(), byOrder);
+        for (auto &one : registered)
+            result.clients.push_back(move(*one.second->client));
+        for (auto &one : removed)
+            result.removed.push_back(move(*one.second->client));
+        for (auto &one : opened)
+            result.portfolios.push_back(move(*one.second->portfolio));
+        partitions.clear();
+        return result;
+    }
+};
+
+#endif
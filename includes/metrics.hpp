@@ -0,0 +1,443 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+using namespace std;
+
+// Operations that get a latency histogram
+enum MetricOp
+{
+    OP_DEPOSIT_MONEY,
+    OP_PURCHASE_STOCK,
+    OP_SELL_STOCK,
+    OP_BUY_HISTORY,
+    OP_SELL_HISTORY,
+    OP_UPDATE_STOCK_PRICES,
+    OP_CLIENT_PORTFOLIO,
+    OP_CLIENT_TRANSACTIONS,
+    OP_BOOK_VALUE,
+    OP_SETTLE_BALANCES,
+    OP_SCREEN_STOCKS,
+    OP_MARKET_INDEX,
+    OP_SEARCH,
+    OP_TRANSACTION_RANGE,
+    OP_AGGREGATE_TRADES,
+    OP_DAILY_SUMMARY,
+    OP_EXPORT,
+    OP_IMPORT,
+    OP_PRICE_HISTORY,
+    OP_AS_OF,
+    OP_FILE_LOAD,
+    OP_FILE_SAVE,
+    OP_COUNT
+};
+
+inline const char *metricOpName(int op)
+{
+    static const char *names[OP_COUNT] = {"depositMoney", "purchaseStock", "sellStock", "buyHistory", "sellHistory",
+                                          "updateStockPrices", "clientPortfolio", "clientTransactions", "bookValue",
+                                          "settleBalances", "screenStocks", "marketIndex", "search", "transactionRange",
+                                          "aggregateTrades", "dailySummary", "export", "import",
+                                          "priceHistory", "asOf", "fileLoad", "fileSave"};
+    return names[op];
+}
+
+inline int floorLog2(uint64_t v)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(v);
+#else
+    int r = 0;
+    while (v >>= 1)
+        r++;
+    return r;
+#endif
+}
+
+// Single writer counter: a relaxed load and store is enough and avoids a locked instruction
+inline void bump(atomic<uint64_t> &counter, uint64_t amount)
+{
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// A count only its own thread adds to, which other threads may read at any time
+class ThreadCount
+{
+private:
+    atomic<uint64_t> value{0};
+
+public:
+    ThreadCount() = default;
+    ThreadCount(const ThreadCount &other) : value(other.value.load(memory_order_relaxed)) {}
+
+    operator uint64_t() const { return value.load(memory_order_relaxed); }
+    ThreadCount &operator+=(uint64_t amount)
+    {
+        bump(value, amount);
+        return *this;
+    }
+    void operator++(int) { bump(value, 1); }
+};
+
+// Raw I/O done by a thread, counted by the storage layer
+struct IoCounters
+{
+    ThreadCount bytesRead;
+    ThreadCount bytesWritten;
+    ThreadCount syscalls; // open, stat, read, write, fsync and close calls
+    ThreadCount fsyncs;
+};
+
+// I/O attributed to one operation, including the I/O of the operations it calls
+struct IoTotals
+{
+    uint64_t operations = 0;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t syscalls = 0;
+    uint64_t fsyncs = 0;
+};
+
+// HDR style log-linear histogram of nanosecond latencies. Every power of two is split into
+// 32 linear sub-buckets, which keeps the relative error of any percentile under about 3%.
+// Only the owning thread records into it, readers may merge it at any time.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 5;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int BUCKETS = SUB_COUNT + (64 - SUB_BITS) * SUB_COUNT;
+
+private:
+    atomic<uint64_t> counts[BUCKETS];
+    atomic<uint64_t> total;
+    atomic<uint64_t> sum;
+
+public:
+    LatencyHistogram() { reset(); }
+
+    static int bucketOf(uint64_t v)
+    {
+        if (v < (uint64_t)SUB_COUNT)
+            return (int)v;
+        int msb = floorLog2(v);
+        int shift = msb - SUB_BITS;
+        return SUB_COUNT + shift * SUB_COUNT + (int)((v >> shift) & (SUB_COUNT - 1));
+    }
+
+    // Largest value that falls into the bucket
+    static uint64_t bucketUpper(int index)
+    {
+        if (index < SUB_COUNT)
+            return index;
+        int shift = (index - SUB_COUNT) / SUB_COUNT;
+        uint64_t sub = (index - SUB_COUNT) % SUB_COUNT;
+        return ((SUB_COUNT + sub) << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+    void record(uint64_t nanoseconds)
+    {
+        bump(counts[bucketOf(nanoseconds)], 1);
+        bump(total, 1);
+        bump(sum, nanoseconds);
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+
+    void mergeInto(vector<uint64_t> &buckets, uint64_t &count, uint64_t &nanoseconds) const
+    {
+        buckets.resize(BUCKETS);
+        for (int i = 0; i < BUCKETS; i++)
+            buckets[i] += counts[i].load(memory_order_relaxed);
+        count += total.load(memory_order_relaxed);
+        nanoseconds += sum.load(memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (auto &c : counts)
+            c.store(0, memory_order_relaxed);
+        total.store(0, memory_order_relaxed);
+        sum.store(0, memory_order_relaxed);
+    }
+};
+
+// Merged view of one operation over every thread
+struct LatencySnapshot
+{
+    vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sumNanoseconds = 0;
+
+    uint64_t percentile(double q) const
+    {
+        if (count == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(q * count);
+        if (rank >= count)
+            rank = count - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); i++)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+                return LatencyHistogram::bucketUpper((int)i);
+        }
+        return 0;
+    }
+
+    // Number of samples at or below the given latency
+    uint64_t countBelow(uint64_t nanoseconds) const
+    {
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size() && LatencyHistogram::bucketUpper((int)i) <= nanoseconds; i++)
+            seen += buckets[i];
+        return seen;
+    }
+};
+
+// Per thread histograms and I/O counters. They are registered once and kept for the life of
+// the process, so the samples of threads that have finished still show up in the export.
+struct ThreadMetrics
+{
+    LatencyHistogram histograms[OP_COUNT];
+    atomic<uint64_t> bytesRead[OP_COUNT] = {};
+    atomic<uint64_t> bytesWritten[OP_COUNT] = {};
+    atomic<uint64_t> syscalls[OP_COUNT] = {};
+    atomic<uint64_t> fsyncs[OP_COUNT] = {};
+    IoCounters io; // all of the thread's I/O, inside an operation or not
+};
+
+class MetricsRegistry
+{
+private:
+    mutex lock;
+    vector<unique_ptr<ThreadMetrics>> threads;
+
+public:
+    // Never destroyed, so an exporter running during exit() can still read it
+    static MetricsRegistry &instance()
+    {
+        static MetricsRegistry *registry = new MetricsRegistry();
+        return *registry;
+    }
+
+    ThreadMetrics &local()
+    {
+        thread_local ThreadMetrics *mine = nullptr;
+        if (mine == nullptr)
+        {
+            lock_guard<mutex> guard(lock);
+            threads.emplace_back(new ThreadMetrics());
+            mine = threads.back().get();
+        }
+        return *mine;
+    }
+
+    IoTotals ioTotals(int op)
+    {
+        IoTotals totals;
+        lock_guard<mutex> guard(lock);
+        for (auto &t : threads)
+        {
+            totals.operations += t->histograms[op].count();
+            totals.bytesRead += t->bytesRead[op].load(memory_order_relaxed);
+            totals.bytesWritten += t->bytesWritten[op].load(memory_order_relaxed);
+            totals.syscalls += t->syscalls[op].load(memory_order_relaxed);
+            totals.fsyncs += t->fsyncs[op].load(memory_order_relaxed);
+        }
+        return totals;
+    }
+
+    // All the I/O of the process so far, on every thread, whatever operation it was done for
+    IoTotals sessionIo()
+    {
+        IoTotals totals;
+        lock_guard<mutex> guard(lock);
+        for (auto &t : threads)
+        {
+            for (int op = 0; op < OP_COUNT; op++)
+                totals.operations += t->histograms[op].count();
+            totals.bytesRead += t->io.bytesRead;
+            totals.bytesWritten += t->io.bytesWritten;
+            totals.syscalls += t->io.syscalls;
+            totals.fsyncs += t->io.fsyncs;
+        }
+        return totals;
+    }
+
+    LatencySnapshot snapshot(int op)
+    {
+        LatencySnapshot s;
+        s.buckets.assign(LatencyHistogram::BUCKETS, 0);
+        lock_guard<mutex> guard(lock);
+        for (auto &t : threads)
+            t->histograms[op].mergeInto(s.buckets, s.count, s.sumNanoseconds);
+        return s;
+    }
+
+    // Renders every operation in the Prometheus text exposition format
+    string prometheusText()
+    {
+        static const double bounds[] = {1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1, 5, 10};
+        ostringstream out;
+        out << "# HELP nsa_operation_duration_seconds Latency of stock engine operations.\n";
+        out << "# TYPE nsa_operation_duration_seconds histogram\n";
+        vector<LatencySnapshot> snapshots;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            snapshots.push_back(snapshot(op));
+            const LatencySnapshot &s = snapshots.back();
+            for (double bound : bounds)
+            {
+                out << "nsa_operation_duration_seconds_bucket{op=\"" << metricOpName(op) << "\",le=\"" << bound << "\"} "
+                    << s.countBelow((uint64_t)(bound * 1e9)) << "\n";
+            }
+            out << "nsa_operation_duration_seconds_bucket{op=\"" << metricOpName(op) << "\",le=\"+Inf\"} " << s.count << "\n";
+            out << "nsa_operation_duration_seconds_sum{op=\"" << metricOpName(op) << "\"} " << s.sumNanoseconds / 1e9 << "\n";
+            out << "nsa_operation_duration_seconds_count{op=\"" << metricOpName(op) << "\"} " << s.count << "\n";
+        }
+
+        out << "# HELP nsa_operation_latency_quantile_seconds Latency percentiles of stock engine operations.\n";
+        out << "# TYPE nsa_operation_latency_quantile_seconds gauge\n";
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            for (double q : {0.5, 0.99, 0.999})
+            {
+                out << "nsa_operation_latency_quantile_seconds{op=\"" << metricOpName(op) << "\",quantile=\"" << q << "\"} "
+                    << snapshots[op].percentile(q) / 1e9 << "\n";
+            }
+        }
+
+        static const char *ioNames[] = {"nsa_io_read_bytes_total", "nsa_io_written_bytes_total", "nsa_io_syscalls_total", "nsa_io_fsyncs_total"};
+        static const char *ioHelp[] = {"Bytes read from the data files", "Bytes written to the data files",
+                                       "open, stat, read, write, fsync and close calls", "fsync calls"};
+        vector<IoTotals> io;
+        for (int op = 0; op < OP_COUNT; op++)
+            io.push_back(ioTotals(op));
+        for (int field = 0; field < 4; field++)
+        {
+            out << "# HELP " << ioNames[field] << " " << ioHelp[field] << ", per operation including nested operations.\n";
+            out << "# TYPE " << ioNames[field] << " counter\n";
+            for (int op = 0; op < OP_COUNT; op++)
+            {
+                uint64_t values[] = {io[op].bytesRead, io[op].bytesWritten, io[op].syscalls, io[op].fsyncs};
+                out << ioNames[field] << "{op=\"" << metricOpName(op) << "\"} " << values[field] << "\n";
+            }
+        }
+        return out.str();
+    }
+};
+
+// Raw I/O done by the current thread. The counters are kept in the thread's registry entry, so
+// they outlive the thread and count towards sessionIo.
+inline IoCounters &threadIo()
+{
+    thread_local IoCounters &counters = MetricsRegistry::instance().local().io;
+    return counters;
+}
+
+// Records the time between construction and destruction into the operation's histogram,
+// and charges the I/O the thread did in between to the operation
+class ScopedLatency
+{
+private:
+    int op;
+    IoCounters before;
+    chrono::steady_clock::time_point start;
+
+public:
+    ScopedLatency(int op) : op(op), before(threadIo()), start(chrono::steady_clock::now()) {}
+
+    ~ScopedLatency()
+    {
+        auto elapsed = chrono::steady_clock::now() - start;
+        ThreadMetrics &mine = MetricsRegistry::instance().local();
+        mine.histograms[op].record(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+
+        const IoCounters &now = threadIo();
+        bump(mine.bytesRead[op], now.bytesRead - before.bytesRead);
+        bump(mine.bytesWritten[op], now.bytesWritten - before.bytesWritten);
+        bump(mine.syscalls[op], now.syscalls - before.syscalls);
+        bump(mine.fsyncs[op], now.fsyncs - before.fsyncs);
+    }
+};
+
+// Writes the Prometheus text file every few seconds from a background thread. The file is
+// replaced atomically so a node_exporter textfile collector never reads half a file.
+class MetricsExporter
+{
+private:
+    string path;
+    chrono::seconds interval{15};
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    bool stopping = false;
+
+public:
+    ~MetricsExporter() { stop(); }
+
+    void start(const string &exportPath, int intervalSeconds)
+    {
+        stop();
+        path = exportPath;
+        interval = chrono::seconds(intervalSeconds > 0 ? intervalSeconds : 15);
+        stopping = false;
+        worker = thread([this]() {
+            unique_lock<mutex> guard(lock);
+            while (!wake.wait_for(guard, interval, [this]() { return stopping; }))
+                exportNow();
+        });
+    }
+
+    // Stops the background thread and writes one last export
+    void stop()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        exportNow();
+    }
+
+    void exportNow()
+    {
+        string tmp = path + ".tmp";
+        {
+            ofstream out(tmp);
+            out << MetricsRegistry::instance().prometheusText();
+        }
+        // a rename over the old file replaces it in one step; Windows needs to be told it may
+#ifdef _WIN32
+        MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+        rename(tmp.c_str(), path.c_str());
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef MONEY_HPP
+#define MONEY_HPP
+
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Checked 64-bit integer arithmetic, an overflow throws instead of wrapping
+inline int64_t checkedAdd(int64_t a, int64_t b)
+{
+    int64_t r;
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_add_overflow(a, b, &r))
+        throw overflow_error("money overflow");
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        throw overflow_error("money overflow");
+    r = a + b;
+#endif
+    return r;
+}
+
+inline int64_t checkedSub(int64_t a, int64_t b)
+{
+    int64_t r;
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_sub_overflow(a, b, &r))
+        throw overflow_error("money overflow");
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+        throw overflow_error("money overflow");
+    r = a - b;
+#endif
+    return r;
+}
+
+inline int64_t checkedMul(int64_t a, int64_t b)
+{
+    int64_t r;
+#if defined(__GNUC__) || defined(__clang__)
+    if (__builtin_mul_overflow(a, b, &r))
+        throw overflow_error("money overflow");
+#else
+    if (a != 0 && (b == INT64_MIN ? a != 1 : llabs(b) > INT64_MAX / llabs(a)))
+        throw overflow_error("money overflow");
+    r = a * b;
+#endif
+    return r;
+}
+
+// An amount of Nepalese rupees held as a whole number of paisa (1/100 rupee).
+// Sums and products are exact; anything that would overflow 64 bits throws overflow_error.
+class Money
+{
+private:
+    int64_t paisa;
+
+    explicit constexpr Money(int64_t paisa) : paisa(paisa) {}
+
+public:
+    constexpr Money() : paisa(0) {}
+
+    static constexpr Money fromPaisa(int64_t paisa) { return Money(paisa); }
+
+    // Rounds to the nearest paisa, for amounts that only exist as floating point
+    static Money fromRupees(double rupees)
+    {
+        double scaled = round(rupees * 100);
+        if (!(fabs(scaled) < 9.2e18))
+            throw overflow_error("money overflow");
+        return Money((int64_t)scaled);
+    }
+
+    // Parses a decimal number such as "1250", "-3.5" or "1.2575e3" exactly. Digits beyond the paisa
+    // are rounded half away from zero. Returns false if the text is not a number or does not fit in
+    // 64 bits of paisa.
+    static bool parse(const char *text, size_t length, Money &out)
+    {
+        size_t i = 0;
+        bool negative = false;
+        if (i < length && (text[i] == '-' || text[i] == '+'))
+            negative = text[i++] == '-';
+
+        // value = digits * 10^exponent, with the decimal point taken out of the digits
+        string digits;
+        long exponent = 0;
+        bool point = false, any = false;
+        for (; i < length; i++)
+        {
+            char ch = text[i];
+            if (ch == '.' && !point)
+                point = true;
+            else if (ch >= '0' && ch <= '9')
+            {
+                any = true;
+                if (!digits.empty() || ch != '0')
+                    digits += ch;
+                if (point)
+                    exponent--;
+            }
+            else
+                break;
+        }
+        if (!any)
+            return false;
+
+        if (i < length && (text[i] == 'e' || text[i] == 'E'))
+        {
+            i++;
+            bool negativeExponent = false;
+            if (i < length && (text[i] == '-' || text[i] == '+'))
+                negativeExponent = text[i++] == '-';
+            if (i >= length || text[i] < '0' || text[i] > '9')
+                return false;
+            long value = 0;
+            for (; i < length && text[i] >= '0' && text[i] <= '9'; i++)
+                value = min(value * 10 + (text[i] - '0'), 100000L);
+            exponent += negativeExponent ? -value : value;
+        }
+        if (i != length)
+            return false;
+
+        // Paisa are digits * 10^(exponent + 2); extra decimals are dropped with rounding
+        long shift = exponent + 2;
+        bool roundUp = false;
+        if (shift < 0)
+        {
+            long keep = (long)digits.size() + shift;
+            roundUp = keep >= 0 && keep < (long)digits.size() && digits[keep] >= '5';
+            digits.resize(keep > 0 ? keep : 0);
+            shift = 0;
+        }
+        if (digits.size() > 19)
+            return false;
+
+        try
+        {
+            int64_t paisa = 0;
+            for (char ch : digits)
+                paisa = checkedAdd(checkedMul(paisa, 10), ch - '0');
+            for (long k = 0; k < shift && paisa != 0; k++)
+                paisa = checkedMul(paisa, 10);
+            if (roundUp)
+                paisa = checkedAdd(paisa, 1);
+            out = Money(negative ? -paisa : paisa);
+        }
+        catch (const overflow_error &)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parse(const string &text, Money &out) { return parse(text.data(), text.size(), out); }
+
+    int64_t getPaisa() const { return paisa; }
+    double toRupees() const { return paisa / 100.0; }
+
+    // "1250.50" style text, always with two decimals
+    string toString() const
+    {
+        uint64_t magnitude = paisa < 0 ? 0 - (uint64_t)paisa : (uint64_t)paisa;
+        string text = to_string(magnitude / 100) + "." + char('0' + magnitude % 100 / 10) + char('0' + magnitude % 10);
+        return paisa < 0 ? "-" + text : text;
+    }
+
+    Money operator+(Money other) const { return Money(checkedAdd(paisa, other.paisa)); }
+    Money operator-(Money other) const { return Money(checkedSub(paisa, other.paisa)); }
+    Money operator-() const { return Money(checkedSub(0, paisa)); }
+    Money operator*(int64_t quantity) const { return Money(checkedMul(paisa, quantity)); }
+    Money &operator+=(Money other) { return *this = *this + other; }
+    Money &operator-=(Money other) { return *this = *this - other; }
+
+    bool operator==(Money other) const { return paisa == other.paisa; }
+    bool operator!=(Money other) const { return paisa != other.paisa; }
+    bool operator<(Money other) const { return paisa < other.paisa; }
+    bool operator<=(Money other) const { return paisa <= other.paisa; }
+    bool operator>(Money other) const { return paisa > other.paisa; }
+    bool operator>=(Money other) const { return paisa >= other.paisa; }
+};
+
+inline ostream &operator<<(ostream &out, Money amount) { return out << amount.toString(); }
+
+// Reads one word and parses it exactly, a word that is not a number or is too large sets failbit
+inline istream &operator>>(istream &in, Money &amount)
+{
+    string word;
+    if (in >> word && !Money::parse(word, amount))
+        in.setstate(ios::failbit);
+    return in;
+}
+
+// Bulk kernels over arrays of paisa. They only use integer instructions; with AVX2 enabled
+// (-mavx2) four lanes are processed at a time, otherwise the scalar loops are used.
+namespace moneykernels
+{
+    // Sum of amounts[i], exact, throws on overflow
+    inline int64_t sum(const int64_t *amounts, size_t n)
+    {
+        int64_t total = 0;
+        size_t i = 0;
+#ifdef __AVX2__
+        // Lanes are flushed into the checked total every 2^20 rows, and values are limited to
+        // 2^42 so that a lane cannot overflow in between
+        const int64_t LIMIT = int64_t(1) << 42;
+        const size_t BLOCK = size_t(1) << 20;
+        bool inRange = true;
+        for (size_t k = 0; k < n && inRange; k++)
+            inRange = amounts[k] < LIMIT && amounts[k] > -LIMIT;
+        if (inRange)
+        {
+            for (; i + 4 <= n;)
+            {
+                __m256i lanes = _mm256_setzero_si256();
+                size_t end = min(n - (n - i) % 4, i + BLOCK);
+                for (; i < end; i += 4)
+                    lanes = _mm256_add_epi64(lanes, _mm256_loadu_si256((const __m256i *)(amounts + i)));
+                alignas(32) int64_t parts[4];
+                _mm256_store_si256((__m256i *)parts, lanes);
+                for (int64_t part : parts)
+                    total = checkedAdd(total, part);
+            }
+        }
+#endif
+        for (; i < n; i++)
+            total = checkedAdd(total, amounts[i]);
+        return total;
+    }
+
+    // Sum of shares[i] * prices[i], exact, throws on overflow. Used to value holdings.
+    inline int64_t dot(const int64_t *shares, const int64_t *prices, size_t n)
+    {
+        int64_t total = 0;
+        size_t i = 0;
+#ifdef __AVX2__
+        // _mm256_mul_epu32 multiplies the low 32 bits of each lane exactly into 64 bits.
+        // With both factors below 2^31 a product is below 2^62, so two of them fit in a lane.
+        bool inRange = true;
+        for (size_t k = 0; k < n && inRange; k++)
+            inRange = shares[k] >= 0 && shares[k] < (int64_t(1) << 31) && prices[k] >= 0 && prices[k] < (int64_t(1) << 31);
+        if (inRange)
+        {
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256i a = _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *)(shares + i)),
+                                             _mm256_loadu_si256((const __m256i *)(prices + i)));
+                __m256i b = _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *)(shares + i + 4)),
+                                             _mm256_loadu_si256((const __m256i *)(prices + i + 4)));
+                alignas(32) int64_t parts[4];
+                _mm256_store_si256((__m256i *)parts, _mm256_add_epi64(a, b));
+                for (int64_t part : parts)
+                    total = checkedAdd(total, part);
+            }
+        }
+#endif
+        for (; i < n; i++)
+            total = checkedAdd(total, checkedMul(shares[i], prices[i]));
+        return total;
+    }
+
+    // balances[i] += deltas[i] for every row. Nothing is changed and false is returned if any
+    // row would overflow, so a settlement is applied completely or not at all.
+    inline bool settle(int64_t *balances, const int64_t *deltas, size_t n)
+    {
+        size_t i = 0;
+        bool overflow = false;
+#ifdef __AVX2__
+        // signed overflow happened when both inputs have a different sign from the result
+        __m256i flags = _mm256_setzero_si256();
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(balances + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(deltas + i));
+            __m256i r = _mm256_add_epi64(a, b);
+            flags = _mm256_or_si256(flags, _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+        }
+        overflow = _mm256_movemask_pd(_mm256_castsi256_pd(flags)) != 0;
+#endif
+        for (; i < n && !overflow; i++)
+        {
+            int64_t r = (int64_t)((uint64_t)balances[i] + (uint64_t)deltas[i]);
+            overflow = ((balances[i] ^ r) & (deltas[i] ^ r)) < 0;
+        }
+        if (overflow)
+            return false;
+
+        // checked, now apply
+        i = 0;
+#ifdef __AVX2__
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(balances + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(deltas + i));
+            _mm256_storeu_si256((__m256i *)(balances + i), _mm256_add_epi64(a, b));
+        }
+#endif
+        for (; i < n; i++)
+            balances[i] += deltas[i];
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef PARALLEL_SCAN_HPP
+#define PARALLEL_SCAN_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+#include "records.hpp"
+
+using namespace std;
+
+// Reads a file of records on several threads. The file is split into record texts as it is read
+// (see scanRecordTexts) and the texts are gathered into batches of a few megabytes. Once there is
+// a batch for every thread, each thread parses its batch and hands the records to work, and the
+// results are passed to merge in file order on the calling thread.
+// work runs on the worker threads and must only touch what it is given; at most threads batches
+// and their results are held at any time, whatever the size of the file.
+// A start past 0 skips the records before that offset, see scanRecordTexts.
+// Returns false if the file does not exist.
+template <typename T, typename Work, typename Merge>
+bool parallelRecords(const string &path, unsigned threads, Work work, Merge merge, long long start = 0)
+{
+    typedef decltype(work(declval<vector<T> &>())) Result;
+    const size_t batchBytes = 4 << 20;
+
+    // Record texts back to back
+    struct Batch
+    {
+        string text;
+        vector<size_t> ends;
+    };
+
+    auto process = [&](const Batch &batch) {
+        vector<T> records(batch.ends.size());
+        size_t begin = 0;
+        for (size_t i = 0; i < batch.ends.size(); i++)
+        {
+            string error;
+            if (!parseRecord(batch.text.data() + begin, batch.ends[i] - begin, records[i], &error))
+                throw runtime_error(path + ": " + error);
+            begin = batch.ends[i];
+        }
+        return work(records);
+    };
+
+    auto flush = [&](vector<Batch> &batches) {
+        vector<Result> results(batches.size());
+        if (batches.size() == 1)
+            results[0] = process(batches[0]);
+        else
+        {
+            // an error in a worker is rethrown here
+            vector<exception_ptr> errors(batches.size());
+            vector<thread> workers;
+            for (size_t b = 0; b < batches.size(); b++)
+            {
+                workers.emplace_back([&, b]() {
+                    try
+                    {
+                        results[b] = process(batches[b]);
+                    }
+                    catch (...)
+                    {
+                        errors[b] = current_exception();
+                    }
+                });
+            }
+            for (auto &worker : workers)
+                worker.join();
+            for (auto &error : errors)
+            {
+                if (error)
+                    rethrow_exception(error);
+            }
+        }
+        for (auto &result : results)
+            merge(result);
+        batches.clear();
+    };
+
+    threads = max(threads, 1u);
+    vector<Batch> batches(1);
+    bool found = scanRecordTexts(path, [&](const string &text) {
+        Batch &batch = batches.back();
+        batch.text += text;
+        batch.ends.push_back(batch.text.size());
+        if (batch.text.size() < batchBytes)
+            return;
+        if (batches.size() >= threads)
+            flush(batches);
+        batches.emplace_back();
+    }, start);
+    if (batches.back().ends.empty())
+        batches.pop_back();
+    if (!batches.empty())
+        flush(batches);
+    return found;
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef POINT_IN_TIME_HPP
+#define POINT_IN_TIME_HPP
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+#include "records.hpp"
+#include "storage.hpp"
+#include "ledger.hpp"
+
+using namespace std;
+
+// A client as the book had them at some time
+struct ClientAsOf
+{
+    optional<Client> client; // as registered, nothing if they never were by then
+    bool removed = false;
+    optional<Portfolio> portfolio; // nothing if they had not traded or deposited by then
+    long long snapshotEvents = 0;  // the checkpoint the answer started from
+    size_t eventsApplied = 0;      // events of the client replayed on top of it
+};
+
+// Answers "what did the client have at time t" from the ledger checkpoints and an index of every
+// client's events in events.json. The latest checkpoint taken at or before t gives the client's
+// state then, and only the client's own events between the checkpoint and t are read and applied,
+// so a query costs O(log n + events since the checkpoint) instead of a replay of the whole log.
+// The index holds the time and the place of every event; it is built by the first query and
+// extended with the events appended since by every later one. The checkpoint in use is loaded
+// whole and kept until a query needs another one.
+// Times before the first event of events.json are answered from the archived journal segments
+// of compaction (see Compactor), each a ledger directory of its own; without them, the ledger
+// starts at its first event and times before it have no answer.
+class PointInTime
+{
+private:
+    // Where an event is in events.json; position counts the events before it
+    struct EventRef
+    {
+        int64_t time;
+        long long position;
+        long long offset;
+        uint32_t length;
+    };
+
+    string dir;
+    unordered_map<long long, vector<EventRef>> byClient; // in log order
+    vector<pair<long long, int64_t>> clock; // position of each event that moved the latest time past the one before
+    long long indexedEvents = 0;
+    long long indexedTo = 0; // offset just past the last indexed event
+
+    long long base = -1; // events before the first of events.json: those of its first checkpoint
+    map<string, unique_ptr<PointInTime>> segments; // archived journals, by directory
+
+    long long loadedEvents = -1; // the checkpoint held below
+    unordered_map<long long, Client> clients;
+    unordered_map<long long, Client> removedClients;
+    unordered_map<long long, Portfolio> portfolios;
+
+    string eventsPath() const { return dir + "/events.json"; }
+
+    // Indexes the events appended since the last call
+    void refresh(long long first)
+    {
+        if (first != base)
+        {
+            // a new journal, compaction has replaced the old one
+            byClient.clear();
+            clock.clear();
+            indexedTo = 0;
+            indexedEvents = base = first;
+        }
+        long long end = endOfRecords(eventsPath());
+        if (end <= indexedTo)
+            return;
+        scanRecordTexts(
+            eventsPath(),
+            [&](const string &text, long long offset) {
+                LedgerEvent event;
+                string error;
+                if (!parseRecord(text.data(), text.size(), event, &error))
+                    throw runtime_error(eventsPath() + ": " + error);
+                byClient[event.clientId].push_back({event.time, indexedEvents, offset, (uint32_t)text.size()});
+                if (clock.empty() || event.time > clock.back().second)
+                    clock.push_back({indexedEvents, event.time});
+                indexedEvents++;
+                indexedTo = offset + (long long)text.size();
+            },
+            indexedTo);
+    }
+
+    // When the checkpoint covering the first events was taken: the time of the latest of them.
+    // Nothing if it covers none.
+    optional<int64_t> takenAt(long long events) const
+    {
+        auto after = lower_bound(clock.begin(), clock.end(), events,
+                                 [](const pair<long long, int64_t> &entry, long long count) { return entry.first < count; });
+        if (after == clock.begin())
+            return nullopt;
+        return prev(after)->second;
+    }
+
+    void loadCheckpoint(long long events, const string &path)
+    {
+        if (loadedEvents == events)
+            return;
+        LedgerCheckpoint loaded = ledger::loadCheckpoint(path);
+        clients.clear();
+        removedClients.clear();
+        portfolios.clear();
+        for (auto &client : loaded.clients)
+            clients.emplace(client.getId(), move(client));
+        for (auto &client : loaded.removed)
+            removedClients.emplace(client.getId(), move(client));
+        for (auto &portfolio : loaded.portfolios)
+            portfolios.emplace(portfolio.id, move(portfolio));
+        loadedEvents = events;
+    }
+
+public:
+    PointInTime(const string &dir) : dir(dir) {}
+
+    size_t indexedClients() const { return byClient.size(); }
+
+    // The client as they were just after the last event at or before the time. Returns false if the
+    // ledger has no checkpoint or the time comes before its first event.
+    bool query(long long clientId, int64_t time, ClientAsOf &result)
+    {
+        auto all = ledger::checkpoints(dir);
+        if (all.empty())
+            return false;
+        refresh(all.front().first);
+        if (clock.empty() || time < clock.front().second)
+        {
+            // The latest archived segment that goes back that far
+            auto archived = ledger::archives(dir);
+            for (size_t i = archived.size(); i-- > 0;)
+            {
+                unique_ptr<PointInTime> &segment = segments[archived[i].second];
+                if (segment == nullptr)
+                    segment = make_unique<PointInTime>(archived[i].second);
+                if (segment->query(clientId, time, result))
+                    return true;
+            }
+            return false;
+        }
+
+        // The latest checkpoint whose events all happened by then; the first one covers none
+        // of this journal
+        size_t chosen = 0;
+        for (size_t i = all.size(); i-- > 1;)
+        {
+            optional<int64_t> taken = takenAt(all[i].first);
+            if (all[i].first <= indexedEvents && taken.has_value() && *taken <= time)
+            {
+                chosen = i;
+                break;
+            }
+        }
+        loadCheckpoint(all[chosen].first, all[chosen].second);
+
+        result = ClientAsOf();
+        result.snapshotEvents = all[chosen].first;
+        auto registered = clients.find(clientId);
+        auto removed = removedClients.find(clientId);
+        if (registered != clients.end())
+            result.client = registered->second;
+        else if (removed != removedClients.end())
+        {
+            result.client = removed->second;
+            result.removed = true;
+        }
+        auto portfolio = portfolios.find(clientId);
+        if (portfolio != portfolios.end())
+            result.portfolio = portfolio->second;
+
+        // The client's events after the checkpoint, up to the time
+        auto found = byClient.find(clientId);
+        if (found == byClient.end())
+            return true;
+        const vector<EventRef> &refs = found->second;
+        auto first = lower_bound(refs.begin(), refs.end(), result.snapshotEvents,
+                                 [](const EventRef &ref, long long position) { return ref.position < position; });
+        string text;
+        for (auto ref = first; ref != refs.end() && ref->time <= time; ++ref)
+        {
+            LedgerEvent event;
+            string error;
+            if (!readFileRange(eventsPath(), ref->offset, ref->length, text) ||
+                !parseRecord(text.data(), text.size(), event, &error))
+                throw runtime_error(eventsPath() + ": cannot read the event at " + to_string(ref->offset) + " " + error);
+            if (event.kind == "register")
+            {
+                result.client = Client(event.name.value_or(""), clientId, event.address.value_or(""), event.dob.value_or(""));
+                result.removed = false;
+            }
+            else if (event.kind == "remove")
+                result.removed = true;
+            else
+            {
+                if (!result.portfolio.has_value())
+                {
+                    Portfolio opened;
+                    opened.id = clientId;
+                    opened.name = result.client.has_value() ? result.client->getName() : "";
+                    result.portfolio = opened;
+                }
+                ledger::apply(*result.portfolio, event);
+            }
+            result.eventsApplied++;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef PRICE_HISTORY_HPP
+#define PRICE_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "records.hpp"
+#include "parallel_scan.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// Open, high, low and close price and the shares traded of a stock on one day
+struct PriceBar
+{
+    Money close;
+    int64_t day = 0; // epoch second of the UTC midnight, see dayOf
+    Money high;
+    Money low;
+    Money open;
+    long long volume = 0;
+
+    static auto fields()
+    {
+        return make_tuple(field("close", &PriceBar::close), field("day", &PriceBar::day), field("high", &PriceBar::high),
+                          field("low", &PriceBar::low), field("open", &PriceBar::open),
+                          field("volume", &PriceBar::volume));
+    }
+};
+
+// The daily bars of one stock, an entry of price_history.json
+struct PriceSeries
+{
+    vector<PriceBar> bars; // oldest first, one per day
+    long long stockId = 0;
+
+    static auto fields()
+    {
+        return make_tuple(field("bars", &PriceSeries::bars), field("stockId", &PriceSeries::stockId));
+    }
+};
+
+// Daily price history of every stock, for backtests and indicators. A series is a vector of bars
+// ordered by day, so a date range is two binary searches and a copy.
+class PriceHistory
+{
+private:
+    vector<PriceSeries> series;
+    unordered_map<long long, size_t> byStock;
+    bool dirty = false;
+
+    static bool earlier(const PriceBar &a, const PriceBar &b) { return a.day < b.day; }
+
+public:
+    bool isDirty() const { return dirty; }
+    size_t stocks() const { return series.size(); }
+
+    size_t bars() const
+    {
+        size_t count = 0;
+        for (auto &one : series)
+            count += one.bars.size();
+        return count;
+    }
+
+    // Every bar of the stock, nullptr if it has no history
+    const vector<PriceBar> *find(long long stockId) const
+    {
+        auto found = byStock.find(stockId);
+        return found != byStock.end() ? &series[found->second].bars : nullptr;
+    }
+
+    // Bars of the stock with from <= day < to, oldest first
+    vector<PriceBar> range(long long stockId, int64_t from, int64_t to) const
+    {
+        const vector<PriceBar> *all = find(stockId);
+        if (all == nullptr || from >= to)
+            return {};
+        auto first = lower_bound(all->begin(), all->end(), from, [](const PriceBar &bar, int64_t day) { return bar.day < day; });
+        auto last = lower_bound(first, all->end(), to, [](const PriceBar &bar, int64_t day) { return bar.day < day; });
+        return vector<PriceBar>(first, last);
+    }
+
+    // The bar of the latest day at or before the day, nullptr if there is none
+    const PriceBar *onOrBefore(long long stockId, int64_t day) const
+    {
+        const vector<PriceBar> *all = find(stockId);
+        if (all == nullptr)
+            return nullptr;
+        auto after = upper_bound(all->begin(), all->end(), day, [](int64_t at, const PriceBar &bar) { return at < bar.day; });
+        return after == all->begin() ? nullptr : &*prev(after);
+    }
+
+    // Adds the bars of a stock, one per day and ordered by day. A bar replaces the one the stock
+    // already has for its day. Returns the number of days that were new.
+    size_t merge(long long stockId, const vector<PriceBar> &bars)
+    {
+        if (bars.empty())
+            return 0;
+        auto found = byStock.find(stockId);
+        if (found == byStock.end())
+        {
+            byStock.emplace(stockId, series.size());
+            series.push_back({bars, stockId});
+            dirty = true;
+            return bars.size();
+        }
+
+        vector<PriceBar> &kept = series[found->second].bars;
+        vector<PriceBar> merged;
+        merged.reserve(kept.size() + bars.size());
+        size_t i = 0, j = 0, added = 0;
+        while (i < kept.size() || j < bars.size())
+        {
+            if (j == bars.size() || (i < kept.size() && kept[i].day < bars[j].day))
+                merged.push_back(kept[i++]);
+            else
+            {
+                if (i < kept.size() && kept[i].day == bars[j].day)
+                    i++;
+                else
+                    added++;
+                merged.push_back(bars[j++]);
+            }
+        }
+        kept.swap(merged);
+        dirty = true;
+        return added;
+    }
+
+    // A missing file is an empty history
+    void load(const string &path, unsigned threads = thread::hardware_concurrency())
+    {
+        series.clear();
+        byStock.clear();
+        parallelRecords<PriceSeries>(
+            path, threads,
+            [](vector<PriceSeries> &loaded) {
+                for (auto &one : loaded)
+                    stable_sort(one.bars.begin(), one.bars.end(), earlier);
+                return move(loaded);
+            },
+            [&](vector<PriceSeries> &loaded) {
+                for (auto &one : loaded)
+                {
+                    byStock.emplace(one.stockId, series.size());
+                    series.push_back(move(one));
+                }
+            });
+        dirty = false;
+    }
+
+    // Series are written by stock id
+    void save(const string &path)
+    {
+        sort(series.begin(), series.end(), [](const PriceSeries &a, const PriceSeries &b) { return a.stockId < b.stockId; });
+        byStock.clear();
+        for (size_t k = 0; k < series.size(); k++)
+            byStock.emplace(series[k].stockId, k);
+        saveRecords(path, series, 0);
+        dirty = false;
+    }
+};
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef RECONCILIATION_HPP
+#define RECONCILIATION_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+
+#include "records.hpp"
+#include "parallel_scan.hpp"
+#include "ledger.hpp"
+#include "time_index.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// Shares of a stock that portfolio.json holds for a client against the net of their purchases
+// and sales in transactions.json
+struct HoldingDiscrepancy
+{
+    long long clientId;
+    long long stockId;
+    long long stored;
+    long long expected;
+};
+
+// Balance in portfolio.json against the deposits and settlements of cash_movements.json less
+// purchases plus sales
+struct BalanceDiscrepancy
+{
+    long long clientId;
+    Money stored;
+    Money expected;
+};
+
+// A transaction filed under someone other than the client who made it: under another name, or in
+// an entry whose first trade is another client's. Purchases get an entry of their own while sales
+// go to the first entry with the client's name, so clients who share a name, or who were renamed,
+// end up with trades in the wrong entry.
+struct MisfiledTrade
+{
+    string entryName;
+    long long clientId;
+    string type;
+    int64_t time;
+};
+
+struct ReconcileReport
+{
+    long long transactions = 0;
+    long long movements = 0;
+    long long portfolios = 0;
+    long long accounts = 0; // clients with a portfolio, trades or cash movements
+    string baseline;   // the checkpoint the expected state starts from, empty if there is none
+    int64_t since = 0; // the records from then on are added to it
+    vector<HoldingDiscrepancy> holdings;  // by client and stock id
+    vector<BalanceDiscrepancy> balances;  // by client id
+    vector<BalanceDiscrepancy> unrecorded; // without a baseline: balances of clients with no cash movements
+    long long misfiled = 0;
+    vector<MisfiledTrade> misfiledExamples; // the first few, in file order
+    double seconds = 0;
+
+    bool clean() const { return holdings.empty() && balances.empty() && misfiled == 0; }
+};
+
+// Checks portfolio.json against what transactions.json and cash_movements.json say it should hold.
+// The money a client had before cash_movements.json existed, and on generated books, is in none
+// of them, so the expected state starts from the first ledger checkpoint, checkpoints/ledger-0.json
+// (kept in the oldest archive segment once compacted), which holds the book as it was before the
+// engine recorded anything. Only the trades and movements from the first event on are added to it.
+// Without that checkpoint everything is added up from nothing, and a balance that differs for a
+// client with no cash movements at all is listed apart, as unrecorded, rather than as a mismatch.
+// Clients are split into one shard per thread by id. Every file is read in parallel batches (see
+// parallelRecords); each batch is turned into per-shard lists of changes on the worker threads,
+// and a round of batches is then folded into the shards on the same threads, one shard per thread,
+// so no two threads touch the same client and nothing is locked. The comparison runs a shard per
+// thread too. Trades are joined by client and stock id, never by the name of their entry, which
+// is checked on its own.
+class ReconcileJob
+{
+private:
+    static constexpr size_t MISFILED_EXAMPLES = 10;
+
+    // One client as the files have it
+    struct Account
+    {
+        Money storedBalance;
+        vector<pair<long long, long long>> storedShares; // stock id, shares
+        Money expectedBalance;
+        vector<pair<long long, long long>> expectedShares;
+        bool moved = false; // has cash movements
+    };
+
+    // A change a trade or cash movement makes to a client
+    struct Change
+    {
+        long long clientId;
+        long long stockId; // 0 for cash alone
+        long long shares;
+        Money cash;
+    };
+
+    // What a batch of records becomes: the changes of each shard
+    struct Split
+    {
+        vector<vector<Change>> changes;
+        vector<vector<Portfolio>> portfolios;
+        long long records = 0;
+        long long misfiled = 0;
+        vector<MisfiledTrade> misfiledExamples;
+    };
+
+    string dir;
+    unsigned threads;
+    int64_t since = INT64_MIN; // trades and movements before then are in the baseline
+    vector<unordered_map<long long, Account>> shards;
+    unordered_map<long long, string> names; // client names, for the entry check
+    vector<Split> round;                     // batches waiting to be folded
+
+    size_t shardOf(long long clientId) const { return (size_t)(((unsigned long long)clientId) % shards.size()); }
+
+    static void addShares(vector<pair<long long, long long>> &shares, long long stockId, long long count)
+    {
+        for (auto &one : shares)
+        {
+            if (one.first == stockId)
+            {
+                one.second += count;
+                return;
+            }
+        }
+        shares.push_back({stockId, count});
+    }
+
+    // Runs the function for every shard, a shard per thread
+    template <typename Function>
+    void forEachShard(Function function)
+    {
+        if (shards.size() == 1)
+        {
+            function(0);
+            return;
+        }
+        // an error in a worker is rethrown here
+        vector<exception_ptr> errors(shards.size());
+        vector<thread> workers;
+        for (size_t s = 0; s < shards.size(); s++)
+        {
+            workers.emplace_back([&, s]() {
+                try
+                {
+                    function(s);
+                }
+                catch (...)
+                {
+                    errors[s] = current_exception();
+                }
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        for (auto &error : errors)
+        {
+            if (error)
+                rethrow_exception(error);
+        }
+    }
+
+    // Folds the batches read so far into the shards
+    void foldRound(ReconcileReport &report)
+    {
+        if (round.empty())
+            return;
+        forEachShard([&](size_t s) {
+            unordered_map<long long, Account> &accounts = shards[s];
+            for (auto &split : round)
+            {
+                if (!split.changes.empty())
+                {
+                    for (auto &change : split.changes[s])
+                    {
+                        Account &account = accounts[change.clientId];
+                        account.expectedBalance += change.cash;
+                        if (change.stockId != 0)
+                            addShares(account.expectedShares, change.stockId, change.shares);
+                        else
+                            account.moved = true;
+                    }
+                }
+                if (!split.portfolios.empty())
+                {
+                    for (auto &portfolio : split.portfolios[s])
+                    {
+                        Account &account = accounts[portfolio.id];
+                        account.storedBalance += portfolio.balance;
+                        for (auto &holding : portfolio.stocks)
+                            addShares(account.storedShares, holding.stockId, holding.numberOfShares);
+                    }
+                }
+            }
+        });
+        for (auto &split : round)
+        {
+            report.misfiled += split.misfiled;
+            for (auto &example : split.misfiledExamples)
+            {
+                if (report.misfiledExamples.size() < MISFILED_EXAMPLES)
+                    report.misfiledExamples.push_back(move(example));
+            }
+        }
+        round.clear();
+    }
+
+    // Reads a file in parallel batches, splitting each batch into changes with split, and folds
+    // every round of batches into the shards. Returns the number of records.
+    template <typename T, typename SplitBatch>
+    long long readFile(const string &name, SplitBatch split, ReconcileReport &report)
+    {
+        long long records = 0;
+        parallelRecords<T>(
+            dir + "/" + name, threads,
+            [&](vector<T> &batch) {
+                Split result;
+                split(batch, result);
+                return result;
+            },
+            [&](Split &result) {
+                records += result.records;
+                round.push_back(move(result));
+                if (round.size() >= threads)
+                    foldRound(report);
+            });
+        foldRound(report);
+        return records;
+    }
+
+    // Starts the expected state from the first checkpoint of the ledger, if there is one
+    void loadBaseline(ReconcileReport &report)
+    {
+        auto segments = ledger::archives(dir);
+        string ledgerDir = segments.empty() ? dir : segments.front().second;
+        auto all = ledger::checkpoints(ledgerDir);
+        if (all.empty() || all.front().first != 0)
+            return;
+        LedgerCheckpoint first = ledger::loadCheckpoint(all.front().second);
+        for (auto &portfolio : first.portfolios)
+        {
+            Account &account = shards[shardOf(portfolio.id)][portfolio.id];
+            account.expectedBalance += portfolio.balance;
+            for (auto &holding : portfolio.stocks)
+                addShares(account.expectedShares, holding.stockId, holding.numberOfShares);
+        }
+        // no event yet, then nothing the files hold is after it
+        since = ledger::firstEventTime(ledgerDir, first.offset).value_or(INT64_MAX);
+        report.baseline = all.front().second;
+        report.since = since;
+    }
+
+    void loadNames()
+    {
+        for (const char *file : {"added_clients.json", "removed_clients.json"})
+        {
+            parallelRecords<Client>(
+                dir + "/" + file, threads, [](vector<Client> &clients) { return move(clients); },
+                [&](vector<Client> &clients) {
+                    for (auto &client : clients)
+                        names.emplace(client.getId(), client.getName());
+                });
+        }
+    }
+
+public:
+    ReconcileJob(const string &dir, unsigned threads = thread::hardware_concurrency())
+        : dir(dir), threads(max(threads, 1u))
+    {
+    }
+
+    ReconcileReport run()
+    {
+        auto start = chrono::steady_clock::now();
+        ReconcileReport report;
+        shards.assign(threads, {});
+        since = INT64_MIN;
+        loadBaseline(report);
+        loadNames();
+
+        report.portfolios = readFile<Portfolio>(
+            "portfolio.json",
+            [&](vector<Portfolio> &portfolios, Split &split) {
+                split.portfolios.resize(shards.size());
+                for (auto &portfolio : portfolios)
+                    split.portfolios[shardOf(portfolio.id)].push_back(move(portfolio));
+                split.records = (long long)portfolios.size();
+            },
+            report);
+
+        report.movements = readFile<CashMovement>(
+            "cash_movements.json",
+            [&](vector<CashMovement> &movements, Split &split) {
+                split.changes.resize(shards.size());
+                for (auto &movement : movements)
+                {
+                    if (movement.time >= since)
+                        split.changes[shardOf(movement.clientId)].push_back({movement.clientId, 0, 0, movement.amount});
+                }
+                split.records = (long long)movements.size();
+            },
+            report);
+
+        // Purchases take their total from the balance and sales add theirs
+        report.transactions = readFile<TransactionHistory>(
+            "transactions.json",
+            [&](vector<TransactionHistory> &histories, Split &split) {
+                split.changes.resize(shards.size());
+                for (auto &history : histories)
+                {
+                    long long owner = history.transactions.empty() ? 0 : history.transactions[0].id;
+                    for (auto &transaction : history.transactions)
+                    {
+                        bool sale = transaction.type == "sell";
+                        int64_t time = transaction.time.has_value() ? parseCtime(*transaction.time) : transaction.timestamp;
+                        if (time >= since)
+                            split.changes[shardOf(transaction.id)].push_back(
+                                {transaction.id, transaction.stockId,
+                                 sale ? -transaction.numberOfShares : transaction.numberOfShares,
+                                 sale ? transaction.totalCost : -transaction.totalCost});
+                        split.records++;
+
+                        auto name = names.find(transaction.id);
+                        if (transaction.id == owner && (name == names.end() || name->second == history.name))
+                            continue;
+                        split.misfiled++;
+                        if (split.misfiledExamples.size() < MISFILED_EXAMPLES)
+                            split.misfiledExamples.push_back({history.name, transaction.id, transaction.type, time});
+                    }
+                }
+            },
+            report);
+
+        // Every shard compares its clients; a holding counts as zero shares where there is none
+        vector<vector<HoldingDiscrepancy>> holdings(shards.size());
+        vector<vector<BalanceDiscrepancy>> balances(shards.size()), unrecorded(shards.size());
+        bool baseline = !report.baseline.empty();
+        forEachShard([&](size_t s) {
+            for (auto &entry : shards[s])
+            {
+                Account &account = entry.second;
+                if (account.storedBalance != account.expectedBalance)
+                {
+                    bool untraced = !baseline && !account.moved;
+                    (untraced ? unrecorded : balances)[s].push_back({entry.first, account.storedBalance, account.expectedBalance});
+                }
+                for (auto &stored : account.storedShares)
+                    addShares(account.expectedShares, stored.first, 0);
+                for (auto &expected : account.expectedShares)
+                {
+                    long long stored = 0;
+                    for (auto &one : account.storedShares)
+                    {
+                        if (one.first == expected.first)
+                            stored = one.second;
+                    }
+                    if (stored != expected.second)
+                        holdings[s].push_back({entry.first, expected.first, stored, expected.second});
+                }
+            }
+        });
+        for (size_t s = 0; s < shards.size(); s++)
+        {
+            report.accounts += (long long)shards[s].size();
+            report.holdings.insert(report.holdings.end(), holdings[s].begin(), holdings[s].end());
+            report.balances.insert(report.balances.end(), balances[s].begin(), balances[s].end());
+            report.unrecorded.insert(report.unrecorded.end(), unrecorded[s].begin(), unrecorded[s].end());
+        }
+        sort(report.holdings.begin(), report.holdings.end(), [](const HoldingDiscrepancy &a, const HoldingDiscrepancy &b) {
+            return make_pair(a.clientId, a.stockId) < make_pair(b.clientId, b.stockId);
+        });
+        auto byClient = [](const BalanceDiscrepancy &a, const BalanceDiscrepancy &b) { return a.clientId < b.clientId; };
+        sort(report.balances.begin(), report.balances.end(), byClient);
+        sort(report.unrecorded.begin(), report.unrecorded.end(), byClient);
+
+        shards.clear();
+        names.clear();
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+};
+
+#endif
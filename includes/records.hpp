@@ -0,0 +1,889 @@
+#ifndef RECORDS_HPP
+#define RECORDS_HPP
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <optional>
+#include <utility>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+
+#include "json.hpp"
+#include "money.hpp"
+#include "storage.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+// A record type lists its fields once, as name and member pointer pairs returned by a static
+// fields() function. The reader and the writer below are generated from that list, so a loaded
+// record is a plain struct and its fields are read without any string lookup.
+// Fields are listed in alphabetical order, which is the order nlohmann::json writes object keys,
+// so files written by either are the same.
+template <typename T, typename M>
+struct Field
+{
+    const char *name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> field(const char *name, M T::*member)
+{
+    return {name, member};
+}
+
+// Symbol id of a holding or transaction that does not name a stock, see symbols.hpp
+constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+
+// Define the Client class
+class Client
+{
+private:
+    string name;
+    long long id = 0;
+    string address;
+    string dob;
+
+public:
+    Client() {}
+    Client(string name, long long id, string address, string dob) : name(name), id(id), address(address), dob(dob) {}
+
+    const string &getName() const { return name; }
+    long long getId() const { return id; }
+    const string &getAddress() const { return address; }
+    const string &getDoB() const { return dob; }
+
+    void setName(string name) { this->name = name; }
+    void setId(long long id) { this->id = id; }
+    void setAddress(string address) { this->address = address; }
+    void setDoB(string dob) { this->dob = dob; }
+
+    static auto fields()
+    {
+        return make_tuple(field("address", &Client::address), field("dob", &Client::dob), field("id", &Client::id),
+                          field("name", &Client::name));
+    }
+};
+
+// Define the StockList class
+class StockList
+{
+private:
+    long long stockId = 0;
+    string stockName;
+    Money marketPrice;
+    optional<Money> previousClose; // price before the last update, missing until prices are first updated
+
+public:
+    StockList() {}
+    StockList(long long stockId, string stockName, Money marketPrice) : stockId(stockId), stockName(stockName), marketPrice(marketPrice) {}
+
+    long long getId() const { return stockId; }
+    const string &getStockName() const { return stockName; }
+    Money getMarketPrice() const { return marketPrice; }
+    Money getPreviousClose() const { return previousClose.value_or(marketPrice); }
+
+    void setStockId(long long stockId) { this->stockId = stockId; }
+    void setStockName(string stockName) { this->stockName = stockName; }
+    void setMarketPrice(Money marketPrice) { this->marketPrice = marketPrice; }
+    void setPreviousClose(Money previousClose) { this->previousClose = previousClose; }
+
+    static auto fields()
+    {
+        return make_tuple(field("marketPrice", &StockList::marketPrice), field("previousClose", &StockList::previousClose),
+                          field("stockId", &StockList::stockId), field("stockName", &StockList::stockName));
+    }
+};
+
+// Shares of one stock held by a client, an entry of portfolio.json
+struct Holding
+{
+    long long numberOfShares = 0;
+    optional<Money> purchaseRate; // only written by buying more of a stock already held
+    string purchaseTime;
+    Money purchasedRate;
+    long long stockId = 0;
+    optional<string> stockName; // only in files written before symbols were interned
+    uint32_t symbol = NO_SYMBOL;
+
+    static auto fields()
+    {
+        return make_tuple(field("numberOfShares", &Holding::numberOfShares), field("purchaseRate", &Holding::purchaseRate),
+                          field("purchaseTime", &Holding::purchaseTime), field("purchasedRate", &Holding::purchasedRate),
+                          field("stockId", &Holding::stockId), field("stockName", &Holding::stockName),
+                          field("symbol", &Holding::symbol));
+    }
+};
+
+// Balance and holdings of one client
+struct Portfolio
+{
+    Money balance;
+    long long id = 0;
+    string name;
+    vector<Holding> stocks;
+
+    static auto fields()
+    {
+        return make_tuple(field("balance", &Portfolio::balance), field("id", &Portfolio::id), field("name", &Portfolio::name),
+                          field("stocks", &Portfolio::stocks));
+    }
+};
+
+// One purchase or sale
+struct Transaction
+{
+    long long id = 0;
+    long long numberOfShares = 0;
+    Money price;
+    long long stockId = 0;
+    optional<string> stockName; // only in files written before symbols were interned
+    uint32_t symbol = NO_SYMBOL;
+    optional<string> time; // ctime() text, only in files written before timestamps
+    int64_t timestamp = 0; // epoch seconds
+    Money totalCost;
+    string type; // "purchase" or "sell"
+
+    static auto fields()
+    {
+        return make_tuple(field("id", &Transaction::id), field("numberOfShares", &Transaction::numberOfShares),
+                          field("price", &Transaction::price), field("stockId", &Transaction::stockId),
+                          field("stockName", &Transaction::stockName), field("symbol", &Transaction::symbol),
+                          field("time", &Transaction::time), field("timestamp", &Transaction::timestamp),
+                          field("totalCost", &Transaction::totalCost), field("type", &Transaction::type));
+    }
+};
+
+// Money put into or taken out of a balance outside of trading, an entry of cash_movements.json
+struct CashMovement
+{
+    Money amount; // negative for debits
+    long long clientId = 0;
+    int64_t time = 0; // epoch seconds
+    string type;      // "deposit" or "settlement"
+
+    static auto fields()
+    {
+        return make_tuple(field("amount", &CashMovement::amount), field("clientId", &CashMovement::clientId),
+                          field("time", &CashMovement::time), field("type", &CashMovement::type));
+    }
+};
+
+// Transactions recorded under one client name, an entry of transactions.json
+struct TransactionHistory
+{
+    string name;
+    vector<Transaction> transactions;
+
+    static auto fields()
+    {
+        return make_tuple(field("name", &TransactionHistory::name), field("transactions", &TransactionHistory::transactions));
+    }
+};
+
+namespace records
+{
+    template <typename T>
+    struct isVector : false_type
+    {
+    };
+    template <typename T>
+    struct isVector<vector<T>> : true_type
+    {
+    };
+
+    template <typename T>
+    struct isOptional : false_type
+    {
+    };
+    template <typename T>
+    struct isOptional<optional<T>> : true_type
+    {
+    };
+
+    // Calls visit with the field at a run time index
+    template <typename Tuple, typename Visitor, size_t... I>
+    void visitField(const Tuple &fields, int index, Visitor &&visit, index_sequence<I...>)
+    {
+        ((I == (size_t)index ? (void)visit(get<I>(fields)) : (void)0), ...);
+    }
+
+    template <typename T, typename Visitor>
+    void visitField(int index, Visitor &&visit)
+    {
+        static const auto fields = T::fields();
+        visitField(fields, index, visit, make_index_sequence<tuple_size<decltype(fields)>::value>());
+    }
+
+    template <typename T, size_t... I>
+    int findField(const string &key, index_sequence<I...>)
+    {
+        static const auto fields = T::fields();
+        int found = -1;
+        ((found < 0 && key == get<I>(fields).name ? (void)(found = I) : (void)0), ...);
+        return found;
+    }
+
+    // Numbers are written the way nlohmann::json writes them: shortest round trip form,
+    // and a ".0" on floating point values that happen to be whole
+    inline void writeNumber(string &out, double value)
+    {
+        if (!isfinite(value))
+        {
+            out += "null";
+            return;
+        }
+        char buffer[32];
+        char *end = to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        out.append(buffer, end);
+        if (find_if(buffer, end, [](char ch) { return ch == '.' || ch == 'e'; }) == end)
+            out += ".0";
+    }
+
+    // Money is written like the double of the same value would be: "12.5", "12.05", "12.0"
+    inline void writeMoney(string &out, Money value)
+    {
+        string text = value.toString();
+        if (text.back() == '0')
+            text.pop_back();
+        out += text;
+    }
+
+    inline void writeInteger(string &out, long long value)
+    {
+        char buffer[24];
+        out.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+    }
+
+    inline void writeString(string &out, const string &value)
+    {
+        out += '"';
+        for (unsigned char ch : value)
+        {
+            switch (ch)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            default:
+                if (ch < 0x20)
+                {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+                    out += buffer;
+                }
+                else
+                    out += char(ch);
+            }
+        }
+        out += '"';
+    }
+
+    inline void newline(string &out, int indent, int level)
+    {
+        out += '\n';
+        out.append((size_t)indent * level, ' ');
+    }
+
+    template <typename T>
+    void writeValue(string &out, const T &value, int indent, int level);
+
+    template <typename T>
+    void writeRecord(string &out, const T &record, int indent, int level)
+    {
+        static const auto fields = T::fields();
+        out += '{';
+        bool first = true;
+        apply(
+            [&](const auto &...f) {
+                auto writeField = [&](const auto &one) {
+                    const auto &value = record.*(one.member);
+                    if constexpr (isOptional<decay_t<decltype(value)>>::value)
+                    {
+                        if (!value.has_value())
+                            return;
+                    }
+                    if (!first)
+                        out += ',';
+                    first = false;
+                    newline(out, indent, level + 1);
+                    writeString(out, one.name);
+                    out += ": ";
+                    if constexpr (isOptional<decay_t<decltype(value)>>::value)
+                        writeValue(out, *value, indent, level + 1);
+                    else
+                        writeValue(out, value, indent, level + 1);
+                };
+                (writeField(f), ...);
+            },
+            fields);
+        if (first)
+        {
+            out += '}';
+            return;
+        }
+        newline(out, indent, level);
+        out += '}';
+    }
+
+    template <typename T>
+    void writeValue(string &out, const T &value, int indent, int level)
+    {
+        if constexpr (is_same<T, string>::value)
+            writeString(out, value);
+        else if constexpr (is_same<T, Money>::value)
+            writeMoney(out, value);
+        else if constexpr (is_floating_point<T>::value)
+            writeNumber(out, value);
+        else if constexpr (is_integral<T>::value)
+            writeInteger(out, value);
+        else if constexpr (isVector<T>::value)
+        {
+            if (value.empty())
+            {
+                out += "[]";
+                return;
+            }
+            out += '[';
+            for (size_t i = 0; i < value.size(); i++)
+            {
+                if (i > 0)
+                    out += ',';
+                newline(out, indent, level + 1);
+                writeValue(out, value[i], indent, level + 1);
+            }
+            newline(out, indent, level);
+            out += ']';
+        }
+        else
+            writeRecord(out, value, indent, level);
+    }
+
+    // What the SAX reader fills in: a record or a vector of records, behind a table of
+    // functions generated for its type
+    struct Target;
+
+    struct TypeInfo
+    {
+        int (*findField)(const string &key);
+        void (*setInteger)(void *object, int field, long long value);
+        void (*setNumber)(void *object, int field, double value, const string &text);
+        void (*setString)(void *object, int field, string &value);
+        Target (*child)(void *object, int field); // a record or vector field of a record
+        Target (*append)(void *object);           // a new element at the end of a vector
+    };
+
+    struct Target
+    {
+        void *object;
+        const TypeInfo *type;
+        bool isArray;
+    };
+
+    template <typename T>
+    const TypeInfo &typeInfo();
+
+    template <typename M>
+    Target targetOf(M &member)
+    {
+        if constexpr (isVector<M>::value)
+            return {&member, &typeInfo<M>(), true};
+        else if constexpr (is_class<M>::value && !is_same<M, string>::value && !is_same<M, Money>::value && !isOptional<M>::value)
+            return {&member, &typeInfo<M>(), false};
+        else
+            return {nullptr, nullptr, false};
+    }
+
+    template <typename M>
+    void assignInteger(M &member, long long value)
+    {
+        if constexpr (is_same<M, Money>::value)
+            member = Money::fromPaisa(checkedMul(value, 100));
+        else if constexpr (is_arithmetic<M>::value)
+            member = (M)value;
+        else if constexpr (isOptional<M>::value)
+        {
+            typename M::value_type inner;
+            assignInteger(inner, value);
+            member = inner;
+        }
+    }
+
+    // Money is parsed from the text of the number, so it is exact whatever the double says
+    template <typename M>
+    void assignNumber(M &member, double value, const std::string &text)
+    {
+        if constexpr (is_same<M, Money>::value)
+        {
+            if (!Money::parse(text, member))
+                member = Money::fromRupees(value);
+        }
+        else if constexpr (is_arithmetic<M>::value)
+            member = (M)value;
+        else if constexpr (isOptional<M>::value)
+        {
+            typename M::value_type inner;
+            assignNumber(inner, value, text);
+            member = inner;
+        }
+    }
+
+    template <typename T>
+    const TypeInfo &recordInfo()
+    {
+        static const TypeInfo info = {
+            [](const string &key) {
+                return findField<T>(key, make_index_sequence<tuple_size<decltype(T::fields())>::value>());
+            },
+            [](void *object, int index, long long value) {
+                visitField<T>(index, [&](const auto &f) { assignInteger(((T *)object)->*(f.member), value); });
+            },
+            [](void *object, int index, double value, const string &text) {
+                visitField<T>(index, [&](const auto &f) { assignNumber(((T *)object)->*(f.member), value, text); });
+            },
+            [](void *object, int index, string &value) {
+                visitField<T>(index, [&](const auto &f) {
+                    auto &member = ((T *)object)->*(f.member);
+                    if constexpr (is_same<decay_t<decltype(member)>, string>::value ||
+                                  is_same<decay_t<decltype(member)>, optional<string>>::value)
+                        member = move(value);
+                });
+            },
+            [](void *object, int index) {
+                Target target = {nullptr, nullptr, false};
+                visitField<T>(index, [&](const auto &f) { target = targetOf(((T *)object)->*(f.member)); });
+                return target;
+            },
+            nullptr};
+        return info;
+    }
+
+    template <typename V>
+    const TypeInfo &vectorInfo()
+    {
+        static const TypeInfo info = {nullptr, nullptr, nullptr, nullptr, nullptr, [](void *object) {
+                                          V &elements = *(V *)object;
+                                          elements.emplace_back();
+                                          return targetOf(elements.back());
+                                      }};
+        return info;
+    }
+
+    template <typename T>
+    const TypeInfo &typeInfo()
+    {
+        if constexpr (isVector<T>::value)
+            return vectorInfo<T>();
+        else
+            return recordInfo<T>();
+    }
+
+    // nlohmann::json SAX handler that fills typed records directly, without building a DOM.
+    // Unknown keys and values of the wrong shape are skipped.
+    class Reader
+    {
+    private:
+        struct Frame
+        {
+            Target target;
+            int field;
+        };
+        vector<Frame> stack;
+        Target root;
+        int skipping = 0;
+        std::string error;
+
+        bool scalarTarget(int &index, void *&object, const TypeInfo *&type)
+        {
+            if (skipping > 0 || stack.empty() || stack.back().target.isArray || stack.back().field < 0)
+                return false;
+            index = stack.back().field;
+            object = stack.back().target.object;
+            type = stack.back().target.type;
+            return true;
+        }
+
+        bool open(bool isArray)
+        {
+            if (skipping > 0)
+            {
+                skipping++;
+                return true;
+            }
+            Target next = {nullptr, nullptr, false};
+            if (stack.empty())
+                next = root;
+            else if (stack.back().target.isArray)
+                next = stack.back().target.type->append(stack.back().target.object);
+            else if (stack.back().field >= 0)
+                next = stack.back().target.type->child(stack.back().target.object, stack.back().field);
+
+            if (next.type == nullptr || next.isArray != isArray)
+            {
+                skipping = 1;
+                return true;
+            }
+            stack.push_back({next, -1});
+            return true;
+        }
+
+        bool close()
+        {
+            if (skipping > 0)
+                skipping--;
+            else
+                stack.pop_back();
+            return true;
+        }
+
+    public:
+        Reader(Target root) : root(root) {}
+
+        const std::string &getError() const { return error; }
+
+        bool null() { return true; }
+        bool boolean(bool) { return true; }
+        bool number_integer(json::number_integer_t value)
+        {
+            int index;
+            void *object;
+            const TypeInfo *type;
+            if (scalarTarget(index, object, type))
+                type->setInteger(object, index, value);
+            return true;
+        }
+        bool number_unsigned(json::number_unsigned_t value) { return number_integer((json::number_integer_t)value); }
+        bool number_float(json::number_float_t value, const json::string_t &text)
+        {
+            int index;
+            void *object;
+            const TypeInfo *type;
+            if (scalarTarget(index, object, type))
+                type->setNumber(object, index, value, text);
+            return true;
+        }
+        bool string(json::string_t &value)
+        {
+            int index;
+            void *object;
+            const TypeInfo *type;
+            if (scalarTarget(index, object, type))
+                type->setString(object, index, value);
+            return true;
+        }
+        bool binary(json::binary_t &) { return true; }
+        bool start_object(size_t) { return open(false); }
+        bool key(json::string_t &key)
+        {
+            if (skipping == 0 && !stack.empty() && !stack.back().target.isArray)
+                stack.back().field = stack.back().target.type->findField(key);
+            return true;
+        }
+        bool end_object() { return close(); }
+        bool start_array(size_t) { return open(true); }
+        bool end_array() { return close(); }
+        bool parse_error(size_t, const std::string &, const nlohmann::detail::exception &ex)
+        {
+            error = ex.what();
+            return false;
+        }
+    };
+}
+
+// Parses a JSON array of records straight into typed records
+template <typename T>
+bool parseRecords(const string &text, vector<T> &records, string *error = nullptr)
+{
+    records::Reader reader({&records, &records::typeInfo<vector<T>>(), true});
+    bool ok = json::sax_parse(text, &reader);
+    if (!ok && error != nullptr)
+        *error = reader.getError();
+    return ok;
+}
+
+// Parses one JSON object into a record
+template <typename T>
+bool parseRecord(const char *text, size_t size, T &record, string *error = nullptr)
+{
+    records::Reader reader({&record, &records::typeInfo<T>(), false});
+    bool ok = json::sax_parse(text, text + size, &reader);
+    if (!ok && error != nullptr)
+        *error = reader.getError();
+    return ok;
+}
+
+// Calls visit with the text of every record of a file of records, in file order. The file is read
+// in chunks and a record is handed over once its closing brace is seen, so memory is bounded by the
+// largest record whatever the size of the file. A start past 0 must be inside the array between
+// two records (see endOfRecords). A visitor that also takes a long long is given the offset of the
+// record in the file, and one that returns false stops the scan. Returns false if the file does
+// not exist.
+template <typename Visitor>
+bool scanRecordTexts(const string &path, Visitor visit, long long start = 0)
+{
+    int depth = start > 0 ? 1 : 0;
+    bool inString = false, escaped = false;
+    string pending; // text of the record being read
+    long long recordOffset = 0;
+
+    // Gives the pending record to visit, false to stop
+    auto handOver = [&]() -> bool {
+        if constexpr (is_invocable_v<Visitor &, string &, long long>)
+        {
+            if constexpr (is_same<invoke_result_t<Visitor &, string &, long long>, bool>::value)
+                return visit(pending, recordOffset);
+            else
+                visit(pending, recordOffset);
+        }
+        else if constexpr (is_same<invoke_result_t<Visitor &, string &>, bool>::value)
+            return visit(pending);
+        else
+            visit(pending);
+        return true;
+    };
+
+    return scanFile(path, 1 << 20, [&](const char *data, size_t size, long long offset) {
+        size_t start = depth >= 2 ? 0 : size;
+        for (size_t i = 0; i < size; i++)
+        {
+            char ch = data[i];
+            if (inString)
+            {
+                if (escaped)
+                    escaped = false;
+                else if (ch == '\\')
+                    escaped = true;
+                else if (ch == '"')
+                    inString = false;
+                continue;
+            }
+            if (ch == '"')
+                inString = true;
+            else if (ch == '{' || ch == '[')
+            {
+                if (++depth == 2)
+                {
+                    start = i;
+                    recordOffset = offset + (long long)i;
+                }
+            }
+            else if ((ch == '}' || ch == ']') && --depth == 1)
+            {
+                pending.append(data + start, i + 1 - start);
+                start = size;
+                if (!handOver())
+                    return false;
+                pending.clear();
+            }
+        }
+        if (start < size)
+            pending.append(data + start, size - start);
+        return true;
+    }, start);
+}
+
+// Calls visit with every record of a file of records, parsed one at a time
+template <typename T, typename Visitor>
+bool streamRecords(const string &path, Visitor visit)
+{
+    ScopedLatency latency(OP_FILE_LOAD);
+    TraceSpan span("streamRecords", "storage", path.c_str());
+    return scanRecordTexts(path, [&](const string &text) {
+        T record;
+        string error;
+        if (!parseRecord(text.data(), text.size(), record, &error))
+            throw runtime_error(path + ": " + error);
+        visit(record);
+    });
+}
+
+// Writes records in the same layout as json::dump(indent)
+template <typename T>
+void writeRecords(string &out, const vector<T> &records, int indent)
+{
+    records::writeValue(out, records, indent, 0);
+}
+
+// Loads a file of records, a missing file gives back no records
+template <typename T>
+vector<T> loadRecords(const string &path)
+{
+    ScopedLatency latency(OP_FILE_LOAD);
+    TraceSpan span("loadRecords", "storage", path.c_str());
+    vector<T> records;
+
+    string text;
+    bool found;
+    {
+        TraceSpan read("read", "storage", path.c_str());
+        found = readWholeFile(path, text);
+    }
+    if (found)
+    {
+        TraceSpan parse("parse", "storage", path.c_str());
+        string error;
+        if (!parseRecords(text, records, &error))
+            throw runtime_error(path + ": " + error);
+    }
+    return records;
+}
+
+// Offset just past the last complete record of text that starts a file of records, for a file
+// whose end is not the closing bracket, as an append cut short by a crash leaves it. It is just past
+// the "[" if no record is complete. Throws if the text does not start an array.
+inline long long lastCompleteRecord(const string &path, const string &text)
+{
+    size_t i = text.find_first_not_of(" \t\r\n");
+    if (i == string::npos || text[i] != '[')
+        throw runtime_error(path + ": not a file of records");
+    long long end = (long long)i + 1;
+    int depth = 1;
+    bool inString = false, escaped = false;
+    for (i++; i < text.size() && depth > 0; i++)
+    {
+        char ch = text[i];
+        if (inString)
+        {
+            if (escaped)
+                escaped = false;
+            else if (ch == '\\')
+                escaped = true;
+            else if (ch == '"')
+                inString = false;
+        }
+        else if (ch == '"')
+            inString = true;
+        else if (ch == '{' || ch == '[')
+            depth++;
+        else if (ch == '}' || ch == ']')
+        {
+            depth--;
+            if (depth == 1 && ch == '}')
+                end = (long long)i + 1;
+        }
+    }
+    return end;
+}
+
+// Offset just past the last record of a file of records (just past the "[" if there is none),
+// -1 if the file is missing or empty. Records appended with appendRecords go there, so everything
+// before it never changes. The tail of the file is enough when it ends with the closing bracket
+// on a line of its own after a record; any other end is taken for a torn append, and the whole
+// file is read to find the last complete record, which the next append writes after.
+inline long long endOfRecords(const string &path)
+{
+    IoCounters &io = threadIo();
+    int fd = rawio::openFile(path.c_str(), O_RDONLY);
+    io.syscalls++;
+    if (fd < 0)
+        return -1;
+    long long size = rawio::fileSize(fd);
+    long long from = max(0LL, size - 64);
+    string tail((size_t)max(0LL, size - from), ' ');
+    rawio::seekFile(fd, from);
+    long long n = tail.empty() ? 0 : rawio::readFile(fd, &tail[0], tail.size());
+    io.syscalls += 4;
+    rawio::closeFile(fd);
+    if (size <= 0)
+        return -1;
+
+    if (n == (long long)tail.size())
+    {
+        // "...}\n]\n", or a file of just "[]"
+        size_t bracket = tail.find_last_not_of(" \t\r\n");
+        if (bracket != string::npos && tail[bracket] == ']' && bracket > 0)
+        {
+            size_t last = tail.find_last_not_of(" \t\r\n", bracket - 1);
+            bool closed = tail[bracket - 1] == '\n' && bracket + 1 < tail.size() && tail[bracket + 1] == '\n';
+            if (last != string::npos && tail[last] == '}' && closed)
+                return from + (long long)last + 1;
+            if (from == 0 && bracket == 1 && tail[0] == '[')
+                return 1;
+        }
+    }
+
+    string text;
+    if (!readWholeFile(path, text))
+        throw runtime_error("cannot read " + path);
+    return lastCompleteRecord(path, text);
+}
+
+// Adds records at the end of a file of records without rewriting what is there: the closing
+// bracket is overwritten by the new records and written again after them, in the layout of
+// saveRecords, and whatever a torn append left after the last complete record is cut off. A
+// missing file is created. Throws if the records cannot be written.
+template <typename T>
+void appendRecords(const string &path, const vector<T> &records, int indent)
+{
+    ScopedLatency latency(OP_FILE_SAVE);
+    TraceSpan span("appendRecords", "storage", path.c_str());
+    if (records.empty())
+        return;
+    long long end = endOfRecords(path);
+    bool empty = true;
+    if (end > 0)
+    {
+        string last;
+        readFileRange(path, end - 1, 1, last);
+        empty = last == "[";
+    }
+
+    string text = end >= 0 ? "" : "[";
+    for (auto &record : records)
+    {
+        if (!empty)
+            text += ',';
+        empty = false;
+        records::newline(text, indent, 1);
+        records::writeValue(text, record, indent, 1);
+    }
+    records::newline(text, indent, 0);
+    text += "]\n";
+    if (!writeFileAt(path, max(end, 0LL), text, true))
+        throw runtime_error("cannot write " + path);
+}
+
+// Saves records to disk with the given indentation, throws if they cannot be written
+template <typename T>
+void saveRecords(const string &path, const vector<T> &records, int indent)
+{
+    ScopedLatency latency(OP_FILE_SAVE);
+    TraceSpan span("saveRecords", "storage", path.c_str());
+    string text;
+    {
+        TraceSpan serialize("serialize", "storage", path.c_str());
+        writeRecords(text, records, indent);
+        text += '\n';
+    }
+    TraceSpan write("write", "storage", path.c_str());
+    if (!writeWholeFile(path, text))
+        throw runtime_error("cannot write " + path);
+}
+
+#endif
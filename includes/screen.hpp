@@ -0,0 +1,345 @@
+#ifndef SCREEN_HPP
+#define SCREEN_HPP
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Off-screen copy of the terminal. Everything written to cout lands in the back buffer at a
+// virtual cursor; present() compares it with what the terminal already shows (the front buffer)
+// and sends only the changed cells, as one batched ANSI write.
+class FrameBuffer : public streambuf
+{
+private:
+    // One cell holds the UTF-8 bytes of one glyph packed into an integer.
+    // UNKNOWN never matches a glyph, it marks cells the terminal may show differently.
+    typedef uint32_t Cell;
+    static constexpr Cell BLANK = ' ';
+    static constexpr Cell UNKNOWN = 0;
+
+    vector<vector<Cell>> back;
+    vector<vector<Cell>> front;
+    bool frontValid;
+    int cursorX, cursorY;
+
+    // UTF-8 sequence being assembled from single bytes
+    Cell pending;
+    int pendingLeft, pendingShift;
+
+    // Input typed after the last present is echoed by the terminal, not by us
+    bool inputPending;
+    int inputX, inputY;
+
+    streambuf *terminal;
+    ostream presenter;
+
+    // Bytes written to the terminal by the last present, for diagnostics
+    size_t lastFrameBytes;
+
+    static Cell cellAt(const vector<vector<Cell>> &buffer, int x, int y)
+    {
+        if (y >= (int)buffer.size() || x >= (int)buffer[y].size())
+            return BLANK;
+        return buffer[y][x];
+    }
+
+    static void appendCell(string &out, Cell cell)
+    {
+        for (; cell != 0; cell >>= 8)
+            out += char(cell & 0xFF);
+    }
+
+    static void appendMove(string &out, int x, int y)
+    {
+        out += "\x1b[" + to_string(y + 1) + ";" + to_string(x + 1) + "H";
+    }
+
+    // Rows the terminal window can show, 0 when it cannot be asked
+    static int terminalRows()
+    {
+#ifdef _WIN32
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info))
+            return info.srWindow.Bottom - info.srWindow.Top + 1;
+#else
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+            return size.ws_row;
+#endif
+        return 0;
+    }
+
+    // The terminal echoed the typed text and moved to the next line on Enter. Those cells are
+    // forgotten so that the next present repaints them.
+    void settleInput(bool moveCursor)
+    {
+        if (!inputPending)
+            return;
+        inputPending = false;
+        if (inputY < (int)front.size())
+        {
+            vector<Cell> &row = front[inputY];
+            if ((int)row.size() < inputX + 80)
+                row.resize(inputX + 80, BLANK);
+            fill(row.begin() + inputX, row.end(), UNKNOWN);
+        }
+        if (moveCursor)
+        {
+            cursorX = 0;
+            cursorY = inputY + 1;
+        }
+    }
+
+    void put(Cell cell)
+    {
+        if ((int)back.size() <= cursorY)
+            back.resize(cursorY + 1);
+        vector<Cell> &row = back[cursorY];
+        if ((int)row.size() <= cursorX)
+            row.resize(cursorX + 1, BLANK);
+        row[cursorX++] = cell;
+    }
+
+    void writeTerminal(const string &out)
+    {
+        lastFrameBytes = out.size();
+        terminal->sputn(out.data(), out.size());
+        terminal->pubsync();
+    }
+
+    // Frames taller than the window cannot be addressed, they are painted top to bottom and scroll
+    void presentTall()
+    {
+        string out = "\x1b[?25l\x1b[H\x1b[2J";
+        for (size_t y = 0; y < back.size(); y++)
+        {
+            if (y > 0)
+                out += "\r\n";
+            size_t end = back[y].size();
+            while (end > 0 && back[y][end - 1] == BLANK)
+                end--;
+            for (size_t x = 0; x < end; x++)
+                appendCell(out, back[y][x]);
+        }
+        if (cursorY == (int)back.size() - 1)
+            out += "\r\x1b[" + to_string(cursorX + 1) + "G";
+        out += "\x1b[?25h";
+        writeTerminal(out);
+        frontValid = false;
+    }
+
+    // Only used while the presenter is flushed, see install()
+    class Presenter : public streambuf
+    {
+    private:
+        FrameBuffer &frame;
+
+    protected:
+        int sync() override
+        {
+            frame.present(true);
+            return 0;
+        }
+
+    public:
+        Presenter(FrameBuffer &frame) : frame(frame) {}
+    };
+    Presenter presentOnFlush;
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (ch == traits_type::eof())
+            return traits_type::not_eof(ch);
+        settleInput(true);
+
+        unsigned char byte = (unsigned char)ch;
+        if (byte >= 0x80 && byte < 0xC0 && pendingLeft > 0)
+        {
+            pending |= Cell(byte) << pendingShift;
+            pendingShift += 8;
+            if (--pendingLeft == 0)
+                put(pending);
+            return ch;
+        }
+
+        pendingLeft = 0;
+        if (byte == '\n')
+        {
+            cursorX = 0;
+            cursorY++;
+        }
+        else if (byte == '\r')
+            cursorX = 0;
+        else if (byte >= 0xC0)
+        {
+            pending = byte;
+            pendingShift = 8;
+            pendingLeft = byte >= 0xF0 ? 3 : byte >= 0xE0 ? 2 : 1;
+        }
+        else if (byte >= 0x20)
+            put(byte);
+        return ch;
+    }
+
+    // Flushing cout (endl) does not draw, frames are drawn before input is read
+    int sync() override { return 0; }
+
+public:
+    FrameBuffer()
+        : frontValid(false), cursorX(0), cursorY(0), pending(0), pendingLeft(0), pendingShift(0),
+          inputPending(false), inputX(0), inputY(0), terminal(nullptr), presenter(nullptr), lastFrameBytes(0),
+          presentOnFlush(*this)
+    {
+        presenter.rdbuf(&presentOnFlush);
+    }
+
+    // Redirects cout into the frame and draws it whenever cin is about to read
+    void install()
+    {
+        if (terminal != nullptr)
+            return;
+#ifdef _WIN32
+        // the Windows console understands the ANSI sequences only when asked to
+        HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD mode = 0;
+        if (GetConsoleMode(handle, &mode))
+            SetConsoleMode(handle, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
+        terminal = cout.rdbuf(this);
+        cin.tie(&presenter);
+        atexit([]() { screen().present(false); });
+    }
+
+    static FrameBuffer &screen();
+
+    void moveTo(int x, int y)
+    {
+        settleInput(false);
+        pendingLeft = 0;
+        cursorX = x < 0 ? 0 : x;
+        cursorY = y < 0 ? 0 : y;
+    }
+
+    int getCursorX() const { return cursorX; }
+    int getCursorY() const { return cursorY; }
+
+    // Starts a new frame, the terminal is only touched by the next present
+    void clear()
+    {
+        settleInput(false);
+        for (auto &row : back)
+            fill(row.begin(), row.end(), BLANK);
+        cursorX = cursorY = 0;
+    }
+
+    // Forgets what the terminal shows, the next present repaints the whole frame
+    void invalidate() { frontValid = false; }
+
+    size_t getLastFrameBytes() const { return lastFrameBytes; }
+
+    // Sends the cells that differ from the terminal and parks the cursor where the next input goes
+    void present(bool forInput)
+    {
+        if (terminal == nullptr)
+            return;
+        settleInput(false);
+
+        int rows = terminalRows();
+        if (rows > 0 && (int)back.size() > rows)
+        {
+            presentTall();
+        }
+        else
+        {
+            string out = "\x1b[?25l";
+            if (!frontValid)
+            {
+                out += "\x1b[H\x1b[2J";
+                front.clear();
+                frontValid = true;
+            }
+
+            size_t height = max(back.size(), front.size());
+            for (size_t y = 0; y < height; y++)
+            {
+                size_t width = max(y < back.size() ? back[y].size() : 0, y < front.size() ? front[y].size() : 0);
+                int outX = -1; // terminal column after the last glyph written on this row
+                for (size_t x = 0; x < width; x++)
+                {
+                    Cell want = cellAt(back, x, y);
+                    if (want == cellAt(front, x, y))
+                        continue;
+                    // short gaps are cheaper to rewrite than to jump over
+                    if (outX >= 0 && (int)x > outX && (int)x - outX <= 4)
+                    {
+                        for (int gap = outX; gap < (int)x; gap++)
+                            appendCell(out, cellAt(back, gap, y));
+                    }
+                    else if (outX != (int)x)
+                        appendMove(out, x, y);
+                    appendCell(out, want);
+                    outX = x + 1;
+                }
+            }
+            front = back;
+
+            appendMove(out, cursorX, cursorY);
+            out += "\x1b[?25h";
+            writeTerminal(out);
+        }
+
+        pendingLeft = 0;
+        if (forInput)
+        {
+            inputPending = true;
+            inputX = cursorX;
+            inputY = cursorY;
+        }
+    }
+};
+
+inline FrameBuffer &FrameBuffer::screen()
+{
+    // Never destroyed, so the frame can still be presented from exit()
+    static FrameBuffer *frame = new FrameBuffer();
+    return *frame;
+}
+
+inline FrameBuffer &screen() { return FrameBuffer::screen(); }
+
+// Draws the frame and waits for one key press, the key is not echoed. Enter reads as 13 everywhere.
+inline int readKey()
+{
+    screen().present(false);
+#ifdef _WIN32
+    return _getch();
+#else
+    termios saved, raw;
+    if (tcgetattr(STDIN_FILENO, &saved) != 0)
+        return getchar();
+    raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    int key = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return key == '\n' ? 13 : key;
+#endif
+}
+
+#endif
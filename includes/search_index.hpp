@@ -0,0 +1,380 @@
+#ifndef SEARCH_INDEX_HPP
+#define SEARCH_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cctype>
+
+using namespace std;
+
+// Word search over short texts such as names and addresses, for type-ahead lookups.
+// Texts are split into lower case words. Every distinct word is stored once in a prefix trie whose
+// nodes are packed into one array (first child / next sibling links), and each word keeps the list
+// of entries it occurs in. Fuzzy matches go through a trigram index over the distinct words, so a
+// misspelt query only compares itself with words that share some letters with it.
+// Entries are added and removed one at a time; a removed entry is only marked dead, and its
+// postings are dropped the next time the index is compacted.
+class SearchIndex
+{
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node
+    {
+        uint32_t firstChild = NONE;
+        uint32_t nextSibling = NONE;
+        uint32_t word = NONE; // word ending at this node
+        char label = 0;
+    };
+
+    struct Entry
+    {
+        long long id;
+        uint32_t wordsBegin; // into entryWords
+        uint32_t wordCount;
+        bool alive;
+    };
+
+    vector<Node> nodes{1}; // nodes[0] is the root
+    vector<string> words;
+    vector<vector<uint32_t>> postings; // entries of every word, in insertion order
+    unordered_map<uint32_t, vector<uint32_t>> trigrams;
+
+    vector<Entry> entries;
+    vector<uint32_t> entryWords;
+    unordered_map<long long, uint32_t> entryById;
+    size_t deadEntries = 0;
+
+    static vector<string> split(const string &text)
+    {
+        vector<string> parts;
+        string word;
+        for (unsigned char ch : text)
+        {
+            if (isalnum(ch) || ch >= 0x80)
+                word += (char)tolower(ch);
+            else if (!word.empty())
+            {
+                parts.push_back(word);
+                word.clear();
+            }
+        }
+        if (!word.empty())
+            parts.push_back(word);
+        return parts;
+    }
+
+    // Trigrams of the word padded with a space at both ends, so short words have some too
+    static vector<uint32_t> trigramsOf(const string &word)
+    {
+        string padded = " " + word + " ";
+        vector<uint32_t> grams;
+        for (size_t i = 0; i + 3 <= padded.size(); i++)
+            grams.push_back((uint32_t)(unsigned char)padded[i] << 16 | (uint32_t)(unsigned char)padded[i + 1] << 8 |
+                            (unsigned char)padded[i + 2]);
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+
+    uint32_t child(uint32_t node, char label) const
+    {
+        for (uint32_t c = nodes[node].firstChild; c != NONE; c = nodes[c].nextSibling)
+        {
+            if (nodes[c].label == label)
+                return c;
+        }
+        return NONE;
+    }
+
+    // Trie node of the prefix, NONE if no word starts with it
+    uint32_t findNode(const string &prefix) const
+    {
+        uint32_t node = 0;
+        for (size_t i = 0; i < prefix.size() && node != NONE; i++)
+            node = child(node, prefix[i]);
+        return node;
+    }
+
+    uint32_t internWord(const string &word)
+    {
+        uint32_t node = 0;
+        for (char ch : word)
+        {
+            uint32_t next = child(node, ch);
+            if (next == NONE)
+            {
+                next = (uint32_t)nodes.size();
+                Node created;
+                created.label = ch;
+                created.nextSibling = nodes[node].firstChild;
+                nodes.push_back(created);
+                nodes[node].firstChild = next;
+            }
+            node = next;
+        }
+        if (nodes[node].word == NONE)
+        {
+            nodes[node].word = (uint32_t)words.size();
+            words.push_back(word);
+            postings.emplace_back();
+            for (uint32_t gram : trigramsOf(word))
+                trigrams[gram].push_back(nodes[node].word);
+        }
+        return nodes[node].word;
+    }
+
+    // Every word below the node
+    void collectWords(uint32_t node, vector<uint32_t> &found) const
+    {
+        vector<uint32_t> stack = {node};
+        while (!stack.empty())
+        {
+            uint32_t n = stack.back();
+            stack.pop_back();
+            if (nodes[n].word != NONE)
+                found.push_back(nodes[n].word);
+            for (uint32_t c = nodes[n].firstChild; c != NONE; c = nodes[c].nextSibling)
+                stack.push_back(c);
+        }
+    }
+
+    // Levenshtein distance, giving up once it is certain to be above limit
+    static int editDistance(const string &a, const string &b, int limit)
+    {
+        if (abs((int)a.size() - (int)b.size()) > limit)
+            return limit + 1;
+        vector<int> row(b.size() + 1);
+        for (size_t j = 0; j <= b.size(); j++)
+            row[j] = (int)j;
+        for (size_t i = 1; i <= a.size(); i++)
+        {
+            int diagonal = row[0], best = row[0] = (int)i;
+            for (size_t j = 1; j <= b.size(); j++)
+            {
+                int above = row[j];
+                row[j] = min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1])});
+                diagonal = above;
+                best = min(best, row[j]);
+            }
+            if (best > limit)
+                return limit + 1;
+        }
+        return row[b.size()];
+    }
+
+    // Words within a small edit distance of the query word, closest first
+    vector<uint32_t> similarWords(const string &word) const
+    {
+        int limit = word.size() <= 4 ? 1 : 2;
+        vector<uint32_t> grams = trigramsOf(word);
+
+        // a word within the limit shares at least this many trigrams with the query
+        int needed = max(1, (int)grams.size() - 3 * limit);
+        unordered_map<uint32_t, int> shared;
+        for (uint32_t gram : grams)
+        {
+            auto it = trigrams.find(gram);
+            if (it != trigrams.end())
+                for (uint32_t w : it->second)
+                    shared[w]++;
+        }
+
+        vector<pair<int, uint32_t>> close;
+        for (auto &candidate : shared)
+        {
+            if (candidate.second < needed)
+                continue;
+            int distance = editDistance(word, words[candidate.first], limit);
+            if (distance <= limit)
+                close.push_back({distance, candidate.first});
+        }
+        sort(close.begin(), close.end());
+        vector<uint32_t> found;
+        for (auto &c : close)
+            found.push_back(c.second);
+        return found;
+    }
+
+    bool entryHasWord(const Entry &entry, const vector<uint32_t> &sortedWords) const
+    {
+        for (uint32_t k = 0; k < entry.wordCount; k++)
+        {
+            if (binary_search(sortedWords.begin(), sortedWords.end(), entryWords[entry.wordsBegin + k]))
+                return true;
+        }
+        return false;
+    }
+
+    // Entries that contain a word of every set. The smallest set drives the search, its words are
+    // tried in the order given, and the search stops at limit results.
+    vector<long long> match(const vector<vector<uint32_t>> &wordSets, size_t limit) const
+    {
+        vector<long long> results;
+        if (wordSets.empty())
+            return results;
+
+        size_t driver = 0;
+        vector<size_t> sizes(wordSets.size(), 0);
+        for (size_t i = 0; i < wordSets.size(); i++)
+        {
+            for (uint32_t w : wordSets[i])
+                sizes[i] += postings[w].size();
+            if (sizes[i] < sizes[driver])
+                driver = i;
+        }
+
+        vector<vector<uint32_t>> sortedSets(wordSets.size());
+        for (size_t i = 0; i < wordSets.size(); i++)
+        {
+            sortedSets[i] = wordSets[i];
+            sort(sortedSets[i].begin(), sortedSets[i].end());
+        }
+
+        vector<uint32_t> seen;
+        for (uint32_t w : wordSets[driver])
+        {
+            for (uint32_t e : postings[w])
+            {
+                const Entry &entry = entries[e];
+                if (!entry.alive || find(seen.begin(), seen.end(), e) != seen.end())
+                    continue;
+                bool all = true;
+                for (size_t i = 0; i < sortedSets.size() && all; i++)
+                    all = i == driver || entryHasWord(entry, sortedSets[i]);
+                if (!all)
+                    continue;
+                seen.push_back(e);
+                results.push_back(entry.id);
+                if (results.size() >= limit)
+                    return results;
+            }
+        }
+        return results;
+    }
+
+    // Rebuilds the postings without the dead entries
+    void compact()
+    {
+        vector<uint32_t> renumber(entries.size(), NONE);
+        vector<Entry> liveEntries;
+        vector<uint32_t> liveWords;
+        for (uint32_t e = 0; e < entries.size(); e++)
+        {
+            if (!entries[e].alive)
+                continue;
+            renumber[e] = (uint32_t)liveEntries.size();
+            Entry entry = entries[e];
+            entry.wordsBegin = (uint32_t)liveWords.size();
+            liveWords.insert(liveWords.end(), entryWords.begin() + entries[e].wordsBegin,
+                             entryWords.begin() + entries[e].wordsBegin + entries[e].wordCount);
+            liveEntries.push_back(entry);
+        }
+        for (auto &list : postings)
+        {
+            size_t kept = 0;
+            for (uint32_t e : list)
+                if (renumber[e] != NONE)
+                    list[kept++] = renumber[e];
+            list.resize(kept);
+        }
+        entries.swap(liveEntries);
+        entryWords.swap(liveWords);
+        for (auto &item : entryById)
+            item.second = renumber[item.second];
+        deadEntries = 0;
+    }
+
+public:
+    size_t size() const { return entryById.size(); }
+
+    // Indexes the words of the texts under the id, replacing what was indexed for it before
+    void add(long long id, const vector<string> &texts)
+    {
+        remove(id);
+        Entry entry = {id, (uint32_t)entryWords.size(), 0, true};
+        uint32_t index = (uint32_t)entries.size();
+        for (auto &text : texts)
+        {
+            for (auto &word : split(text))
+            {
+                uint32_t w = internWord(word);
+                bool repeated = false;
+                for (uint32_t k = entry.wordsBegin; k < entryWords.size() && !repeated; k++)
+                    repeated = entryWords[k] == w;
+                if (repeated)
+                    continue;
+                entryWords.push_back(w);
+                entry.wordCount++;
+                postings[w].push_back(index);
+            }
+        }
+        entries.push_back(entry);
+        entryById[id] = index;
+    }
+
+    void remove(long long id)
+    {
+        auto it = entryById.find(id);
+        if (it == entryById.end())
+            return;
+        entries[it->second].alive = false;
+        entryById.erase(it);
+        if (++deadEntries > 1024 && deadEntries > entries.size() / 2)
+            compact();
+    }
+
+    // Entries with a word starting with each word of the query: "sit sha" finds "Sita Sharma".
+    // Words that match the query word exactly come first.
+    vector<long long> prefixSearch(const string &query, size_t limit) const
+    {
+        vector<vector<uint32_t>> wordSets;
+        for (auto &part : split(query))
+        {
+            uint32_t node = findNode(part);
+            if (node == NONE)
+                return {};
+            vector<uint32_t> found;
+            collectWords(node, found);
+            stable_sort(found.begin(), found.end(), [&](uint32_t a, uint32_t b) { return words[a].size() < words[b].size(); });
+            wordSets.push_back(found);
+        }
+        return match(wordSets, limit);
+    }
+
+    // Entries with a word close to each word of the query: "sarma" finds "Sharma"
+    vector<long long> fuzzySearch(const string &query, size_t limit) const
+    {
+        vector<vector<uint32_t>> wordSets;
+        for (auto &part : split(query))
+        {
+            vector<uint32_t> found = similarWords(part);
+            if (found.empty())
+                return {};
+            wordSets.push_back(found);
+        }
+        return match(wordSets, limit);
+    }
+
+    // Prefix matches, topped up with fuzzy matches when there are fewer than limit
+    vector<long long> search(const string &query, size_t limit) const
+    {
+        vector<long long> results = prefixSearch(query, limit);
+        if (results.size() < limit)
+        {
+            for (long long id : fuzzySearch(query, limit))
+            {
+                if (results.size() >= limit)
+                    break;
+                if (find(results.begin(), results.end(), id) == results.end())
+                    results.push_back(id);
+            }
+        }
+        return results;
+    }
+};
+
+#endif
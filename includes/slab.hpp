@@ -0,0 +1,232 @@
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+// Records stored contiguously in one growing array of slots. A removed slot goes on a free list
+// and is reused by the next insert, so inserting and removing never allocate per record.
+// Records are found by getId() through a hash index, and a Handle names one slot for as long as
+// the record in it lives; a handle to a removed record is recognised as stale.
+// Iteration visits the records in insertion order, which is the order they are saved in. The
+// order is kept as links between slots, so it walks the array front to back until slots get reused.
+template <typename T>
+class Slab
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Handle
+    {
+        uint32_t slot = NONE;
+        uint32_t generation = 0;
+
+        bool isValid() const { return slot != NONE; }
+    };
+
+private:
+    vector<T> items;
+    vector<uint32_t> generations; // odd while the slot holds a record
+    vector<uint32_t> next, previous;
+    vector<uint32_t> freeSlots;
+    uint32_t first = NONE, last = NONE;
+    size_t count = 0;
+
+    // Only the first record with an id is indexed; later ones with the same id are counted
+    // so that removing the first can hand the id over to them
+    unordered_map<long long, uint32_t> byId;
+    size_t duplicates = 0;
+
+    bool isLive(uint32_t slot) const { return slot < generations.size() && (generations[slot] & 1) != 0; }
+
+    void indexAfterRemove(long long id)
+    {
+        if (duplicates == 0)
+            return;
+        for (uint32_t slot = first; slot != NONE; slot = next[slot])
+        {
+            if (items[slot].getId() == id)
+            {
+                byId.emplace(id, slot);
+                duplicates--;
+                return;
+            }
+        }
+    }
+
+public:
+    template <bool IsConst>
+    class Iterator
+    {
+    private:
+        typedef typename conditional<IsConst, const Slab, Slab>::type Owner;
+        Owner *slab;
+        uint32_t slot;
+
+    public:
+        Iterator(Owner *slab, uint32_t slot) : slab(slab), slot(slot) {}
+
+        typename conditional<IsConst, const T &, T &>::type operator*() const { return slab->items[slot]; }
+        typename conditional<IsConst, const T *, T *>::type operator->() const { return &slab->items[slot]; }
+        Iterator &operator++()
+        {
+            slot = slab->next[slot];
+            return *this;
+        }
+        bool operator!=(const Iterator &other) const { return slot != other.slot; }
+        bool operator==(const Iterator &other) const { return slot == other.slot; }
+        Handle handle() const { return {slot, slab->generations[slot]}; }
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    iterator begin() { return iterator(this, first); }
+    iterator end() { return iterator(this, NONE); }
+    const_iterator begin() const { return const_iterator(this, first); }
+    const_iterator end() const { return const_iterator(this, NONE); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void reserve(size_t n)
+    {
+        items.reserve(n);
+        generations.reserve(n);
+        next.reserve(n);
+        previous.reserve(n);
+        byId.reserve(n);
+    }
+
+    void clear()
+    {
+        items.clear();
+        generations.clear();
+        next.clear();
+        previous.clear();
+        freeSlots.clear();
+        byId.clear();
+        first = last = NONE;
+        count = duplicates = 0;
+    }
+
+    // Adds the record at the end of the order, O(1)
+    Handle insert(T record)
+    {
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            items[slot] = move(record);
+            generations[slot]++;
+        }
+        else
+        {
+            slot = (uint32_t)items.size();
+            items.push_back(move(record));
+            generations.push_back(1);
+            next.push_back(NONE);
+            previous.push_back(NONE);
+        }
+
+        next[slot] = NONE;
+        previous[slot] = last;
+        if (last != NONE)
+            next[last] = slot;
+        else
+            first = slot;
+        last = slot;
+        count++;
+
+        if (!byId.emplace(items[slot].getId(), slot).second)
+            duplicates++;
+        return {slot, generations[slot]};
+    }
+
+    // Removes the record the handle names, false if it was removed already
+    bool remove(Handle handle)
+    {
+        if (!isLive(handle.slot) || generations[handle.slot] != handle.generation)
+            return false;
+        uint32_t slot = handle.slot;
+        long long id = items[slot].getId();
+
+        if (previous[slot] != NONE)
+            next[previous[slot]] = next[slot];
+        else
+            first = next[slot];
+        if (next[slot] != NONE)
+            previous[next[slot]] = previous[slot];
+        else
+            last = previous[slot];
+
+        auto indexed = byId.find(id);
+        bool wasIndexed = indexed != byId.end() && indexed->second == slot;
+        if (wasIndexed)
+            byId.erase(indexed);
+        else
+            duplicates--;
+
+        items[slot] = T(); // drop what the record owns
+        generations[slot]++;
+        freeSlots.push_back(slot);
+        count--;
+
+        if (wasIndexed)
+            indexAfterRemove(id);
+        return true;
+    }
+
+    // Removes the record with the id, O(1)
+    bool remove(long long id) { return remove(handleOf(id)); }
+
+    Handle handleOf(long long id) const
+    {
+        auto it = byId.find(id);
+        if (it == byId.end())
+            return Handle();
+        return {it->second, generations[it->second]};
+    }
+
+    // The record with the id, nullptr if there is none
+    T *find(long long id)
+    {
+        auto it = byId.find(id);
+        return it != byId.end() ? &items[it->second] : nullptr;
+    }
+
+    const T *find(long long id) const
+    {
+        auto it = byId.find(id);
+        return it != byId.end() ? &items[it->second] : nullptr;
+    }
+
+    // The record the handle names, nullptr once it has been removed
+    T *get(Handle handle)
+    {
+        return isLive(handle.slot) && generations[handle.slot] == handle.generation ? &items[handle.slot] : nullptr;
+    }
+
+    const T *get(Handle handle) const
+    {
+        return isLive(handle.slot) && generations[handle.slot] == handle.generation ? &items[handle.slot] : nullptr;
+    }
+
+    // Copies the records out in order, for saving
+    vector<T> toVector() const
+    {
+        vector<T> records;
+        records.reserve(count);
+        for (const T &record : *this)
+            records.push_back(record);
+        return records;
+    }
+};
+
+#endif
@@ -0,0 +1,353 @@
+#ifndef STATEMENTS_HPP
+#define STATEMENTS_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+
+#include "records.hpp"
+#include "parallel_scan.hpp"
+#include "symbols.hpp"
+#include "time_index.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// Throughput of one statement run
+struct StatementReport
+{
+    long long statements;
+    long long bytes;
+    double seconds;
+};
+
+// Writes the statement of every client for one period: opening and closing balance, deposits,
+// settlements, purchases, sales, the trades of the period and the holdings with their unrealized
+// P&L at the current market prices.
+// Each ledger file is read once, in parallel batches (see parallelRecords), and its records are
+// partitioned by client. The statements are then rendered in parallel, a block of clients per
+// thread, and written in client id order.
+// The closing balance is the current balance less everything that moved it after the period, and
+// the opening balance is the closing balance less what moved it during the period, so the job is
+// meant to run at month end or later. Holdings are as they are when the job runs.
+class StatementJob
+{
+private:
+    static constexpr size_t CLIENTS_PER_BLOCK = 512;
+
+    // Everything the statement of one client needs
+    struct Account
+    {
+        long long id = 0;
+        string name;
+        string address;
+        Money balance; // now
+        vector<Holding> holdings;
+        vector<Transaction> trades;      // of the period, oldest first
+        vector<CashMovement> movements;  // of the period, oldest first
+        Money laterFlow;                 // what moved the balance after the period
+    };
+
+    string dir;
+    int64_t from, to; // the period, from <= time < to
+    unsigned threads;
+    SymbolTable symbols;
+    unordered_map<long long, Money> prices; // market price by stock id
+
+    vector<Account> accounts;
+    unordered_map<long long, size_t> accountById;
+
+    Account &account(long long id)
+    {
+        auto found = accountById.find(id);
+        if (found != accountById.end())
+            return accounts[found->second];
+        accountById.emplace(id, accounts.size());
+        accounts.emplace_back();
+        accounts.back().id = id;
+        return accounts.back();
+    }
+
+    Account *findAccount(long long id)
+    {
+        auto found = accountById.find(id);
+        return found != accountById.end() ? &accounts[found->second] : nullptr;
+    }
+
+    string stockName(const optional<string> &name, uint32_t symbol) const
+    {
+        if (name.has_value())
+            return *name;
+        return symbol < symbols.size() ? symbols.name(symbol) : "";
+    }
+
+    static int64_t timeOf(const Transaction &transaction)
+    {
+        return transaction.time.has_value() ? parseCtime(*transaction.time) : transaction.timestamp;
+    }
+
+    // Money the trade moved into the balance
+    static Money cashOf(const Transaction &transaction)
+    {
+        return transaction.type == "sell" ? transaction.totalCost : -transaction.totalCost;
+    }
+
+    void loadClients()
+    {
+        parallelRecords<Client>(
+            dir + "/added_clients.json", threads, [](vector<Client> &clients) { return move(clients); },
+            [&](vector<Client> &clients) {
+                for (auto &client : clients)
+                {
+                    Account &entry = account(client.getId());
+                    entry.name = client.getName();
+                    entry.address = client.getAddress();
+                }
+            });
+    }
+
+    // Clients that were removed but still have a portfolio get a statement too
+    void loadPortfolios()
+    {
+        parallelRecords<Portfolio>(
+            dir + "/portfolio.json", threads, [](vector<Portfolio> &portfolios) { return move(portfolios); },
+            [&](vector<Portfolio> &portfolios) {
+                for (auto &portfolio : portfolios)
+                {
+                    Account &entry = account(portfolio.id);
+                    if (entry.name.empty())
+                        entry.name = portfolio.name;
+                    entry.balance = portfolio.balance;
+                    entry.holdings = move(portfolio.stocks);
+                }
+            });
+    }
+
+    // The threads keep the trades of the period and sum up the later ones, so only those reach
+    // the calling thread
+    void loadTrades()
+    {
+        struct Partition
+        {
+            vector<Transaction> inPeriod;
+            vector<pair<long long, Money>> later;
+        };
+        parallelRecords<TransactionHistory>(
+            dir + "/transactions.json", threads,
+            [&](vector<TransactionHistory> &histories) {
+                Partition partition;
+                for (auto &history : histories)
+                {
+                    for (auto &transaction : history.transactions)
+                    {
+                        int64_t time = timeOf(transaction);
+                        if (time >= to)
+                            partition.later.push_back({transaction.id, cashOf(transaction)});
+                        else if (time >= from)
+                        {
+                            transaction.timestamp = time;
+                            transaction.time.reset();
+                            partition.inPeriod.push_back(move(transaction));
+                        }
+                    }
+                }
+                return partition;
+            },
+            [&](Partition &partition) {
+                for (auto &transaction : partition.inPeriod)
+                {
+                    Account *entry = findAccount(transaction.id);
+                    if (entry != nullptr)
+                        entry->trades.push_back(move(transaction));
+                }
+                for (auto &flow : partition.later)
+                {
+                    Account *entry = findAccount(flow.first);
+                    if (entry != nullptr)
+                        entry->laterFlow += flow.second;
+                }
+            });
+    }
+
+    void loadCashMovements()
+    {
+        streamRecords<CashMovement>(dir + "/cash_movements.json", [&](CashMovement &movement) {
+            Account *entry = findAccount(movement.clientId);
+            if (entry == nullptr || movement.time < from)
+                return;
+            if (movement.time >= to)
+                entry->laterFlow += movement.amount;
+            else
+                entry->movements.push_back(movement);
+        });
+    }
+
+    // Appends one printf formatted line
+    static void line(string &out, const char *format, ...)
+    {
+        char text[256];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        out += text;
+        out += '\n';
+    }
+
+    void render(const Account &entry, string &out) const
+    {
+        Money deposits, settlements, purchases, sales;
+        for (auto &movement : entry.movements)
+            (movement.type == "deposit" ? deposits : settlements) += movement.amount;
+        for (auto &trade : entry.trades)
+            (trade.type == "sell" ? sales : purchases) += trade.totalCost;
+        Money closing = entry.balance - entry.laterFlow;
+        Money opening = closing - deposits - settlements + purchases - sales;
+
+        string rule(80, '-'), doubleRule(80, '=');
+        out += doubleRule + '\n';
+        line(out, " %-40s%39s", "NEPAL STOCK ANALYZER", "CLIENT STATEMENT");
+        line(out, " Period  : %s to %s", formatDate(from).c_str(), formatDate(to - 1).c_str());
+        line(out, " Client  : %s (ID %lld)", entry.name.c_str(), entry.id);
+        line(out, " Address : %s", entry.address.c_str());
+        out += rule + '\n';
+        line(out, " %-30s%48s", "Opening balance", opening.toString().c_str());
+        line(out, " %-30s%48s", "Deposits", deposits.toString().c_str());
+        line(out, " %-30s%48s", "Settlements", settlements.toString().c_str());
+        line(out, " %-30s%48s", "Purchases", (-purchases).toString().c_str());
+        line(out, " %-30s%48s", "Sales", sales.toString().c_str());
+        line(out, " %-30s%48s", "Closing balance", closing.toString().c_str());
+
+        out += rule + '\n';
+        line(out, " %-12s%-10s%-14s%10s%15s%17s", "Date", "Type", "Stock", "Shares", "Price", "Total");
+        if (entry.trades.empty())
+            line(out, " No trades in this period");
+        for (auto &trade : entry.trades)
+        {
+            line(out, " %-12s%-10s%-14.13s%10lld%15s%17s", formatDate(trade.timestamp).c_str(), trade.type.c_str(),
+                 stockName(trade.stockName, trade.symbol).c_str(), trade.numberOfShares, trade.price.toString().c_str(),
+                 trade.totalCost.toString().c_str());
+        }
+
+        out += rule + '\n';
+        line(out, " %-14s%10s%13s%13s%14s%15s", "Holding", "Shares", "Cost rate", "Market", "Value", "Unrealized P&L");
+        Money totalValue, totalProfit;
+        for (auto &holding : entry.holdings)
+        {
+            auto price = prices.find(holding.stockId);
+            Money market = price != prices.end() ? price->second : Money();
+            Money value = market * holding.numberOfShares;
+            Money profit = value - holding.purchasedRate * holding.numberOfShares;
+            totalValue += value;
+            totalProfit += profit;
+            line(out, " %-14.13s%10lld%13s%13s%14s%15s", stockName(holding.stockName, holding.symbol).c_str(),
+                 holding.numberOfShares, holding.purchasedRate.toString().c_str(), market.toString().c_str(),
+                 value.toString().c_str(), profit.toString().c_str());
+        }
+        line(out, " %-50s%14s%15s", "Total", totalValue.toString().c_str(), totalProfit.toString().c_str());
+        out += doubleRule + "\n\n";
+    }
+
+public:
+    // The statements cover from <= time < to, in epoch seconds
+    StatementJob(const string &dir, int64_t from, int64_t to, unsigned threads = thread::hardware_concurrency())
+        : dir(dir), from(from), to(to), threads(max(threads, 1u))
+    {
+    }
+
+    StatementReport run(const string &outPath)
+    {
+        auto start = chrono::steady_clock::now();
+        StatementReport report = {0, 0, 0};
+
+        symbols.load(dir + "/symbols.json");
+        for (auto &stock : loadRecords<StockList>(dir + "/added_stocks.json"))
+            prices.emplace(stock.getId(), stock.getMarketPrice());
+        loadClients();
+        loadPortfolios();
+        loadTrades();
+        loadCashMovements();
+        sort(accounts.begin(), accounts.end(), [](const Account &a, const Account &b) { return a.id < b.id; });
+        accountById.clear();
+
+        FILE *file = fopen(outPath.c_str(), "wb");
+        if (file == nullptr)
+            throw runtime_error("cannot open " + outPath + " for writing");
+
+        // Blocks of clients are rendered one per thread and written in order
+        size_t blocks = (accounts.size() + CLIENTS_PER_BLOCK - 1) / CLIENTS_PER_BLOCK;
+        vector<string> rendered(threads);
+        for (size_t first = 0; first < blocks; first += threads)
+        {
+            size_t count = min<size_t>(threads, blocks - first);
+            auto renderBlock = [&](size_t k) {
+                rendered[k].clear();
+                size_t begin = (first + k) * CLIENTS_PER_BLOCK;
+                size_t end = min(accounts.size(), begin + CLIENTS_PER_BLOCK);
+                for (size_t a = begin; a < end; a++)
+                {
+                    sort(accounts[a].trades.begin(), accounts[a].trades.end(),
+                         [](const Transaction &x, const Transaction &y) { return x.timestamp < y.timestamp; });
+                    render(accounts[a], rendered[k]);
+                }
+            };
+
+            if (count == 1)
+                renderBlock(0);
+            else
+            {
+                vector<exception_ptr> errors(count);
+                vector<thread> workers;
+                for (size_t k = 0; k < count; k++)
+                {
+                    workers.emplace_back([&, k]() {
+                        try
+                        {
+                            renderBlock(k);
+                        }
+                        catch (...)
+                        {
+                            errors[k] = current_exception();
+                        }
+                    });
+                }
+                for (auto &worker : workers)
+                    worker.join();
+                for (auto &error : errors)
+                {
+                    if (error)
+                    {
+                        fclose(file);
+                        rethrow_exception(error);
+                    }
+                }
+            }
+
+            for (size_t k = 0; k < count; k++)
+            {
+                if (fwrite(rendered[k].data(), 1, rendered[k].size(), file) != rendered[k].size())
+                {
+                    fclose(file);
+                    throw runtime_error("cannot write " + outPath);
+                }
+                report.bytes += rendered[k].size();
+            }
+        }
+        if (fclose(file) != 0)
+            throw runtime_error("cannot write " + outPath);
+
+        report.statements = accounts.size();
+        report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return report;
+    }
+};
+
+#endif
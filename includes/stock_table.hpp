@@ -0,0 +1,181 @@
+#ifndef STOCK_TABLE_HPP
+#define STOCK_TABLE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "records.hpp"
+#include "money.hpp"
+
+using namespace std;
+
+// Price filter of a stock screen. Prices are in paisa, the change is measured from the
+// previous close in basis points (1/100 of a percent).
+struct StockScreen
+{
+    int64_t minPrice = 0;
+    int64_t maxPrice = INT64_MAX;
+    int64_t minChangeBasisPoints = -10000; // a fall of 100%, so every stock passes
+    int64_t minVolume = 0;
+};
+
+// Price weighted index of every listed stock: the sum of the prices now and at the previous close
+struct MarketIndex
+{
+    Money value;
+    Money previousValue;
+    long long stocks;
+};
+
+// The listed stocks as columns. Every field the price loops read (ids, prices, previous closes,
+// volumes, symbol ids) is its own contiguous array, so ticks, screens, the index and valuation are
+// straight loops over integers. Names are only needed for display and live in a side table.
+// Rows keep the order of added_stocks.json; the table is small, so removing a row just closes the gap.
+class StockTable
+{
+public:
+    static constexpr size_t NO_ROW = SIZE_MAX;
+
+private:
+    vector<long long> ids;
+    vector<int64_t> prices;         // paisa
+    vector<int64_t> previousCloses; // paisa
+    vector<int64_t> volumes;        // shares traded since the table was loaded
+    vector<uint32_t> symbols;
+    vector<string> names;
+
+    unordered_map<long long, size_t> rowById; // first row with the id
+
+    void reindex()
+    {
+        rowById.clear();
+        for (size_t row = 0; row < ids.size(); row++)
+            rowById.emplace(ids[row], row);
+    }
+
+public:
+    size_t size() const { return ids.size(); }
+
+    // Row of the stock with the id, NO_ROW if it is not listed
+    size_t find(long long id) const
+    {
+        auto it = rowById.find(id);
+        return it != rowById.end() ? it->second : NO_ROW;
+    }
+
+    long long id(size_t row) const { return ids[row]; }
+    Money price(size_t row) const { return Money::fromPaisa(prices[row]); }
+    Money previousClose(size_t row) const { return Money::fromPaisa(previousCloses[row]); }
+    long long volume(size_t row) const { return volumes[row]; }
+    uint32_t symbol(size_t row) const { return symbols[row]; }
+    const string &name(size_t row) const { return names[row]; }
+
+    const int64_t *priceColumn() const { return prices.data(); }
+    const int64_t *previousCloseColumn() const { return previousCloses.data(); }
+
+    void append(const StockList &stock, uint32_t symbol)
+    {
+        ids.push_back(stock.getId());
+        prices.push_back(stock.getMarketPrice().getPaisa());
+        previousCloses.push_back(stock.getPreviousClose().getPaisa());
+        volumes.push_back(0);
+        symbols.push_back(symbol);
+        names.push_back(stock.getStockName());
+        rowById.emplace(stock.getId(), ids.size() - 1);
+    }
+
+    void remove(size_t row)
+    {
+        ids.erase(ids.begin() + row);
+        prices.erase(prices.begin() + row);
+        previousCloses.erase(previousCloses.begin() + row);
+        volumes.erase(volumes.begin() + row);
+        symbols.erase(symbols.begin() + row);
+        names.erase(names.begin() + row);
+        reindex();
+    }
+
+    // The row as a record, as it is saved
+    StockList record(size_t row) const
+    {
+        StockList stock(ids[row], names[row], price(row));
+        if (previousCloses[row] != prices[row])
+            stock.setPreviousClose(previousClose(row));
+        return stock;
+    }
+
+    vector<StockList> toRecords() const
+    {
+        vector<StockList> records;
+        records.reserve(size());
+        for (size_t row = 0; row < size(); row++)
+            records.push_back(record(row));
+        return records;
+    }
+
+    // Closes the current prices and moves every price by its delta, in paisa. Nothing changes
+    // if a price would overflow.
+    bool tick(const int64_t *deltas)
+    {
+        vector<int64_t> next = prices;
+        if (!moneykernels::settle(next.data(), deltas, next.size()))
+            return false;
+        previousCloses.swap(prices);
+        prices.swap(next);
+        return true;
+    }
+
+    // Sets the price and the previous close of the row, as a price history says they were
+    void setPrice(size_t row, Money price, Money previousClose)
+    {
+        prices[row] = price.getPaisa();
+        previousCloses[row] = previousClose.getPaisa();
+    }
+
+    void recordTrade(size_t row, long long shares) { volumes[row] += shares; }
+
+    // Rows that pass the screen, in table order. The loop has no branches: every row is written
+    // to the output and the count only advances for the rows that pass.
+    vector<size_t> screen(const StockScreen &criteria) const
+    {
+        size_t n = size();
+        vector<size_t> rows(n);
+        size_t count = 0;
+        for (size_t row = 0; row < n; row++)
+        {
+            int64_t price = prices[row], close = previousCloses[row];
+            bool pass = (price >= criteria.minPrice) & (price <= criteria.maxPrice) & (volumes[row] >= criteria.minVolume) &
+                        ((price - close) * 10000 >= criteria.minChangeBasisPoints * close);
+            rows[count] = row;
+            count += pass;
+        }
+        rows.resize(count);
+        return rows;
+    }
+
+    MarketIndex index() const
+    {
+        MarketIndex result;
+        result.value = Money::fromPaisa(moneykernels::sum(prices.data(), prices.size()));
+        result.previousValue = Money::fromPaisa(moneykernels::sum(previousCloses.data(), previousCloses.size()));
+        result.stocks = size();
+        return result;
+    }
+
+    // Current price by symbol id, 0 for symbols that are not listed
+    vector<int64_t> pricesBySymbol(size_t symbolCount) const
+    {
+        vector<int64_t> bySymbol(symbolCount, 0);
+        for (size_t row = 0; row < size(); row++)
+        {
+            if (symbols[row] < symbolCount)
+                bySymbol[symbols[row]] = prices[row];
+        }
+        return bySymbol;
+    }
+};
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include <string>
+#include <atomic>
+#include <vector>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "json.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// When set, every save is flushed to the disk with fsync before it returns
+inline atomic<bool> durableWrites(false);
+
+// Thin wrappers over the raw file calls so that every call and byte is counted
+namespace rawio
+{
+#ifdef _WIN32
+    inline int openFile(const char *path, int flags) { return _open(path, flags | O_BINARY, _S_IREAD | _S_IWRITE); }
+    inline long long readFile(int fd, char *buffer, size_t size) { return _read(fd, buffer, (unsigned)size); }
+    inline long long writeFile(int fd, const char *buffer, size_t size) { return _write(fd, buffer, (unsigned)size); }
+    inline int syncFile(int fd) { return _commit(fd); }
+    inline int closeFile(int fd) { return _close(fd); }
+    inline long long seekFile(int fd, long long offset) { return _lseeki64(fd, offset, SEEK_SET); }
+    inline int truncateFile(int fd, long long size) { return _chsize_s(fd, size) == 0 ? 0 : -1; }
+    inline bool replaceFile(const char *from, const char *to) { return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0; }
+    inline int removeFile(const char *path) { return _unlink(path); }
+    inline long long fileSize(int fd)
+    {
+        struct _stat64 st;
+        return _fstat64(fd, &st) == 0 ? st.st_size : -1;
+    }
+#else
+    inline int openFile(const char *path, int flags) { return open(path, flags | O_BINARY, 0644); }
+    inline long long readFile(int fd, char *buffer, size_t size) { return read(fd, buffer, size); }
+    inline long long writeFile(int fd, const char *buffer, size_t size) { return write(fd, buffer, size); }
+    inline int syncFile(int fd) { return fsync(fd); }
+    inline int closeFile(int fd) { return close(fd); }
+    inline long long seekFile(int fd, long long offset) { return lseek(fd, offset, SEEK_SET); }
+    inline int truncateFile(int fd, long long size) { return ftruncate(fd, size); }
+    inline bool replaceFile(const char *from, const char *to) { return rename(from, to) == 0; }
+    inline int removeFile(const char *path) { return unlink(path); }
+    inline long long fileSize(int fd)
+    {
+        struct stat st;
+        return fstat(fd, &st) == 0 ? st.st_size : -1;
+    }
+#endif
+}
+
+// Reads the whole file into text, returns false if it cannot be opened
+inline bool readWholeFile(const string &path, string &text)
+{
+    IoCounters &io = threadIo();
+    int fd = rawio::openFile(path.c_str(), O_RDONLY);
+    io.syscalls++;
+    if (fd < 0)
+        return false;
+
+    long long size = rawio::fileSize(fd);
+    io.syscalls++;
+    text.resize(size > 0 ? size : 0);
+
+    size_t done = 0;
+    while (done < text.size())
+    {
+        long long n = rawio::readFile(fd, &text[done], text.size() - done);
+        io.syscalls++;
+        if (n <= 0)
+            break;
+        done += n;
+        io.bytesRead += n;
+    }
+    text.resize(done);
+
+    rawio::closeFile(fd);
+    io.syscalls++;
+    return true;
+}
+
+// Reads size bytes starting at offset, returns false if the file cannot be opened
+inline bool readFileRange(const string &path, long long offset, size_t size, string &text)
+{
+    IoCounters &io = threadIo();
+    int fd = rawio::openFile(path.c_str(), O_RDONLY);
+    io.syscalls++;
+    if (fd < 0)
+        return false;
+
+    rawio::seekFile(fd, offset);
+    io.syscalls++;
+    text.resize(size);
+    size_t done = 0;
+    while (done < size)
+    {
+        long long n = rawio::readFile(fd, &text[done], size - done);
+        io.syscalls++;
+        if (n <= 0)
+            break;
+        done += n;
+        io.bytesRead += n;
+    }
+    text.resize(done);
+
+    rawio::closeFile(fd);
+    io.syscalls++;
+    return true;
+}
+
+// Hands the file to visit one chunk at a time so that large files are never held in memory,
+// starting at byte start. A visitor that returns false stops the scan.
+template <typename Visitor>
+bool scanFile(const string &path, size_t chunkSize, Visitor visit, long long start = 0)
+{
+    IoCounters &io = threadIo();
+    int fd = rawio::openFile(path.c_str(), O_RDONLY);
+    io.syscalls++;
+    if (fd < 0)
+        return false;
+    if (start > 0)
+    {
+        rawio::seekFile(fd, start);
+        io.syscalls++;
+    }
+
+    vector<char> chunk(chunkSize);
+    long long offset = start;
+    while (true)
+    {
+        long long n = rawio::readFile(fd, chunk.data(), chunk.size());
+        io.syscalls++;
+        if (n <= 0)
+            break;
+        io.bytesRead += n;
+        if constexpr (is_same<decltype(visit(chunk.data(), (size_t)n, offset)), bool>::value)
+        {
+            if (!visit(chunk.data(), (size_t)n, offset))
+                break;
+        }
+        else
+            visit(chunk.data(), (size_t)n, offset);
+        offset += n;
+    }
+
+    rawio::closeFile(fd);
+    io.syscalls++;
+    return true;
+}
+
+// A whole file mapped read-only into memory, so that several threads can parse parts of it
+// without copying. A file that cannot be mapped (an empty one, for instance) is read instead.
+class MappedFile
+{
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    string copy;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // Returns false if the file cannot be opened
+    bool open(const string &path)
+    {
+        close();
+        IoCounters &io = threadIo();
+        int fd = rawio::openFile(path.c_str(), O_RDONLY);
+        io.syscalls++;
+        if (fd < 0)
+            return false;
+        long long size = rawio::fileSize(fd);
+        io.syscalls++;
+
+        if (size > 0)
+        {
+#ifdef _WIN32
+            mapping = CreateFileMappingA((HANDLE)_get_osfhandle(fd), nullptr, PAGE_READONLY, 0, 0, nullptr);
+            void *view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (view == nullptr && mapping != nullptr)
+            {
+                CloseHandle(mapping);
+                mapping = nullptr;
+            }
+#else
+            void *view = mmap(nullptr, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view == MAP_FAILED)
+                view = nullptr;
+            else
+                madvise(view, (size_t)size, MADV_SEQUENTIAL);
+#endif
+            io.syscalls++;
+            if (view != nullptr)
+            {
+                bytes = (const char *)view;
+                length = (size_t)size;
+                mapped = true;
+                io.bytesRead += size;
+            }
+        }
+        rawio::closeFile(fd);
+        io.syscalls++;
+
+        if (!mapped)
+        {
+            if (!readWholeFile(path, copy))
+                return false;
+            bytes = copy.data();
+            length = copy.size();
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (mapped)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(bytes);
+            CloseHandle(mapping);
+            mapping = nullptr;
+#else
+            munmap((void *)bytes, length);
+#endif
+            mapped = false;
+        }
+        copy.clear();
+        bytes = nullptr;
+        length = 0;
+    }
+};
+
+// Replaces the file with text. The text is written to path.tmp, synced to the disk if durable
+// writes are on, and renamed over the file, so a crash leaves the old file or the new one and never
+// a part of either. Returns false, with the file as it was, if any step fails.
+inline bool writeWholeFile(const string &path, const string &text)
+{
+    IoCounters &io = threadIo();
+    string tmp = path + ".tmp";
+    int fd = rawio::openFile(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+    io.syscalls++;
+    if (fd < 0)
+        return false;
+
+    size_t done = 0;
+    while (done < text.size())
+    {
+        long long n = rawio::writeFile(fd, text.data() + done, text.size() - done);
+        io.syscalls++;
+        if (n <= 0)
+            break;
+        done += n;
+        io.bytesWritten += n;
+    }
+
+    bool written = done == text.size();
+    if (written && durableWrites.load(memory_order_relaxed))
+    {
+        written = rawio::syncFile(fd) == 0;
+        io.syscalls++;
+        io.fsyncs++;
+    }
+
+    written = rawio::closeFile(fd) == 0 && written;
+    written = written && rawio::replaceFile(tmp.c_str(), path.c_str());
+    io.syscalls += 2;
+    if (!written)
+        rawio::removeFile(tmp.c_str());
+    return written;
+}
+
+// Writes text over the file from byte offset on, creating the file if needed, and syncs it if
+// durable writes are on. Bytes past the end of the text are left as they are, or cut off if
+// truncate is set. Returns false if not all of the text was written.
+inline bool writeFileAt(const string &path, long long offset, const string &text, bool truncate = false)
+{
+    IoCounters &io = threadIo();
+    int fd = rawio::openFile(path.c_str(), O_WRONLY | O_CREAT);
+    io.syscalls++;
+    if (fd < 0)
+        return false;
+    rawio::seekFile(fd, offset);
+    io.syscalls++;
+
+    size_t done = 0;
+    while (done < text.size())
+    {
+        long long n = rawio::writeFile(fd, text.data() + done, text.size() - done);
+        io.syscalls++;
+        if (n <= 0)
+            break;
+        done += n;
+        io.bytesWritten += n;
+    }
+
+    bool written = done == text.size();
+    if (written && truncate)
+    {
+        written = rawio::truncateFile(fd, offset + (long long)text.size()) == 0;
+        io.syscalls++;
+    }
+    if (written && durableWrites.load(memory_order_relaxed))
+    {
+        written = rawio::syncFile(fd) == 0;
+        io.syscalls++;
+        io.fsyncs++;
+    }
+
+    written = rawio::closeFile(fd) == 0 && written;
+    io.syscalls++;
+    return written;
+}
+
+// Loads a JSON document from disk, a missing file gives back a null document
+inline json loadJson(const string &path)
+{
+    ScopedLatency latency(OP_FILE_LOAD);
+    TraceSpan span("loadJson", "storage", path.c_str());
+    json data;
+
+    // Reading and parsing are separate steps so that a trace shows which one is slow
+    string text;
+    bool found;
+    {
+        TraceSpan read("read", "storage", path.c_str());
+        found = readWholeFile(path, text);
+    }
+    if (found)
+    {
+        TraceSpan parse("parse", "storage", path.c_str());
+        data = json::parse(text);
+    }
+    return data;
+}
+
+// Saves a JSON document to disk with the given indentation, throws if it cannot be written
+inline void saveJson(const string &path, const json &data, int indent)
+{
+    ScopedLatency latency(OP_FILE_SAVE);
+    TraceSpan span("saveJson", "storage", path.c_str());
+    string text;
+    {
+        TraceSpan serialize("serialize", "storage", path.c_str());
+        text = data.dump(indent);
+        text += '\n';
+    }
+    TraceSpan write("write", "storage", path.c_str());
+    if (!writeWholeFile(path, text))
+        throw runtime_error("cannot write " + path);
+}
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef SUMMARIES_HPP
+#define SUMMARIES_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#include "records.hpp"
+#include "money.hpp"
+#include "time_index.hpp"
+
+using namespace std;
+
+// Money a client spent on purchases and got from sales on one day; the net flow into their
+// balance is sold - bought
+struct ClientFlow
+{
+    Money bought;
+    long long clientId = 0;
+    Money sold;
+
+    Money netFlow() const { return sold - bought; }
+
+    static auto fields()
+    {
+        return make_tuple(field("bought", &ClientFlow::bought), field("clientId", &ClientFlow::clientId),
+                          field("sold", &ClientFlow::sold));
+    }
+};
+
+// Trading in one stock on one day
+struct StockActivity
+{
+    long long stockId = 0;
+    long long trades = 0;
+    Money turnover;
+    long long volume = 0;
+
+    static auto fields()
+    {
+        return make_tuple(field("stockId", &StockActivity::stockId), field("trades", &StockActivity::trades),
+                          field("turnover", &StockActivity::turnover), field("volume", &StockActivity::volume));
+    }
+};
+
+// Every client and stock that traded on one day, an entry of summaries.json
+struct DaySummary
+{
+    vector<ClientFlow> clients;
+    int64_t day = 0;
+    vector<StockActivity> stocks;
+
+    static auto fields()
+    {
+        return make_tuple(field("clients", &DaySummary::clients), field("day", &DaySummary::day),
+                          field("stocks", &DaySummary::stocks));
+    }
+};
+
+// The single record of summaries.json: the cash of the whole book and the days
+struct SummaryFile
+{
+    Money cash;
+    vector<DaySummary> days;
+
+    static auto fields() { return make_tuple(field("cash", &SummaryFile::cash), field("days", &SummaryFile::days)); }
+};
+
+// Materialized views over the ledger: per-client daily net flow, per-stock daily volume and
+// turnover, and the cash balance of the whole book. They are updated by every trade and balance
+// change, so the dashboard reads them with point lookups instead of walking the history.
+class DailySummaries
+{
+private:
+    struct Day
+    {
+        unordered_map<long long, ClientFlow> clients;
+        unordered_map<long long, StockActivity> stocks;
+    };
+
+    map<int64_t, Day> days;
+    Money cash;
+    bool dirty = false;
+
+public:
+    bool isDirty() const { return dirty; }
+
+    void clear()
+    {
+        days.clear();
+        cash = Money();
+        dirty = true;
+    }
+
+    Money bookCash() const { return cash; }
+
+    // Deposits, trades and settlements move the book's cash by the amount
+    void recordCash(Money amount)
+    {
+        cash += amount;
+        dirty = true;
+    }
+
+    void recordTrade(const Transaction &transaction)
+    {
+        Day &day = days[dayOf(transaction.timestamp)];
+
+        ClientFlow &flow = day.clients[transaction.id];
+        flow.clientId = transaction.id;
+        if (transaction.type == "sell")
+            flow.sold += transaction.totalCost;
+        else
+            flow.bought += transaction.totalCost;
+
+        StockActivity &activity = day.stocks[transaction.stockId];
+        activity.stockId = transaction.stockId;
+        activity.trades++;
+        activity.volume = checkedAdd(activity.volume, transaction.numberOfShares);
+        activity.turnover += transaction.totalCost;
+        dirty = true;
+    }
+
+    // The client's flow on the day of the time, nothing bought or sold if they did not trade
+    ClientFlow clientFlow(long long clientId, int64_t time) const
+    {
+        ClientFlow none;
+        none.clientId = clientId;
+        auto day = days.find(dayOf(time));
+        if (day == days.end())
+            return none;
+        auto flow = day->second.clients.find(clientId);
+        return flow != day->second.clients.end() ? flow->second : none;
+    }
+
+    StockActivity stockActivity(long long stockId, int64_t time) const
+    {
+        StockActivity none;
+        none.stockId = stockId;
+        auto day = days.find(dayOf(time));
+        if (day == days.end())
+            return none;
+        auto activity = day->second.stocks.find(stockId);
+        return activity != day->second.stocks.end() ? activity->second : none;
+    }
+
+    // False if there is no file, the views then have to be rebuilt
+    bool load(const string &path)
+    {
+        vector<SummaryFile> records = loadRecords<SummaryFile>(path);
+        days.clear();
+        if (records.empty())
+            return false;
+        cash = records[0].cash;
+        for (auto &summary : records[0].days)
+        {
+            Day &day = days[summary.day];
+            for (auto &flow : summary.clients)
+                day.clients[flow.clientId] = flow;
+            for (auto &activity : summary.stocks)
+                day.stocks[activity.stockId] = activity;
+        }
+        dirty = false;
+        return true;
+    }
+
+    // Days are written oldest first, and the clients and stocks of a day by id
+    void save(const string &path)
+    {
+        SummaryFile file;
+        file.cash = cash;
+        for (auto &day : days)
+        {
+            DaySummary summary;
+            summary.day = day.first;
+            for (auto &flow : day.second.clients)
+                summary.clients.push_back(flow.second);
+            for (auto &activity : day.second.stocks)
+                summary.stocks.push_back(activity.second);
+            sort(summary.clients.begin(), summary.clients.end(),
+                 [](const ClientFlow &a, const ClientFlow &b) { return a.clientId < b.clientId; });
+            sort(summary.stocks.begin(), summary.stocks.end(),
+                 [](const StockActivity &a, const StockActivity &b) { return a.stockId < b.stockId; });
+            file.days.push_back(summary);
+        }
+        saveRecords(path, vector<SummaryFile>{file}, 4);
+        dirty = false;
+    }
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cctype>
+
+#include "records.hpp"
+
+using namespace std;
+
+// A NEPSE ticker of up to eight letters or digits packed into one integer, first character in
+// the lowest byte. Comparing and hashing a ticker is comparing and hashing a uint64_t.
+class Ticker
+{
+private:
+    uint64_t code;
+
+public:
+    constexpr Ticker() : code(0) {}
+
+    // Packs the name if it is a ticker (1 to 8 letters or digits, case ignored), otherwise gives the empty ticker
+    static Ticker fromString(const string &name)
+    {
+        Ticker ticker;
+        if (name.empty() || name.size() > 8)
+            return ticker;
+        for (size_t i = 0; i < name.size(); i++)
+        {
+            unsigned char ch = name[i];
+            if (!isalnum(ch))
+                return Ticker();
+            ticker.code |= uint64_t(toupper(ch)) << (8 * i);
+        }
+        return ticker;
+    }
+
+    uint64_t getCode() const { return code; }
+    bool empty() const { return code == 0; }
+
+    string toString() const
+    {
+        string text;
+        for (uint64_t rest = code; rest != 0; rest >>= 8)
+            text += char(rest & 0xFF);
+        return text;
+    }
+
+    bool operator==(Ticker other) const { return code == other.code; }
+    bool operator!=(Ticker other) const { return code != other.code; }
+};
+
+// An interned stock name as stored in symbols.json
+struct SymbolRecord
+{
+    long long id = 0;
+    string name;
+    string ticker;
+
+    static auto fields()
+    {
+        return make_tuple(field("id", &SymbolRecord::id), field("name", &SymbolRecord::name), field("ticker", &SymbolRecord::ticker));
+    }
+};
+
+// Interns stock names to dense 32-bit ids. Holdings and transactions keep only the id; the name
+// is stored once here, and anything indexed by symbol is a plain array indexed by the id.
+// Ids are never reused, so the table only grows.
+class SymbolTable
+{
+private:
+    vector<string> names;
+    vector<Ticker> tickers;
+    unordered_map<uint64_t, uint32_t> byTicker;
+    unordered_map<string, uint32_t> byName; // only names that are not tickers
+    bool dirty = false;
+
+public:
+    size_t size() const { return names.size(); }
+    const string &name(uint32_t id) const { return names[id]; }
+    Ticker ticker(uint32_t id) const { return tickers[id]; }
+
+    // True when symbols were added since the table was loaded or saved
+    bool isDirty() const { return dirty; }
+
+    // Id of the name, NO_SYMBOL if it was never interned. Tickers match regardless of case.
+    uint32_t find(const string &name) const
+    {
+        Ticker ticker = Ticker::fromString(name);
+        if (!ticker.empty())
+        {
+            auto it = byTicker.find(ticker.getCode());
+            return it != byTicker.end() ? it->second : NO_SYMBOL;
+        }
+        auto it = byName.find(name);
+        return it != byName.end() ? it->second : NO_SYMBOL;
+    }
+
+    // Id of the name, adding it to the table if needed
+    uint32_t intern(const string &name)
+    {
+        uint32_t id = find(name);
+        if (id != NO_SYMBOL)
+            return id;
+
+        id = (uint32_t)names.size();
+        Ticker ticker = Ticker::fromString(name);
+        names.push_back(name);
+        tickers.push_back(ticker);
+        if (!ticker.empty())
+            byTicker.emplace(ticker.getCode(), id);
+        else
+            byName.emplace(name, id);
+        dirty = true;
+        return id;
+    }
+
+    void load(const string &path)
+    {
+        names.clear();
+        tickers.clear();
+        byTicker.clear();
+        byName.clear();
+        for (auto &record : loadRecords<SymbolRecord>(path))
+        {
+            // the file lists the symbols in id order
+            if (record.id != (long long)names.size())
+                throw runtime_error(path + ": symbol ids are not dense");
+            intern(record.name);
+        }
+        dirty = false;
+    }
+
+    void save(const string &path)
+    {
+        vector<SymbolRecord> records(names.size());
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            records[i].id = i;
+            records[i].name = names[i];
+            records[i].ticker = tickers[i].toString();
+        }
+        saveRecords(path, records, 3);
+        dirty = false;
+    }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SYSINFO_HPP
+#define SYSINFO_HPP
+
+#include <string>
+#include <fstream>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+using namespace std;
+
+// Reads a "Vm...: <n> kB" line from /proc/self/status, returning 0 when it is not available
+inline long long readProcStatusKB(const string &key)
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':')
+        {
+            return stoll(line.substr(key.size() + 1));
+        }
+    }
+    return 0;
+}
+
+// Returns the resident memory of the current process in kilobytes
+inline long long currentMemoryKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.WorkingSetSize / 1024;
+    return 0;
+#else
+    return readProcStatusKB("VmRSS");
+#endif
+}
+
+// Returns the peak resident memory of the current process in kilobytes
+inline long long peakMemoryKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    return readProcStatusKB("VmHWM");
+#endif
+}
+
+// Simple wall clock stopwatch used by the tools to report throughput
+class Stopwatch
+{
+private:
+    chrono::steady_clock::time_point start;
+
+public:
+    Stopwatch() : start(chrono::steady_clock::now()) {}
+
+    void reset() { start = chrono::steady_clock::now(); }
+    double seconds() const { return chrono::duration<double>(chrono::steady_clock::now() - start).count(); }
+    long long nanoseconds() const { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(); }
+};
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef TABLE_VIEW_HPP
+#define TABLE_VIEW_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <filesystem>
+#include <cstdint>
+
+#include "json.hpp"
+#include "storage.hpp"
+#include "extra.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+// One column of a table: the heading, the record field it shows and where it is drawn
+struct TableColumn
+{
+    string title;
+    string field;
+    int x;
+};
+
+// Byte ranges of the records of a JSON array file, found by one streaming pass over the file.
+// A record is only parsed when it is shown, so the index costs 20 bytes per record whatever the
+// size of the records.
+class RecordIndex
+{
+private:
+    string path;
+    string idField;
+    uintmax_t fileSize = 0;
+    filesystem::file_time_type modified;
+
+    vector<uint64_t> offsets;
+    vector<uint32_t> lengths;
+    vector<long long> ids;
+
+public:
+    // Scans the file and records where every top level object starts and ends, and its id
+    bool build(const string &newPath, const string &newIdField)
+    {
+        path = newPath;
+        idField = newIdField;
+        offsets.clear();
+        lengths.clear();
+        ids.clear();
+
+        error_code ec;
+        fileSize = filesystem::file_size(path, ec);
+        modified = filesystem::last_write_time(path, ec);
+        if (ec)
+            return false;
+
+        // The scanner keeps its state between chunks, a record may span two of them
+        int depth = 0;
+        bool inString = false, escaped = false, inKey = false, readingId = false, negative = false;
+        string key, currentKey;
+        long long id = 0;
+        uint64_t start = 0;
+
+        return scanFile(path, 1 << 20, [&](const char *data, size_t size, long long base) {
+            for (size_t i = 0; i < size; i++)
+            {
+                char ch = data[i];
+                if (inString)
+                {
+                    if (escaped)
+                        escaped = false;
+                    else if (ch == '\\')
+                        escaped = true;
+                    else if (ch == '"')
+                        inString = false;
+                    else if (inKey)
+                        key += ch;
+                    continue;
+                }
+
+                if (readingId)
+                {
+                    if (ch >= '0' && ch <= '9')
+                    {
+                        id = id * 10 + (ch - '0');
+                        continue;
+                    }
+                    if (ch != '.' && ch != 'e' && ch != 'E')
+                    {
+                        readingId = false;
+                        if (negative)
+                            id = -id;
+                    }
+                }
+
+                switch (ch)
+                {
+                case '"':
+                    inString = true;
+                    inKey = depth == 2;
+                    key.clear();
+                    break;
+                case ':':
+                    if (depth == 2)
+                        currentKey = key;
+                    break;
+                case ',':
+                    if (depth == 2)
+                        currentKey.clear();
+                    break;
+                case '{':
+                case '[':
+                    if (depth == 1 && ch == '{')
+                    {
+                        start = base + i;
+                        id = 0;
+                        currentKey.clear();
+                    }
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    depth--;
+                    if (depth == 1 && ch == '}')
+                    {
+                        offsets.push_back(start);
+                        lengths.push_back((uint32_t)(base + i + 1 - start));
+                        ids.push_back(id);
+                    }
+                    break;
+                default:
+                    if (depth == 2 && currentKey == idField && (ch == '-' || (ch >= '0' && ch <= '9')))
+                    {
+                        readingId = true;
+                        negative = ch == '-';
+                        id = negative ? 0 : ch - '0';
+                        currentKey.clear();
+                    }
+                    break;
+                }
+            }
+        });
+    }
+
+    // True while the file has not been written since the index was built
+    bool isCurrent() const
+    {
+        error_code ec;
+        return filesystem::file_size(path, ec) == fileSize && !ec && filesystem::last_write_time(path, ec) == modified && !ec;
+    }
+
+    size_t size() const { return offsets.size(); }
+    long long id(size_t i) const { return ids[i]; }
+    const string &getIdField() const { return idField; }
+
+    // Reads and parses a single record
+    json record(size_t i) const
+    {
+        string text;
+        if (!readFileRange(path, offsets[i], lengths[i], text))
+            return json();
+        return json::parse(text, nullptr, false);
+    }
+
+    // Parses every record in file order with a single pass over the file
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        size_t next = 0;
+        string text;
+        scanFile(path, 1 << 20, [&](const char *data, size_t size, long long base) {
+            uint64_t chunkEnd = base + size;
+            while (next < offsets.size() && offsets[next] < chunkEnd)
+            {
+                uint64_t begin = max<uint64_t>(offsets[next], base);
+                uint64_t end = min<uint64_t>(offsets[next] + lengths[next], chunkEnd);
+                text.append(data + (begin - base), end - begin);
+                if (end < offsets[next] + lengths[next])
+                    break;
+                visit(next, json::parse(text, nullptr, false));
+                text.clear();
+                next++;
+            }
+        });
+    }
+};
+
+// Scrollable window over a record file. Only the rows of the visible page are read from disk;
+// sorting keeps a permutation of record numbers instead of moving the records.
+class TableView
+{
+private:
+    shared_ptr<RecordIndex> index;
+    vector<uint32_t> order;
+    size_t top = 0;
+    size_t pageSize;
+    int sortColumn = -1;
+    bool descending = false;
+
+    // Indexes are kept between views so that reopening an unchanged file costs nothing
+    static shared_ptr<RecordIndex> cachedIndex(const string &path, const string &idField)
+    {
+        static map<string, shared_ptr<RecordIndex>> cache;
+        shared_ptr<RecordIndex> &entry = cache[path];
+        if (entry == nullptr || entry->getIdField() != idField || !entry->isCurrent())
+        {
+            entry = make_shared<RecordIndex>();
+            entry->build(path, idField);
+        }
+        return entry;
+    }
+
+    // Sort key of a field, numbers sort by value and text the way it is displayed
+    static void sortKey(const json &record, const string &field, double &number, string &text)
+    {
+        auto it = record.find(field);
+        if (it == record.end())
+            return;
+        if (it->is_number())
+            number = it->get<double>();
+        else if (it->is_string())
+            text = formatString(it->get<string>());
+    }
+
+public:
+    TableView(size_t pageSize = 15) : pageSize(pageSize) {}
+
+    void open(const string &path, const string &idField)
+    {
+        index = cachedIndex(path, idField);
+        order.resize(index->size());
+        iota(order.begin(), order.end(), 0);
+        top = 0;
+        sortColumn = -1;
+        descending = false;
+    }
+
+    size_t size() const { return order.size(); }
+    size_t getTop() const { return top; }
+    size_t getPageSize() const { return pageSize; }
+    int getSortColumn() const { return sortColumn; }
+    bool isDescending() const { return descending; }
+
+    // Records of the visible page, in display order
+    vector<json> page() const
+    {
+        vector<json> rows;
+        for (size_t i = top; i < order.size() && i < top + pageSize; i++)
+            rows.push_back(index->record(order[i]));
+        return rows;
+    }
+
+    void scroll(long long rows)
+    {
+        long long last = order.size() > pageSize ? (long long)(order.size() - pageSize) : 0;
+        long long next = (long long)top + rows;
+        top = (size_t)max(0LL, min(last, next));
+    }
+
+    void nextPage() { scroll((long long)pageSize); }
+    void previousPage() { scroll(-(long long)pageSize); }
+    void home() { top = 0; }
+    void end() { scroll((long long)order.size()); }
+
+    // Scrolls so that the record with the id is the first row, returns false if there is none
+    bool jumpToId(long long id)
+    {
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            if (index->id(order[i]) == id)
+            {
+                top = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Sorts by the column; sorting by the same column again reverses the order
+    void sortBy(int column, const vector<TableColumn> &columns)
+    {
+        descending = column == sortColumn ? !descending : false;
+        sortColumn = column;
+        const string &field = columns[column].field;
+
+        if (field == index->getIdField())
+        {
+            // the ids are in the index already, nothing has to be read
+            stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return index->id(a) < index->id(b); });
+        }
+        else
+        {
+            // other fields are read once for the sort and dropped afterwards
+            vector<double> numbers(index->size(), 0);
+            vector<string> texts(index->size());
+            index->forEach([&](size_t i, const json &record) { sortKey(record, field, numbers[i], texts[i]); });
+            stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                return numbers[a] != numbers[b] ? numbers[a] < numbers[b] : texts[a] < texts[b];
+            });
+        }
+        if (descending)
+            reverse(order.begin(), order.end());
+        top = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef TIME_INDEX_HPP
+#define TIME_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+
+using namespace std;
+
+// Epoch seconds of a ctime() text such as "Mon Jan  2 10:00:00 2023\n", read as local time the way
+// ctime() wrote it. Text in any other form gives 0.
+inline int64_t parseCtime(const string &text)
+{
+    static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    char weekday[4], month[4];
+    tm parts = {};
+    if (sscanf(text.c_str(), "%3s %3s %d %d:%d:%d %d", weekday, month, &parts.tm_mday, &parts.tm_hour, &parts.tm_min,
+               &parts.tm_sec, &parts.tm_year) != 7)
+        return 0;
+    const char *found = strstr(months, month);
+    if (found == nullptr || strlen(month) != 3 || (found - months) % 3 != 0)
+        return 0;
+    parts.tm_mon = (int)(found - months) / 3;
+    parts.tm_year -= 1900;
+    parts.tm_isdst = -1;
+    time_t epoch = mktime(&parts);
+    return epoch == (time_t)-1 ? 0 : (int64_t)epoch;
+}
+
+// Epoch second of the UTC midnight that starts the day of the time
+inline int64_t dayOf(int64_t time)
+{
+    return time - ((time % 86400) + 86400) % 86400;
+}
+
+// Epoch second of the UTC midnight starting the date, months and days counted from 1
+inline int64_t epochOfDate(int64_t year, int64_t month, int64_t day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return (era * 146097 + dayOfEra - 719468) * 86400;
+}
+
+// UTC date of an epoch time as YYYY-MM-DD
+inline string formatDate(int64_t epoch)
+{
+    int64_t z = dayOf(epoch) / 86400 + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t dayOfEra = z - era * 146097;
+    int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int64_t mp = (5 * dayOfYear + 2) / 153;
+    int64_t day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    int64_t month = mp < 10 ? mp + 3 : mp - 9;
+    int64_t year = yearOfEra + era * 400 + (month <= 2);
+
+    char text[32];
+    snprintf(text, sizeof(text), "%04d-%02d-%02d", (int)year, (int)month, (int)day);
+    return text;
+}
+
+// ctime() of an epoch time, without the trailing newline. Unlike ctime() it keeps no shared
+// buffer, so threads can call it at once.
+inline string formatTime(int64_t epoch)
+{
+    static const char *days = "SunMonTueWedThuFriSat";
+    static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    time_t t = (time_t)epoch;
+    tm parts;
+#ifdef _WIN32
+    if (localtime_s(&parts, &t) != 0)
+        return "";
+#else
+    if (localtime_r(&t, &parts) == nullptr)
+        return "";
+#endif
+    char text[64];
+    snprintf(text, sizeof(text), "%.3s %.3s%3d %.2d:%.2d:%.2d %d", days + 3 * parts.tm_wday, months + 3 * parts.tm_mon,
+             parts.tm_mday, parts.tm_hour, parts.tm_min, parts.tm_sec, 1900 + parts.tm_year);
+    return text;
+}
+
+// Records of each key (a client or a stock id) ordered by time, for range queries such as
+// "client X, last 30 days". Postings are kept in one sorted run plus a short sorted tail of the
+// latest additions. A range is two binary searches in each, so a query costs O(log n + k).
+// The tail is merged into the run once it grows past a fixed size, which keeps additions cheap
+// without the bookkeeping of a tree.
+class TimeIndex
+{
+public:
+    // Where a record is: the position of a transaction within an entry of transactions.json
+    struct Posting
+    {
+        long long key;
+        int64_t time;
+        uint32_t entry;
+        uint32_t position;
+    };
+
+private:
+    static constexpr size_t TAIL_LIMIT = 4096;
+
+    vector<Posting> run, tail;
+
+    static bool before(const Posting &a, const Posting &b)
+    {
+        return tie(a.key, a.time, a.entry, a.position) < tie(b.key, b.time, b.entry, b.position);
+    }
+
+    // The postings of the key with from <= time < to
+    static pair<const Posting *, const Posting *> rangeOf(const vector<Posting> &postings, long long key, int64_t from,
+                                                          int64_t to)
+    {
+        auto lower = [](const Posting &p, const pair<long long, int64_t> &k) { return make_pair(p.key, p.time) < k; };
+        const Posting *first = lower_bound(postings.data(), postings.data() + postings.size(), make_pair(key, from), lower);
+        const Posting *last = lower_bound(first, postings.data() + postings.size(), make_pair(key, to), lower);
+        return {first, last};
+    }
+
+public:
+    size_t size() const { return run.size() + tail.size(); }
+
+    void clear()
+    {
+        run.clear();
+        tail.clear();
+    }
+
+    // Replaces the index with the postings, sorting them once
+    void build(vector<Posting> postings)
+    {
+        sort(postings.begin(), postings.end(), before);
+        run.swap(postings);
+        tail.clear();
+    }
+
+    void add(const Posting &posting)
+    {
+        tail.insert(upper_bound(tail.begin(), tail.end(), posting, before), posting);
+        if (tail.size() < TAIL_LIMIT)
+            return;
+        vector<Posting> merged(run.size() + tail.size());
+        merge(run.begin(), run.end(), tail.begin(), tail.end(), merged.begin(), before);
+        run.swap(merged);
+        tail.clear();
+    }
+
+    // Postings of the key with from <= time < to, oldest first
+    vector<Posting> range(long long key, int64_t from, int64_t to) const
+    {
+        vector<Posting> found;
+        if (from >= to)
+            return found;
+        auto inRun = rangeOf(run, key, from, to);
+        auto inTail = rangeOf(tail, key, from, to);
+        found.resize((inRun.second - inRun.first) + (inTail.second - inTail.first));
+        merge(inRun.first, inRun.second, inTail.first, inTail.second, found.begin(), before);
+        return found;
+    }
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+
+// Tracing is off by default. When it is off a span costs one relaxed load and a branch.
+inline atomic<bool> traceEnabled(false);
+
+inline void setTracing(bool enabled) { traceEnabled.store(enabled, memory_order_relaxed); }
+inline bool isTracing() { return traceEnabled.load(memory_order_relaxed); }
+
+// Nanoseconds since the first call, shared by every thread
+inline int64_t traceClock()
+{
+    static const chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+struct TraceEvent
+{
+    const char *name;     // string literal naming the phase
+    const char *category; // string literal grouping the phases
+    char detail[32];      // e.g. the file name of a load
+    int64_t start;
+    int64_t duration;
+};
+
+// Fixed size ring of the most recent spans of one thread. Only the owning thread writes;
+// a reader copies the ring and drops the slots that were overwritten while it was copying.
+class TraceRing
+{
+public:
+    static const uint64_t CAPACITY = 1 << 14;
+
+private:
+    TraceEvent events[CAPACITY];
+    atomic<uint64_t> head;
+    int threadId;
+
+public:
+    TraceRing(int threadId) : head(0), threadId(threadId) {}
+
+    int getThreadId() const { return threadId; }
+
+    void push(const TraceEvent &event)
+    {
+        uint64_t h = head.load(memory_order_relaxed);
+        events[h % CAPACITY] = event;
+        head.store(h + 1, memory_order_release);
+    }
+
+    void copyTo(vector<TraceEvent> &out) const
+    {
+        uint64_t end = head.load(memory_order_acquire);
+        uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        size_t first = out.size();
+        for (uint64_t i = begin; i < end; i++)
+            out.push_back(events[i % CAPACITY]);
+
+        // Anything the writer may have reused during the copy is dropped
+        uint64_t now = head.load(memory_order_acquire);
+        uint64_t safe = now > CAPACITY ? now - CAPACITY : 0;
+        if (safe > begin)
+        {
+            size_t stale = (size_t)min<uint64_t>(safe - begin, end - begin);
+            out.erase(out.begin() + first, out.begin() + first + stale);
+        }
+    }
+};
+
+class TraceRegistry
+{
+private:
+    mutex lock;
+    vector<unique_ptr<TraceRing>> rings;
+
+public:
+    // Never destroyed, so spans recorded during exit() are still safe
+    static TraceRegistry &instance()
+    {
+        static TraceRegistry *registry = new TraceRegistry();
+        return *registry;
+    }
+
+    TraceRing &local()
+    {
+        thread_local TraceRing *mine = nullptr;
+        if (mine == nullptr)
+        {
+            lock_guard<mutex> guard(lock);
+            rings.emplace_back(new TraceRing((int)rings.size() + 1));
+            mine = rings.back().get();
+        }
+        return *mine;
+    }
+
+    // Writes every buffered span in the Chrome trace event format (chrome://tracing, Perfetto)
+    bool dumpChromeTrace(const string &path)
+    {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == nullptr)
+            return false;
+
+        fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Nepal Stock Analyzer\"}}");
+
+        lock_guard<mutex> guard(lock);
+        vector<TraceEvent> events;
+        for (auto &ring : rings)
+        {
+            events.clear();
+            ring->copyTo(events);
+            for (auto &e : events)
+            {
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                        e.name, e.category, ring->getThreadId(), e.start / 1000.0, e.duration / 1000.0);
+                if (e.detail[0] != '\0')
+                {
+                    fprintf(out, ",\"args\":{\"detail\":\"");
+                    for (const char *p = e.detail; *p; p++)
+                    {
+                        if (*p == '"' || *p == '\\')
+                            fputc('\\', out);
+                        fputc(*p, out);
+                    }
+                    fprintf(out, "\"}");
+                }
+                fputc('}', out);
+            }
+        }
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        return true;
+    }
+};
+
+// File the trace is written to by dumpTrace()
+inline string &traceOutputPath()
+{
+    static string path = "trace.json";
+    return path;
+}
+
+inline bool dumpTrace() { return TraceRegistry::instance().dumpChromeTrace(traceOutputPath()); }
+
+// Records the enclosing scope as one complete ("X") event when tracing is on
+class TraceSpan
+{
+private:
+    TraceEvent event;
+    bool active;
+
+public:
+    TraceSpan(const char *name, const char *category = "engine", const char *detail = nullptr) : active(isTracing())
+    {
+        if (!active)
+            return;
+        event.name = name;
+        event.category = category;
+        event.detail[0] = '\0';
+        if (detail != nullptr)
+        {
+            strncpy(event.detail, detail, sizeof(event.detail) - 1);
+            event.detail[sizeof(event.detail) - 1] = '\0';
+        }
+        event.start = traceClock();
+    }
+
+    ~TraceSpan() { finish(); }
+
+    // Ends the span before the end of its scope
+    void finish()
+    {
+        if (!active)
+            return;
+        active = false;
+        event.duration = traceClock() - event.start;
+        TraceRegistry::instance().local().push(event);
+    }
+};
+
+#endif
@@ -10,7 +10,7 @@
         - include the json.hpp file
         - g++ main.cpp -o main.exe; start-process main.exe
 
-    Description: A simple implementation of a stock analyzer program that uses a linked list to store the stock data and a JSON file to store the client data.
+    Description: A simple implementation of a stock analyzer program that keeps the clients and stocks in slab containers and stores them in JSON files.
 */
 
 #include <iostream>
@@ -18,148 +18,36 @@
 #include <windows.h>
 #include <string>
 #include <fstream>
-#include <random>
 #include <math.h>
 #include <algorithm>
 #include <vector>
+#include <iomanip>
+#include <sstream>
 
 #include "includes/extra.hpp"
 #include "includes/json.hpp"
+#include "includes/engine.hpp"
+#include "includes/compactor.hpp"
+#include "includes/screen.hpp"
+#include "includes/table_view.hpp"
+#include "includes/importer.hpp"
 
 using namespace std;
 using json = nlohmann::json;
 
-// Define the Client class
-class Client
-{
-private:
-    string name;
-    int id;
-    string address;
-    string dob;
-
-public:
-    Client(string name, int id, string address, string dob) : name(name), id(id), address(address), dob(dob) {}
-
-    string getName() { return name; }
-    int getId() { return id; }
-    string getAddress() { return address; }
-    string getDoB() { return dob; }
-
-    void setName(string name) { this->name = name; }
-    void setId(int id) { this->id = id; }
-    void setAddress(string address) { this->address = address; }
-    void setDoB(string dob) { this->dob = dob; }
-};
-
-// Define the StockList class
-class StockList
-{
-private:
-    int stockId;
-    string stockName;
-    float marketPrice;
-
-public:
-    StockList(int stockId, string stockName, float marketPrice) : stockId(stockId), stockName(stockName), marketPrice(marketPrice) {}
-
-    int getId() { return stockId; }
-    string getStockName() { return stockName; }
-    float getMarketPrice() { return marketPrice; }
-
-    void setStockId(int stockId) { this->stockId = stockId; }
-    void setStockName(string stockName) { this->stockName = stockName; }
-    void setMarketPrice(float marketPrice) { this->marketPrice = marketPrice; }
-};
-
-// Define the LinkedList class
-template <typename T>
-class LinkedList
-{
-private:
-    // Define the Node struct
-    struct Node
-    {
-        T data;
-        Node *next;
-
-        Node(T data) : data(data), next(nullptr) {}
-    };
-
-    Node *head;
-    int size;
-
-public:
-    LinkedList() : head(nullptr), size(0) {}
-
-    ~LinkedList()
-    {
-        // Delete all nodes
-        Node *current = head;
-        while (current != nullptr)
-        {
-            Node *next = current->next;
-            delete current;
-            current = next;
-        }
-    }
-
-    void insert(T data)
-    {
-        // Create a new node
-        Node *newNode = new Node(data);
-
-        // Insert the new node at the front of the list
-        newNode->next = head;
-        head = newNode;
-
-        // Increment the size of the list
-        size++;
-    }
-
-    void remove(int id)
-    {
-        if (head == nullptr)
-        {
-            return;
-        }
-
-        Node *current = head;
-        Node *prev = nullptr;
-
-        while (current != nullptr)
-        {
-            if (current->data.getId() == id)
-            {
-                if (prev == nullptr)
-                {
-                    // Removing the head node
-                    head = current->next;
-                }
-                else
-                {
-                    prev->next = current->next;
-                }
-                delete current;
-                size--;
-                return;
-            }
-            prev = current;
-            current = current->next;
-        }
-    }
-};
-
 class Console
 {
 public:
     // This function moves the console cursor to the specified position
     void gotoxy(int x, int y)
     {
-        COORD coord;
-        coord.X = x;
-        coord.Y = y;
-        SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), coord);
+        screen().moveTo(x, y);
+    }
+
+    // This function starts a new screen, only the changed cells are redrawn
+    void clearScreen()
+    {
+        screen().clear();
     }
 
     // This function draws a line of the specified length and unicode escape sequence
@@ -227,7 +115,7 @@ public:
             cout << "Logged In Time : " << ctime(&t);
             c.gotoxy(44, 23);
             cout << "Press any key to continue .... ";
-            getch();
+            readKey();
             return true;
         }
         else
@@ -236,14 +124,37 @@ public:
             return false;
         }
     }
+    // Shows the file I/O done during the session, in total and per operation
+    void showIoSummary(int y)
+    {
+        Console c;
+        MetricsRegistry &registry = MetricsRegistry::instance();
+        IoTotals session = registry.sessionIo();
+        c.gotoxy(22, y);
+        cout << "I/O This Session :: read " << fixed << setprecision(1) << session.bytesRead / 1024.0 << " KB, wrote "
+             << session.bytesWritten / 1024.0 << " KB, " << session.syscalls << " calls, " << session.fsyncs
+             << " fsyncs";
+        for (int op = 0; op < OP_FILE_LOAD && y < 25; op++)
+        {
+            IoTotals io = registry.ioTotals(op);
+            if (io.operations == 0)
+                continue;
+            y++;
+            c.gotoxy(22, y);
+            cout << left << setw(19) << metricOpName(op) << right << " x" << setw(4) << io.operations << "  read "
+                 << setw(9) << io.bytesRead / 1024.0 << " KB  wrote " << setw(9) << io.bytesWritten / 1024.0 << " KB  "
+                 << setw(5) << io.syscalls << " calls";
+        }
+        cout.unsetf(ios::floatfield);
+    }
+
     virtual void login() = 0;
     virtual void logout() = 0;
 };
 
 class NepalStockAnalyzer
 {
-    LinkedList<Client> clients;
-    LinkedList<StockList> stockLists;
+    StockEngine engine; // holds the clients and stocks, and performs the operations on the JSON files
     Console c;
     Login *currentUser; // add a member variable to store the current user
 public:
@@ -253,6 +164,14 @@ public:
     void addRecords();
     void removeRecords();
     void displayAllRecords();
+    void browseTable(const string &title, const string &file, const string &idField, const vector<TableColumn> &columns,
+                     int serialX);
+
+    long long readClientId(int listX) { return readRecordId(false, listX); }
+    long long readStockId(int listX) { return readRecordId(true, listX); }
+    long long readRecordId(bool stocks, int listX);
+    bool readAmount(Money &amount);
+    string describeRecord(long long id, bool stocks);
 
     void updateStockPrices();
     void depositMoney();
@@ -260,8 +179,6 @@ public:
     void sellStock();
 
     void displayTransactions();
-    void buyHistory(int, int, string, int, float, float, string);
-    void sellHistory(int, int, string, int, float, float, string);
 
     void displayClientPortfolio();
 
@@ -309,7 +226,7 @@ void ClientLogin::login()
     string newPassword;
     // Capture the password input from the user
     char ch;
-    while ((ch = getch()) != 13)
+    while ((ch = readKey()) != 13)
     {
         newPassword += ch;
         cout << "*";
@@ -323,7 +240,7 @@ void ClientLogin::login()
     }
     else
     {
-        system("CLS");
+        c.clearScreen();
         c.gotoxy(36, 18);
         c.design(48, "\u2500");
         c.gotoxy(43, 17);
@@ -334,7 +251,7 @@ void ClientLogin::login()
 
 void ClientLogin::logout()
 {
-    system("cls");
+    c.clearScreen();
     c.gotoxy(30, 4);
     c.design(25, "\u2592");
     cout << " THANK YOU ";
@@ -346,8 +263,15 @@ void ClientLogin::logout()
     time(&t);
     c.gotoxy(40, 14);
     cout << "Logged Out Time :: " << ctime(&t);
+    if (isTracing())
+    {
+        dumpTrace();
+        c.gotoxy(40, 16);
+        cout << "Trace Saved To  :: " << traceOutputPath();
+    }
+    showIoSummary(18);
     fflush(stdin);
-    getch();
+    readKey();
     c.gotoxy(0, 26);
     exit(0);
 }
@@ -371,7 +295,7 @@ void AdminLogin::login()
     string newPassword;
     // Capture the password input from the user
     char ch;
-    while ((ch = getch()) != 13)
+    while ((ch = readKey()) != 13)
     {
         newPassword += ch;
         cout << "*";
@@ -387,7 +311,7 @@ void AdminLogin::login()
     }
     else
     {
-        system("CLS");
+        c.clearScreen();
         c.gotoxy(36, 18);
         c.design(48, "\u2500");
         c.gotoxy(43, 17);
@@ -398,7 +322,7 @@ void AdminLogin::login()
 
 void AdminLogin::logout()
 {
-    system("cls");
+    c.clearScreen();
     c.gotoxy(30, 4);
     c.design(25, "\u2592");
     cout << " THANK YOU ";
@@ -410,8 +334,15 @@ void AdminLogin::logout()
     time(&t);
     c.gotoxy(40, 14);
     cout << "Logged Out Time :: " << ctime(&t);
+    if (isTracing())
+    {
+        dumpTrace();
+        c.gotoxy(40, 16);
+        cout << "Trace Saved To  :: " << traceOutputPath();
+    }
+    showIoSummary(18);
     fflush(stdin);
-    getch();
+    readKey();
     c.gotoxy(0, 26);
     exit(0);
 }
@@ -438,10 +369,10 @@ public:
         cin >> choice;
         if (choice != '1' && choice != '2')
         {
-            system("CLS");
+            clearScreen();
             displayMenu();
         }
-        system("CLS");
+        clearScreen();
 
         if (choice == '1')
         {
@@ -469,7 +400,7 @@ public:
 
 void NepalStockAnalyzer::displayMenu()
 {
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(29, 4);
     c.design(20, "\u2592");
     cout << " WELCOME TO MAIN MENU ";
@@ -493,6 +424,11 @@ void NepalStockAnalyzer::displayMenu()
     cout << "[8] . View Portfolio" << endl;
     c.gotoxy(49, 17);
     cout << "[9] . Log Out !!!" << endl;
+    if (isTracing())
+    {
+        c.gotoxy(40, 19);
+        cout << "Tracing is on, press [T] to stop and save it" << endl;
+    }
     c.gotoxy(45, 22);
     cout << "Please Enter Your Choice [1-9] : ";
     getChoice();
@@ -500,7 +436,7 @@ void NepalStockAnalyzer::displayMenu()
 
 void NepalStockAnalyzer::displayMenuClient()
 {
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(29, 4);
     c.design(20, "\u2592");
     cout << " WELCOME TO MAIN MENU ";
@@ -541,7 +477,7 @@ void NepalStockAnalyzer::getChoice()
 {
     char choice;
     cin >> choice;
-    system("CLS");
+    c.clearScreen();
     switch (choice)
     {
     case DISPLAY_ALL_RECORDS:
@@ -584,6 +520,22 @@ void NepalStockAnalyzer::getChoice()
         displayClientPortfolio();
         break;
     }
+    case 'T':
+    case 't':
+    {
+        // start or stop recording trace spans, stopping saves them to the trace file
+        if (isTracing())
+        {
+            setTracing(false);
+            dumpTrace();
+        }
+        else
+        {
+            setTracing(true);
+        }
+        displayMenu();
+        break;
+    }
     case QUIT:
     {
         // retrieve the current user
@@ -613,7 +565,7 @@ void NepalStockAnalyzer::getChoiceClient()
 {
     char choice;
     cin >> choice;
-    system("CLS");
+    c.clearScreen();
     switch (choice)
     {
     case DEPOSIT_MONEY_C:
@@ -678,360 +630,291 @@ void NepalStockAnalyzer::displayAllRecords()
     int choice;
     cin >> choice;
 
-    system("CLS");
-    int i = 7;
+    c.clearScreen();
+    const vector<TableColumn> clientColumns = {{"Full Name", "name", 36}, {"UserID", "id", 51}, {"Address", "address", 64}, {"Birth Date", "dob", 85}};
+    const vector<TableColumn> stockColumns = {{"Stock Name", "stockName", 45}, {"Stock ID", "stockId", 61}, {"Market Price", "marketPrice", 73}};
     if (choice == 1)
-    {
-        // Load the data from the clients.json file and store it in the clients member variable
-        json clientsJson;
-        ifstream in("added_clients.json");
-        if (in.good())
-        {
-            in >> clientsJson;
-        }
-        in.close();
-
-        c.gotoxy(28, 3);
-        c.design(25, "\u2592");
-        cout << " CLIENTS LIST ";
-        c.design(25, "\u2592");
-
-        c.gotoxy(26, 5);
-        cout << "S/N.";
-        c.gotoxy(36, 5);
-        cout << "Full Name";
-        c.gotoxy(51, 5);
-        cout << "UserID";
-        c.gotoxy(64, 5);
-        cout << "Address";
-        c.gotoxy(85, 5);
-        cout << "Birth Date";
-
-        c.gotoxy(5, 6);
-        c.design(109, "\u2550");
-        for (auto &client : clientsJson)
-        {
-            string name = formatString(client["name"]);
-            int id = client["id"];
-            string address = formatString(client["address"]);
-            string dob = formatString(client["dob"]);
-
-            // automaticaly increment S.No. for each client when displaying the list
-            int size = clientsJson.size();
-            int sNo = 1;
-            for (int i = 0; i < size; i++)
-            {
-                c.gotoxy(26, i + 7);
-                cout << sNo << endl;
-                sNo++;
-            }
-            c.gotoxy(36, i);
-            cout << name << endl;
-            c.gotoxy(51, i);
-            cout << id << endl;
-            c.gotoxy(64, i);
-            cout << address << endl;
-            c.gotoxy(85, i);
-            cout << dob << endl;
-            i++;
-        }
+        browseTable(" CLIENTS LIST ", "added_clients.json", "id", clientColumns, 26);
+    else if (choice == 2)
+        browseTable(" STOCKS LIST ", "added_stocks.json", "stockId", stockColumns, 34);
+    else if (choice == 3)
+        browseTable(" REMOVED CLIENTS ", "removed_clients.json", "id", clientColumns, 26);
+    else if (choice == 4)
+        browseTable(" REMOVED STOCKS ", "removed_stocks.json", "stockId", stockColumns, 34);
 
-        // this loop draws the top and bottom borders of the table
-        for (int k = 0; k < 113; k++)
-        {
-            c.gotoxy(k + 3, 1);
-            cout << "\u2580";
-            c.gotoxy(k + 3, i + 2);
-            cout << "\u2584";
-        }
+    // Go back to the main menu
+    displayMenu();
+}
 
-        // this loop draws the left and right borders of the table
-        for (int j = 0; j < i + 2; j++)
-        {
-            c.gotoxy(3, j + 1);
-            cout << "\u2588";
-            c.gotoxy(116, j + 1);
-            cout << "\u2588";
-        }
-        int x;
-        c.gotoxy(42, i + 5);
-        cout << "Press [Enter] to return back to main menu. ";
-        x = getch();
-        if (x == 13)
-        {
-            displayMenu();
-        }
-        else
-        {
-            system("CLS");
-            displayAllRecords();
-        }
-    }
-    else if (choice == 2)
+// Shows one page of the records at a time, only the visible rows are read from the file
+void NepalStockAnalyzer::browseTable(const string &title, const string &file, const string &idField,
+                                     const vector<TableColumn> &columns, int serialX)
+{
+    TableView view;
+    view.open(file, idField);
+    string message;
+    while (true)
     {
-        // Load the data from the added_stocks.json file and store it in the stockLists member variable
-        json stockListsJson;
-        ifstream in("added_stocks.json");
-        if (in.good())
-        {
-            in >> stockListsJson;
-        }
-        in.close();
-
+        c.clearScreen();
         c.gotoxy(28, 3);
         c.design(25, "\u2592");
-        cout << " STOCKS LIST ";
+        cout << title;
         c.design(25, "\u2592");
 
-        c.gotoxy(34, 5);
+        c.gotoxy(serialX, 5);
         cout << "S/N.";
-        c.gotoxy(45, 5);
-        cout << "Stock Name";
-        c.gotoxy(61, 5);
-        cout << "Stock ID";
-        c.gotoxy(73, 5);
-        cout << "Market Price";
-
+        for (size_t k = 0; k < columns.size(); k++)
+        {
+            c.gotoxy(columns[k].x, 5);
+            cout << columns[k].title;
+            if ((int)k == view.getSortColumn())
+                cout << (view.isDescending() ? " \u25bc" : " \u25b2");
+        }
         c.gotoxy(5, 6);
         c.design(109, "\u2550");
-        for (auto &stock : stockListsJson)
+
+        // one line per visible record, the serial number is the position in the current order
+        int i = 7;
+        size_t sNo = view.getTop() + 1;
+        for (auto &record : view.page())
         {
-            int stockId = stock["stockId"];
-            string stockName = formatString(stock["stockName"]);
-            float marketPrice = stock["marketPrice"];
-
-            // automaticaly increment S.No. for each stock when displaying the list
-            int size = stockListsJson.size();
-            int sNo = 1;
-            for (int i = 0; i < size; i++)
+            c.gotoxy(serialX, i);
+            cout << sNo++;
+            for (auto &column : columns)
             {
-                c.gotoxy(34, i + 7);
-                cout << sNo << endl;
-                sNo++;
+                c.gotoxy(column.x, i);
+                auto value = record.find(column.field);
+                if (value == record.end())
+                    continue;
+                if (value->is_string())
+                    cout << formatString(value->get<string>());
+                else if (value->is_number_float())
+                {
+                    // amounts are the only fractional fields, shown exactly from the number's text
+                    string text = value->dump();
+                    Money amount;
+                    cout << (Money::parse(text, amount) ? amount.toString() : text);
+                }
+                else
+                    cout << *value;
             }
-            c.gotoxy(45, i);
-            cout << stockName << endl;
-            c.gotoxy(61, i);
-            cout << stockId << endl;
-            c.gotoxy(73, i);
-            cout << marketPrice << endl;
             i++;
         }
 
-        // this loop draws the top and bottom borders of the table
+        // the table keeps the height of a full page so that the borders do not move while scrolling
+        int bottom = 7 + (int)view.getPageSize() + 1;
         for (int k = 0; k < 113; k++)
         {
             c.gotoxy(k + 3, 1);
             cout << "\u2580";
-            c.gotoxy(k + 3, i + 2);
+            c.gotoxy(k + 3, bottom);
             cout << "\u2584";
         }
-
-        // this loop draws the left and right borders of the table
-        for (int j = 0; j < i + 2; j++)
+        for (int j = 1; j < bottom; j++)
         {
-            c.gotoxy(3, j + 1);
+            c.gotoxy(3, j);
             cout << "\u2588";
-            c.gotoxy(116, j + 1);
+            c.gotoxy(116, j);
             cout << "\u2588";
         }
 
-        int x;
-        c.gotoxy(42, i + 5);
-        cout << "Press [Enter] to return back to main menu. ";
-        x = getch();
-        if (x == 13)
-        {
-            displayMenu();
-        }
+        c.gotoxy(8, bottom + 2);
+        if (view.size() == 0)
+            cout << "No records";
         else
+            cout << "Records " << view.getTop() + 1 << " - " << min(view.getTop() + view.getPageSize(), view.size())
+                 << " of " << view.size();
+        if (!message.empty())
         {
-            system("CLS");
-            displayAllRecords();
+            c.gotoxy(60, bottom + 2);
+            cout << message;
+            message.clear();
         }
-    }
-    else if (choice == 3)
-    {
-        // Load the data from the removed_clients.json file and display it
-        json clientsJson;
-        ifstream in("removed_clients.json");
-        if (in.good())
-        {
-            in >> clientsJson;
-        }
-        in.close();
-
-        c.gotoxy(28, 3);
-        c.design(25, "\u2592");
-        cout << " REMOVED CLIENTS ";
-        c.design(25, "\u2592");
-
-        c.gotoxy(26, 5);
-        cout << "S/N.";
-        c.gotoxy(36, 5);
-        cout << "Full Name";
-        c.gotoxy(51, 5);
-        cout << "UserID";
-        c.gotoxy(64, 5);
-        cout << "Address";
-        c.gotoxy(85, 5);
-        cout << "Date of Birth";
+        c.gotoxy(8, bottom + 3);
+        cout << "[N] Next  [P] Previous  [H] Home  [E] End  [J] Jump To ID  [S] Sort  [Enter] Main Menu";
 
-        c.gotoxy(5, 6);
-        c.design(109, "\u2550");
-        for (auto &client : clientsJson)
+        int key = readKey();
+        if (key == 13)
+            return;
+        switch (key)
+        {
+        case 'n':
+        case 'N':
+        case ' ':
+            view.nextPage();
+            break;
+        case 'p':
+        case 'P':
+            view.previousPage();
+            break;
+        case 'h':
+        case 'H':
+            view.home();
+            break;
+        case 'e':
+        case 'E':
+            view.end();
+            break;
+        case 'j':
+        case 'J':
         {
-            string name = formatString(client["name"]);
-            int id = client["id"];
-            string address = formatString(client["address"]);
-            string dob = formatString(client["dob"]);
-
-            // automaticaly increment S.No. for each client when displaying the list
-            int size = clientsJson.size();
-            int sNo = 1;
-            for (int i = 0; i < size; i++)
+            c.gotoxy(8, bottom + 4);
+            cout << "Enter The ID : ";
+            long long id;
+            if (!(cin >> id))
             {
-                c.gotoxy(26, i + 7);
-                cout << sNo << endl;
-                sNo++;
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                message = "Invalid ID";
             }
-            c.gotoxy(36, i);
-            cout << name << endl;
-            c.gotoxy(51, i);
-            cout << id << endl;
-            c.gotoxy(64, i);
-            cout << address << endl;
-            c.gotoxy(85, i);
-            cout << dob << endl;
-            i++;
-        }
-
-        // this loop draws the top and bottom borders of the table
-        for (int k = 0; k < 113; k++)
-        {
-            c.gotoxy(k + 3, 1);
-            cout << "\u2580";
-            c.gotoxy(k + 3, i + 2);
-            cout << "\u2584";
-        }
-
-        // this loop draws the left and right borders of the table
-        for (int j = 0; j < i + 2; j++)
-        {
-            c.gotoxy(3, j + 1);
-            cout << "\u2588";
-            c.gotoxy(116, j + 1);
-            cout << "\u2588";
+            else if (!view.jumpToId(id))
+                message = "ID " + to_string(id) + " not found";
+            break;
         }
-
-        int x;
-        c.gotoxy(42, i + 5);
-        cout << "Press [Enter] to return back to main menu. ";
-        x = getch();
-        if (x == 13)
+        case 's':
+        case 'S':
         {
-            displayMenu();
+            c.gotoxy(8, bottom + 4);
+            cout << "Sort by column [1-" << columns.size() << "] : ";
+            int column = readKey() - '1';
+            if (column >= 0 && column < (int)columns.size())
+                view.sortBy(column, columns);
+            break;
         }
-        else
-        {
-            system("CLS");
-            displayAllRecords();
         }
     }
-    else if (choice == 4)
+}
+
+// Reads an amount of money typed at the prompt. Returns false, with the rest of the line dropped, if
+// it is not a number, is too large to hold or is not above zero.
+bool NepalStockAnalyzer::readAmount(Money &amount)
+{
+    if (cin >> amount && amount > Money())
+        return true;
+    cin.clear();
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    return false;
+}
+
+// Reads a client or stock at the cursor. A number is taken as the ID, anything else is searched by
+// name as it is typed and the best matches are listed below the prompt, starting at column listX.
+// Tab or the arrow keys move through the matches and Enter picks one. Returns -1 if nothing matched.
+long long NepalStockAnalyzer::readRecordId(bool stocks, int listX)
+{
+    const size_t shown = 5;
+    const int width = 50;
+    int x = screen().getCursorX(), y = screen().getCursorY();
+    string text;
+    vector<long long> matches;
+    size_t selected = 0;
+    long long id = -1;
+
+    while (true)
     {
-        // Load the data from the removed_stocks.json file and display it
-        json stockListsJson;
-        ifstream in("removed_stocks.json");
-        if (in.good())
+        bool numeric = !text.empty() && text.size() <= 18 && all_of(text.begin(), text.end(), ::isdigit);
+        matches.clear();
+        if (!text.empty() && !numeric)
+            matches = stocks ? engine.searchStocks(text, shown) : engine.searchClients(text, shown);
+        if (selected >= matches.size())
+            selected = 0;
+
+        for (size_t i = 0; i < shown; i++)
         {
-            in >> stockListsJson;
+            string line = i < matches.size() ? (i == selected ? "> " : "  ") + describeRecord(matches[i], stocks) : "";
+            line.resize(width, ' ');
+            c.gotoxy(listX, y + 1 + i);
+            cout << line;
         }
-        in.close();
-
-        c.gotoxy(28, 3);
-        c.design(25, "\u2592");
-        cout << " REMOVED STOCKS ";
-        c.design(25, "\u2592");
-
-        c.gotoxy(34, 5);
-        cout << "S/N.";
-        c.gotoxy(45, 5);
-        cout << "Stock Name";
-        c.gotoxy(61, 5);
-        cout << "Stock ID";
-        c.gotoxy(73, 5);
-        cout << "Market Price";
+        c.gotoxy(x, y);
+        cout << text << string(max(0, 24 - (int)text.size()), ' ');
+        c.gotoxy(x + text.size(), y);
 
-        c.gotoxy(5, 6);
-        c.design(109, "\u2550");
-        for (auto &stock : stockListsJson)
+        int key = readKey();
+        if (key == 13 || key == '\n')
         {
-            int stockId = stock["stockId"];
-            string stockName = formatString(stock["stockName"]);
-            float marketPrice = stock["marketPrice"];
-
-            // automaticaly increment S.No. for each stock when displaying the list
-            int size = stockListsJson.size();
-            int sNo = 1;
-            for (int i = 0; i < size; i++)
+            if (numeric)
             {
-                c.gotoxy(34, i + 7);
-                cout << sNo << endl;
-                sNo++;
+                id = stoll(text);
+                break;
             }
-
-            c.gotoxy(45, i);
-            cout << stockName << endl;
-            c.gotoxy(61, i);
-            cout << stockId << endl;
-            c.gotoxy(73, i);
-            cout << marketPrice << endl;
-            i++;
+            if (!matches.empty())
+            {
+                id = matches[selected];
+                break;
+            }
+            // a newline left over from the previous input is not an answer
+            if (!text.empty())
+                break;
         }
-
-        // this loop draws the top and bottom borders of the table
-        for (int k = 0; k < 113; k++)
+        else if (key == 8 || key == 127)
         {
-            c.gotoxy(k + 3, 1);
-            cout << "\u2580";
-            c.gotoxy(k + 3, i + 2);
-            cout << "\u2584";
+            if (!text.empty())
+                text.pop_back();
         }
-
-        // this loop draws the left and right borders of the table
-        for (int j = 0; j < i + 2; j++)
+        else if (key == 9 && !matches.empty())
+            selected = (selected + 1) % matches.size();
+#ifdef _WIN32
+        else if (key == 0 || key == 224)
         {
-            c.gotoxy(3, j + 1);
-            cout << "\u2588";
-            c.gotoxy(116, j + 1);
-            cout << "\u2588";
+            key = readKey();
+            if (key == 72 && !matches.empty())
+                selected = (selected + matches.size() - 1) % matches.size();
+            else if (key == 80 && !matches.empty())
+                selected = (selected + 1) % matches.size();
         }
-
-        int x;
-        c.gotoxy(42, i + 5);
-        cout << "Press [Enter] to return back to main menu. ";
-        x = getch();
-        if (x == 13)
+#else
+        else if (key == 27 && readKey() == '[')
         {
-            displayMenu();
+            key = readKey();
+            if (key == 'A' && !matches.empty())
+                selected = (selected + matches.size() - 1) % matches.size();
+            else if (key == 'B' && !matches.empty())
+                selected = (selected + 1) % matches.size();
         }
-        else
+#endif
+        else if ((key >= 32 && key < 127) || key >= 128)
         {
-            system("CLS");
-            displayAllRecords();
+            if (text.size() < 40)
+                text += (char)key;
         }
     }
+
+    // the matches are cleared and the answer is left on the prompt line
+    for (size_t i = 0; i < shown; i++)
+    {
+        c.gotoxy(listX, y + 1 + i);
+        cout << string(width, ' ');
+    }
+    c.gotoxy(x, y);
+    string answer = id >= 0 ? to_string(id) : text;
+    cout << answer << string(max(0, 24 - (int)answer.size()), ' ');
+    c.gotoxy(x + answer.size(), y);
+    return id;
+}
+
+// One line describing a search match
+string NepalStockAnalyzer::describeRecord(long long id, bool stocks)
+{
+    ostringstream line;
+    line << id << "  ";
+    if (stocks)
+    {
+        optional<StockList> stock = engine.findStock(id);
+        if (stock.has_value())
+            line << formatString(stock->getStockName()) << "  " << stock->getMarketPrice();
+    }
     else
     {
-        // Go back to the main menu
-        displayMenu();
+        const Client *client = engine.findClient(id);
+        if (client != nullptr)
+            line << formatString(client->getName()) << ", " << formatString(client->getAddress());
     }
+    return line.str();
 }
 
 void NepalStockAnalyzer::addRecords()
 {
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(26, 4);
     c.design(25, "\u2592");
     cout << " REGISTRATION MENU ";
@@ -1048,33 +931,18 @@ void NepalStockAnalyzer::addRecords()
     int choice;
     cin >> choice;
 
-    system("CLS");
+    c.clearScreen();
     if (choice == 1)
     {
         char ch;
         do
         {
-            system("CLS");
+            c.clearScreen();
             c.gotoxy(26, 4);
             c.design(20, "\u2592");
             cout << " CLIENT ACCOUNT REGISTRATION ";
             c.design(20, "\u2592");
             c.border();
-            // Load the existing data from the JSON file
-            json clientsJson;
-            ifstream in("added_clients.json");
-            if (in.good())
-            {
-                in >> clientsJson;
-            }
-            in.close();
-
-            // Generate a random ID for the new client
-            random_device rd;                       // Seed the generator
-            mt19937 gen(rd());                      // Choose a generator
-            uniform_int_distribution<> dis(1, 200); // Generate random numbers between 1 and 200
-            int id = dis(gen);                      // Generate a random ID
-
             // Add a new client
             c.gotoxy(36, 9);
             cout << "[1] . Enter Client Name            : ";
@@ -1094,16 +962,12 @@ void NepalStockAnalyzer::addRecords()
             // cin >> dob;
             getline(cin, dob);
 
-            Client newClient(name, id, address, dob);
-            clients.insert(newClient);
+            // Add the client to the records under a new ID and save them
+            Client newClient(name, 0, address, dob);
+            long long id = engine.addClient(newClient);
 
-            // Update the data in memory
-            clientsJson.push_back({{"name", name}, {"id", id}, {"address", address}, {"dob", dob}});
-
-            // Save the updated data to the JSON file
-            ofstream out("added_clients.json");
-            out << clientsJson.dump(4);
-            out.close();
+            c.gotoxy(36, 15);
+            cout << "      Client ID                    : " << id;
 
             c.gotoxy(38, 17);
             c.design(45, "\u2500");
@@ -1122,27 +986,12 @@ void NepalStockAnalyzer::addRecords()
         char ch;
         do
         {
-            system("CLS");
+            c.clearScreen();
             c.gotoxy(30, 4);
             c.design(20, "\u2592");
             cout << " STOCK REGISTRATION ";
             c.design(20, "\u2592");
             c.border();
-            // Load the existing data from the JSON file
-            json stockListsJson;
-            ifstream in("added_stocks.json");
-            if (in.good())
-            {
-                in >> stockListsJson;
-            }
-            in.close();
-
-            // Generate a random ID for the new client
-            random_device rd;                       // Seed the generator
-            mt19937 gen(rd());                      // Choose a generator
-            uniform_int_distribution<> dis(1, 200); // Generate random numbers between 1 and 200
-            int stockId = dis(gen);                 // Generate a random ID
-
             c.gotoxy(42, 10);
             cout << "[1] . Enter Stock Name        : ";
             string stockName;
@@ -1152,18 +1001,27 @@ void NepalStockAnalyzer::addRecords()
 
             c.gotoxy(42, 12);
             cout << "[2] . Enter Stock Market Price: ";
-            float marketPrice;
-            cin >> marketPrice;
+            Money marketPrice;
+            if (!readAmount(marketPrice))
+            {
+                c.gotoxy(38, 17);
+                c.design(45, "\u2500");
+                c.gotoxy(43, 18);
+                cout << "THE PRICE MUST BE A NUMBER ABOVE ZERO";
+                c.gotoxy(38, 19);
+                c.design(45, "\u2500");
+                c.gotoxy(38, 21);
+                cout << "Do You Want To Add Another Record ? (Y/N) : ";
+                cin >> ch;
+                continue;
+            }
 
-            StockList newStock(stockId, stockName, marketPrice);
-            stockLists.insert(newStock);
+            // Add the stock to the records under a new ID and save them
+            StockList newStock(0, stockName, marketPrice);
+            long long stockId = engine.addStock(newStock);
 
-            // Update the data in memory
-            stockListsJson.push_back({{"stockId", stockId}, {"stockName", stockName}, {"marketPrice", marketPrice}});
-            // Save the updated data to the JSON file
-            ofstream out("added_stocks.json");
-            out << stockListsJson.dump(3) << endl;
-            out.close();
+            c.gotoxy(42, 14);
+            cout << "      Stock ID                : " << stockId;
 
             c.gotoxy(38, 17);
             c.design(45, "\u2500");
@@ -1186,39 +1044,12 @@ void NepalStockAnalyzer::addRecords()
 
 void NepalStockAnalyzer::updateStockPrices()
 {
-    // Load the data from the added_stocks.json file
-    json stockListsJson;
-    ifstream in("added_stocks.json");
-    if (in.good())
-    {
-        in >> stockListsJson;
-    }
-    in.close();
-
-    // Iterate over the stocks in the JSON file
-    for (auto &stock : stockListsJson)
-    {
-        // Generate a random fluctuation value
-        float fluctuation = generateFluctuation(stock["marketPrice"]);
-
-        // Update the market price of the stock
-        float temp = stock["marketPrice"];
-        temp += fluctuation;
-        stock["marketPrice"] = temp;
-
-        // Round the market price to the nearest 2 decimal places
-        stock["marketPrice"] = floor(temp * 100 + 0.5) / 100;
-    }
-
-    // Save the updated data to the JSON file
-    ofstream out("added_stocks.json");
-    out << stockListsJson.dump(3) << endl;
-    out.close();
+    engine.updateStockPrices();
 }
 
 void NepalStockAnalyzer::removeRecords()
 {
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(27, 4);
     c.design(25, "\u2592");
     cout << " REMOVE RECORDS ";
@@ -1238,7 +1069,7 @@ void NepalStockAnalyzer::removeRecords()
     if (choice == 1)
     {
     re:
-        system("CLS");
+        c.clearScreen();
         c.gotoxy(24, 4);
         c.design(25, "\u2592");
         cout << " REMOVE CLIENT RECORD ";
@@ -1246,84 +1077,43 @@ void NepalStockAnalyzer::removeRecords()
         c.border();
         while (true)
         {
-            // Load the data from the clients.json file
-            json clientsJson;
-            ifstream in("added_clients.json");
-            if (in.good())
-            {
-                in >> clientsJson;
-            }
-            in.close();
-
             c.gotoxy(46, 10);
-            cout << "Enter ID of Client to Remove: ";
-            int id;
-            cin >> id;
+            cout << "Enter ID or Name of Client to Remove: ";
+            long long id = readClientId(46);
 
-            // Remove the client from the linked list
-            clients.remove(id);
-
-            // Remove the client from the JSON object
-            bool clientFound = false;
-            for (auto it = clientsJson.begin(); it != clientsJson.end(); it++)
-            {
-                if (it->at("id") == id)
-                {
-                    string name = it->at("name");
-                    string address = it->at("address");
-                    string dob = it->at("dob");
-                    clientsJson.erase(it);
-                    clientFound = true;
-
-                    // Save the updated data to the clients.json file
-                    ofstream out("added_clients.json");
-                    out << clientsJson.dump(4);
-                    out.close();
-
-                    // Load the data from the removed_clients.json file
-                    json removedClientsJson;
-                    ifstream in2("removed_clients.json");
-                    if (in2.good())
-                    {
-                        in2 >> removedClientsJson;
-                    }
-                    in2.close();
-                    // Add the removed client to the removed_clients.json file
-                    removedClientsJson.push_back({{"name", name}, {"id", id}, {"address", address}, {"dob", dob}});
-                    ofstream out2("removed_clients.json");
-                    out2 << removedClientsJson.dump(4);
-                    out2.close();
-
-                    c.gotoxy(41, 14);
-                    c.design(42, "\u2500");
-                    c.gotoxy(48, 15);
-                    cout << "CLIENT REMOVED SUCCESSFULLY";
-                    c.gotoxy(41, 16);
-                    c.design(42, "\u2500");
-                    c.gotoxy(43, 18);
-                    cout << "Want to remove another client? (Y/N) ";
-                    char choice;
-                    cin >> choice;
-                    if (choice == 'Y' || choice == 'y')
-                    {
-                        goto re;
-                    }
-                    else
-                    {
-                        displayMenu();
-                    }
-                }
-            }
-            if (!clientFound)
+            // Move the client from the records to removed_clients.json
+            bool clientFound = engine.removeClient(id);
+            if (clientFound)
             {
                 c.gotoxy(41, 14);
                 c.design(42, "\u2500");
-                c.gotoxy(54, 15);
-                cout << "CLIENT NOT FOUND";
+                c.gotoxy(48, 15);
+                cout << "CLIENT REMOVED SUCCESSFULLY";
                 c.gotoxy(41, 16);
                 c.design(42, "\u2500");
-                c.gotoxy(33, 18);
-                cout << "Press 'Y' to retry or any other key to return to main menu. ";
+                c.gotoxy(43, 18);
+                cout << "Want to remove another client? (Y/N) ";
+                char choice;
+                cin >> choice;
+                if (choice == 'Y' || choice == 'y')
+                {
+                    goto re;
+                }
+                else
+                {
+                    displayMenu();
+                }
+            }
+            if (!clientFound)
+            {
+                c.gotoxy(41, 14);
+                c.design(42, "\u2500");
+                c.gotoxy(54, 15);
+                cout << "CLIENT NOT FOUND";
+                c.gotoxy(41, 16);
+                c.design(42, "\u2500");
+                c.gotoxy(33, 18);
+                cout << "Press 'Y' to retry or any other key to return to main menu. ";
                 char choice;
                 cin >> choice;
                 if (choice == 'Y' || choice == 'y')
@@ -1340,7 +1130,7 @@ void NepalStockAnalyzer::removeRecords()
     else if (choice == 2)
     {
     ye:
-        system("CLS");
+        c.clearScreen();
         c.gotoxy(24, 4);
         c.design(25, "\u2592");
         cout << " REMOVE STOCK RECORD ";
@@ -1348,71 +1138,31 @@ void NepalStockAnalyzer::removeRecords()
         c.border();
         while (true)
         {
-            // Load the data from the added_stocks.json file
-            json stockListsJson;
-            ifstream in("added_stocks.json");
-            if (in.good())
-            {
-                in >> stockListsJson;
-            }
-            in.close();
-
             c.gotoxy(46, 10);
-            cout << "Enter ID of the Stock to Remove: ";
-            int stockId;
-            cin >> stockId;
-
-            // Remove the stock from the linked list
-            stockLists.remove(stockId);
+            cout << "Enter ID or Name of the Stock to Remove: ";
+            long long stockId = readStockId(46);
 
-            // Remove the stock from the JSON object
-            bool found = false;
-            for (auto it = stockListsJson.begin(); it != stockListsJson.end(); it++)
+            // Move the stock from the records to removed_stocks.json
+            bool found = engine.removeStock(stockId);
+            if (found)
             {
-                if (it->at("stockId") == stockId)
+                c.gotoxy(41, 14);
+                c.design(42, "\u2500");
+                c.gotoxy(49, 15);
+                cout << "STOCK REMOVED SUCCESSFULLY";
+                c.gotoxy(41, 16);
+                c.design(42, "\u2500");
+                c.gotoxy(43, 18);
+                cout << "Want to remove another stock? (Y/N) ";
+                char choice;
+                cin >> choice;
+                if (choice == 'Y' || choice == 'y')
+                {
+                    goto ye;
+                }
+                else
                 {
-                    found = true;
-                    string stockName = it->at("stockName");
-                    float marketPrice = it->at("marketPrice");
-                    stockListsJson.erase(it);
-
-                    // Save the updated data to the added_stocks.json file
-                    ofstream out("added_stocks.json");
-                    out << stockListsJson.dump(3) << endl;
-                    out.close();
-
-                    // Load the data from the removed_stocks.json file
-                    json removedStockListsJson;
-                    ifstream in2("removed_stocks.json");
-                    if (in2.good())
-                    {
-                        in2 >> removedStockListsJson;
-                    }
-                    in2.close();
-                    // Add the removed stock to the removed_stocks.json file
-                    removedStockListsJson.push_back({{"stockId", stockId}, {"stockName", stockName}, {"marketPrice", marketPrice}});
-                    ofstream out2("removed_stocks.json");
-                    out2 << removedStockListsJson.dump(3) << endl;
-                    out2.close();
-
-                    c.gotoxy(41, 14);
-                    c.design(42, "\u2500");
-                    c.gotoxy(49, 15);
-                    cout << "STOCK REMOVED SUCCESSFULLY";
-                    c.gotoxy(41, 16);
-                    c.design(42, "\u2500");
-                    c.gotoxy(43, 18);
-                    cout << "Want to remove another stock? (Y/N) ";
-                    char choice;
-                    cin >> choice;
-                    if (choice == 'Y' || choice == 'y')
-                    {
-                        goto ye;
-                    }
-                    else
-                    {
-                        displayMenu();
-                    }
+                    displayMenu();
                 }
             }
             if (!found)
@@ -1449,115 +1199,75 @@ void NepalStockAnalyzer::depositMoney()
 {
     while (true)
     {
-        system("CLS");
+        c.clearScreen();
         c.gotoxy(33, 4);
         c.design(20, "\u2592");
         cout << " CASH DEPOSIT ";
         c.design(20, "\u2592");
         c.border();
         c.gotoxy(46, 10);
-        cout << "Enter the ID of the client: ";
-        int id;
-        cin >> id;
-
-        // Load the data from the clients.json file
-        json clientsJson;
-        ifstream in("added_clients.json");
-        if (in.good())
-        {
-            in >> clientsJson;
-        }
-        in.close();
+        cout << "Enter the ID or name of the client: ";
+        long long id = readClientId(46);
 
         // Find the client with the specified ID
-        bool clientFound = false;
-        for (auto &client : clientsJson)
-        {
-            if (client["id"] == id)
+        const Client *client = engine.findClient(id);
+        bool clientFound = client != nullptr;
+        if (clientFound)
+        {
+            c.gotoxy(45, 13);
+            cout << "Enter the amount to deposit: $ ";
+            Money amount;
+            if (!readAmount(amount))
             {
-                clientFound = true;
-                c.gotoxy(45, 13);
-                cout << "Enter the amount to deposit: $ ";
-                float amount;
-                cin >> amount;
-
-                // Load the data from the portfolio.json file
-                json portfolioJson;
-                ifstream in2("portfolio.json");
-                if (in2.good())
-                {
-                    in2 >> portfolioJson;
-                }
-                in2.close();
-
-                // Check if the client already has an entry in the portfolio.json file
-                bool clientFoundInPortfolio = false;
-                for (auto &clientInPortfolio : portfolioJson)
-                {
-                    if (clientInPortfolio["id"] == id)
-                    {
-                        clientFoundInPortfolio = true;
-                        break;
-                    }
-                }
-
-                // If the client doesn't have an entry in the portfolio.json file, add a new entry
-                if (!clientFoundInPortfolio)
-                {
-                    string name = client["name"];
-                    int balance_cents = round(amount * 100);
-                    portfolioJson.push_back({{"name", name}, {"id", id}, {"balance", balance_cents / 100.0}});
-                }
-                else
-                {
-                    // If the client already has an entry in the portfolio.json file, update the balance
-                    for (auto &clientInPortfolio : portfolioJson)
-                    {
-                        if (clientInPortfolio["id"] == id)
-                        {
-                            float current_balance = clientInPortfolio["balance"];
-                            float updated_balance = current_balance + amount;
-
-                            int balance_cents = round(updated_balance * 100);
-                            clientInPortfolio["balance"] = balance_cents / 100.0;
-                            break;
-                        }
-                    }
-                }
-
-                // Save the updated data to the portfolio.json file
-                ofstream out2("portfolio.json");
-                out2 << portfolioJson.dump(3) << endl;
-                out2.close();
-
-                c.gotoxy(39, 18);
+                c.gotoxy(39, 15);
                 c.design(42, "\u2500");
-                c.gotoxy(39, 20);
+                c.gotoxy(47, 16);
+                cout << "ENTER AN AMOUNT ABOVE ZERO";
+                c.gotoxy(39, 17);
                 c.design(42, "\u2500");
-                c.gotoxy(52, 15);
-                c.gotoxy(34, 19);
-                cout << "Successfully deposited " << amount << " to the account of " << client["name"] << endl;
-                c.gotoxy(39, 21);
-                cout << "Do you want to deposit more money? (Y/N) ";
+                c.gotoxy(31, 19);
+                cout << "Press 'Y' to retry or any other key to return to main menu. ";
                 char choice;
                 cin >> choice;
-                if (choice != 'Y' && choice != 'y')
+                if (choice == 'Y' || choice == 'y')
+                    continue;
+                if (currentUser->getLoginType() == "client")
+                    displayMenuClient();
+                else
+                    displayMenu();
+                return;
+            }
+
+            // Update the client's balance in the portfolio.json file
+            engine.depositMoney(id, amount);
+
+            c.gotoxy(39, 18);
+            c.design(42, "\u2500");
+            c.gotoxy(39, 20);
+            c.design(42, "\u2500");
+            c.gotoxy(52, 15);
+            c.gotoxy(34, 19);
+            cout << "Successfully deposited " << amount << " to the account of " << client->getName() << endl;
+            c.gotoxy(39, 21);
+            cout << "Do you want to deposit more money? (Y/N) ";
+            char choice;
+            cin >> choice;
+            if (choice != 'Y' && choice != 'y')
+            {
+                // if user is client then go to client menu, if user is admin then go to admin menu
+                if (currentUser->getLoginType() == "client")
                 {
-                    // if user is client then go to client menu, if user is admin then go to admin menu
-                    if (currentUser->getLoginType() == "client")
-                    {
-                        displayMenuClient();
-                    }
-                    else if (currentUser->getLoginType() == "admin")
-                    {
-                        displayMenu();
-                    }
+                    displayMenuClient();
                 }
-                else
+                else if (currentUser->getLoginType() == "admin")
                 {
-                    depositMoney();
+                    displayMenu();
                 }
             }
+            else
+            {
+                depositMoney();
+            }
         }
         if (!clientFound)
         {
@@ -1593,264 +1303,169 @@ void NepalStockAnalyzer::depositMoney()
 void NepalStockAnalyzer::purchaseStock()
 {
 ae:
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(28, 4);
     c.design(24, "\u2592");
     cout << " STOCK PURCHASE ";
     c.design(24, "\u2592");
     c.border();
     c.gotoxy(47, 7);
-    cout << "Enter the ID of the client: ";
-    int id;
-    cin >> id;
-
-    // Load the data from the clients.json file
-    json clientsJson;
-    ifstream in("added_clients.json");
-    if (in.good())
-    {
-        in >> clientsJson;
-    }
-    in.close();
+    cout << "Enter the ID or name of the client: ";
+    long long id = readClientId(47);
 
     // Find the client with the specified ID
-    bool clientFound = false;
-    for (auto &client : clientsJson)
+    const Client *client = engine.findClient(id);
+    bool clientFound = client != nullptr;
+    if (clientFound)
     {
-        if (client["id"] == id)
-        {
-            clientFound = true;
+        // Load the data from the portfolio.json file
+        vector<Portfolio> portfolios = engine.loadPortfolios();
 
-            // Load the data from the portfolio.json file
-            json portfolioJson;
-            ifstream in2("portfolio.json");
-            if (in2.good())
+        // Find the client's balance
+        Money balance;
+        for (auto &entry : portfolios)
+        {
+            if (entry.id == id)
             {
-                in2 >> portfolioJson;
+                balance = entry.balance;
+                break;
             }
-            in2.close();
+        }
 
-            // Find the client's balance
-            float balance = 0;
-            for (auto &entry : portfolioJson)
-            {
-                if (entry["id"] == id)
-                {
-                    balance = entry["balance"];
-                    break;
-                }
-            }
+        // The listed stocks
+        const StockTable &addedStocks = engine.allStocks();
 
-            // Load the data from the added_stocks.json file
-            json stockListsJson;
-            ifstream in3("added_stocks.json");
-            if (in3.good())
-            {
-                in3 >> stockListsJson;
-            }
-            in3.close();
-
-            c.gotoxy(54, 9);
-            cout << "Available stocks:" << endl;
-
-            // first let's display headers
-            c.gotoxy(38, 11);
-            cout << "Stock ID";
-            c.gotoxy(53, 11);
-            cout << "Stock Name";
-            c.gotoxy(70, 11);
-            cout << "Market Price";
-
-            c.gotoxy(35, 12);
-            c.design(50, "\u2550");
-            int i = 13;
-            // now let's display the data
-            for (auto &stock : stockListsJson)
-            {
-                int stockId = stock["stockId"];
-                string stockName = formatString(stock["stockName"]);
-                float marketPrice = stock["marketPrice"];
-
-                c.gotoxy(38, i);
-                cout << stockId << endl;
-                c.gotoxy(53, i);
-                cout << stockName << endl;
-                c.gotoxy(70, i);
-                cout << marketPrice << endl;
-                i++;
-            }
+        c.gotoxy(54, 9);
+        cout << "Available stocks:" << endl;
 
-            // calculate the number of rows in the table
-            int numberOfRows = i - 12;
+        // first let's display headers
+        c.gotoxy(38, 11);
+        cout << "Stock ID";
+        c.gotoxy(53, 11);
+        cout << "Stock Name";
+        c.gotoxy(70, 11);
+        cout << "Market Price";
 
-            c.gotoxy(44, 13 + numberOfRows);
-            cout << "Enter ID of Stock to Purchase: ";
-            int stockId;
-            cin >> stockId;
+        c.gotoxy(35, 12);
+        c.design(50, "\u2550");
+        int i = 13;
+        // now let's display the data
+        for (size_t row = 0; row < addedStocks.size(); row++)
+        {
+            long long stockId = addedStocks.id(row);
+            string stockName = formatString(addedStocks.name(row));
+            Money marketPrice = addedStocks.price(row);
 
-            // Find the stock with the specified ID
-            bool stockFound = false;
-            float marketPrice = 0;
-            string stockName;
-            for (auto &stock : stockListsJson)
-            {
-                if (stock["stockId"] == stockId)
-                {
-                    stockFound = true;
-                    marketPrice = stock["marketPrice"];
-                    stockName = stock["stockName"];
-                    break;
-                }
-            }
+            c.gotoxy(38, i);
+            cout << stockId << endl;
+            c.gotoxy(53, i);
+            cout << stockName << endl;
+            c.gotoxy(70, i);
+            cout << marketPrice << endl;
+            i++;
+        }
 
-            if (!stockFound)
-            {
-                c.gotoxy(39, numberOfRows + 14);
-                c.design(42, "\u2500");
-                c.gotoxy(52, numberOfRows + 15);
-                cout << "STOCK NOT FOUND";
-                c.gotoxy(39, numberOfRows + 16);
-                c.design(42, "\u2500");
-                c.gotoxy(30, numberOfRows + 18);
-                cout << "Press 'Y' to retry or any other key to return to main menu. ";
-                char choice;
-                cin >> choice;
-                if (choice != 'Y' && choice != 'y')
-                {
-                    displayMenu();
-                }
-                else
-                {
-                    goto ae;
-                }
-            }
+        // calculate the number of rows in the table
+        int numberOfRows = i - 12;
 
-            c.gotoxy(40, numberOfRows + 14);
-            cout << "Enter the number of stocks to purchase: ";
-            int numStocks;
-            cin >> numStocks;
+        c.gotoxy(44, 13 + numberOfRows);
+        cout << "Enter ID or Name of Stock to Purchase: ";
+        long long stockId = readStockId(44);
 
-            // Calculate the total cost of the purchase
-            float totalCost = marketPrice * numStocks;
+        // Find the stock with the specified ID
+        optional<StockList> stock = engine.findStock(stockId);
+        bool stockFound = stock.has_value();
+        Money marketPrice;
+        string stockName;
+        if (stockFound)
+        {
+            marketPrice = stock->getMarketPrice();
+            stockName = stock->getStockName();
+        }
 
-            if (balance < totalCost)
-            {
-                c.gotoxy(41, numberOfRows + 15);
-                c.design(42, "\u2500");
-                c.gotoxy(39, numberOfRows + 16);
-                cout << "INSUFFICIENT BALANCE TO COMPLETE THE PURCHASE";
-                c.gotoxy(41, numberOfRows + 17);
-                c.design(42, "\u2500");
-                c.gotoxy(34, numberOfRows + 19);
-                cout << "Press 'Y' to retry or any other key to return to main menu. ";
-                char choice;
-                cin >> choice;
-                if (choice != 'Y' && choice != 'y')
-                {
-                    if (currentUser->getLoginType() == "admin")
-                    {
-                        displayMenu();
-                    }
-                    else
-                    {
-                        displayMenuClient();
-                    }
-                }
-                else
-                {
-                    goto ae;
-                }
-            }
-            // Update the client's balance
-            for (auto &entry : portfolioJson)
+        if (!stockFound)
+        {
+            c.gotoxy(39, numberOfRows + 14);
+            c.design(42, "\u2500");
+            c.gotoxy(52, numberOfRows + 15);
+            cout << "STOCK NOT FOUND";
+            c.gotoxy(39, numberOfRows + 16);
+            c.design(42, "\u2500");
+            c.gotoxy(30, numberOfRows + 18);
+            cout << "Press 'Y' to retry or any other key to return to main menu. ";
+            char choice;
+            cin >> choice;
+            if (choice != 'Y' && choice != 'y')
             {
-                if (entry["id"] == id)
-                {
-                    float balance = entry["balance"].get<float>();
-                    float updated_balance = balance - totalCost;
-                    int balance_cents = round(updated_balance * 100);
-                    entry["balance"] = balance_cents / 100.0;
-                    break;
-                }
+                displayMenu();
             }
-            // Save the updated data to the portfolio.json file
-            ofstream out2("portfolio.json");
-            out2 << portfolioJson.dump(4);
-            out2.close();
-
-            // Get the current time
-            time_t t;
-            time(&t);
-            string purchaseTime = ctime(&t);
-
-            // Add the purchased stock to the client's portfolio
-            bool portfolioEntryFound = false;
-            for (auto &entry : portfolioJson)
+            else
             {
-                if (entry["id"] == id)
-                {
-                    portfolioEntryFound = true;
-                    bool stockAlreadyExists = false;
-                    for (auto &stock : entry["stocks"])
-                    {
-                        if (stock["stockId"] == stockId)
-                        {
-                            stockAlreadyExists = true;
-                            int numberOfShares = stock["numberOfShares"];
-                            numberOfShares += numStocks;
-                            stock["numberOfShares"] = numberOfShares;
-                            int purchaseRateCents = round(marketPrice * 100);
-                            stock["purchaseRate"] = purchaseRateCents / 100.0;
-                            stock["purchaseTime"] = purchaseTime;
-                            break;
-                        }
-                    }
-                    if (!stockAlreadyExists)
-                    {
-                        json newStock;
-                        newStock["stockId"] = stockId;
-                        newStock["stockName"] = stockName;
-                        newStock["numberOfShares"] = numStocks;
-                        int purchaseRateCents = round(marketPrice * 100);
-                        newStock["purchasedRate"] = purchaseRateCents / 100.0;
-                        newStock["purchaseTime"] = purchaseTime;
-                        entry["stocks"].push_back(newStock);
-                    }
-                    break;
-                }
+                goto ae;
             }
+        }
 
-            // Save the updated data to the portfolio.json file
-            ofstream out3("portfolio.json");
-            out3 << portfolioJson.dump(4);
-            out3.close();
+        c.gotoxy(40, numberOfRows + 14);
+        cout << "Enter the number of stocks to purchase: ";
+        int numStocks;
+        cin >> numStocks;
 
-            // Call the buyHistory function to store the purchase transaction in the transactions.json file
-            buyHistory(id, stockId, stockName, numStocks, marketPrice, totalCost, purchaseTime);
+        // Calculate the total cost of the purchase
+        Money totalCost = marketPrice * numStocks;
 
+        if (balance < totalCost)
+        {
             c.gotoxy(41, numberOfRows + 15);
             c.design(42, "\u2500");
-            c.gotoxy(32, numberOfRows + 16);
-            cout << "Successfully Purchased " << numStocks << " Shares of " << stockName << " for a Total of " << totalCost;
+            c.gotoxy(39, numberOfRows + 16);
+            cout << "INSUFFICIENT BALANCE TO COMPLETE THE PURCHASE";
             c.gotoxy(41, numberOfRows + 17);
             c.design(42, "\u2500");
-            c.gotoxy(44, numberOfRows + 19);
-            cout << "Want to Purchase More Stocks? (Y/N) ";
+            c.gotoxy(34, numberOfRows + 19);
+            cout << "Press 'Y' to retry or any other key to return to main menu. ";
             char choice;
             cin >> choice;
-            if (choice == 'Y' || choice == 'y')
-            {
-                goto ae;
-            }
-            else
+            if (choice != 'Y' && choice != 'y')
             {
-                // if the user is admin then go to admin menu else go to client menu
                 if (currentUser->getLoginType() == "admin")
+                {
                     displayMenu();
+                }
                 else
+                {
                     displayMenuClient();
+                }
+            }
+            else
+            {
+                goto ae;
             }
         }
+        // Update the client's balance and portfolio, and store the purchase transaction
+        engine.purchaseStock(id, stockId, numStocks);
+
+        c.gotoxy(41, numberOfRows + 15);
+        c.design(42, "\u2500");
+        c.gotoxy(32, numberOfRows + 16);
+        cout << "Successfully Purchased " << numStocks << " Shares of " << stockName << " for a Total of " << totalCost;
+        c.gotoxy(41, numberOfRows + 17);
+        c.design(42, "\u2500");
+        c.gotoxy(44, numberOfRows + 19);
+        cout << "Want to Purchase More Stocks? (Y/N) ";
+        char choice;
+        cin >> choice;
+        if (choice == 'Y' || choice == 'y')
+        {
+            goto ae;
+        }
+        else
+        {
+            // if the user is admin then go to admin menu else go to client menu
+            if (currentUser->getLoginType() == "admin")
+                displayMenu();
+            else
+                displayMenuClient();
+        }
     }
     if (!clientFound)
     {
@@ -1881,36 +1496,18 @@ ae:
 void NepalStockAnalyzer::sellStock()
 {
 be:
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(29, 4);
     c.design(25, "\u2592");
     cout << " SELL STOCK ";
     c.design(25, "\u2592");
     c.border();
     c.gotoxy(47, 6);
-    cout << "Enter the ID of the client: ";
-    int id;
-    cin >> id;
-
-    // Load the data from the clients.json file
-    json clientsJson;
-    ifstream in("added_clients.json");
-    if (in.good())
-    {
-        in >> clientsJson;
-    }
-    in.close();
+    cout << "Enter the ID or name of the client: ";
+    long long id = readClientId(47);
 
     // Find the client with the specified ID
-    bool clientFound = false;
-    for (auto &client : clientsJson)
-    {
-        if (client["id"] == id)
-        {
-            clientFound = true;
-            break;
-        }
-    }
+    bool clientFound = engine.findClient(id) != nullptr;
 
     if (!clientFound)
     {
@@ -1942,24 +1539,19 @@ be:
     }
 
     // Load the data from the portfolio.json file
-    json portfolioJson;
-    ifstream in2("portfolio.json");
-    if (in2.good())
-    {
-        in2 >> portfolioJson;
-    }
-    in2.close();
+    vector<Portfolio> portfolios = engine.loadPortfolios();
 
     // Find the client's portfolio
-    bool portfolioFound = false;
-    for (auto &entry : portfolioJson)
+    Portfolio *portfolio = nullptr;
+    for (auto &entry : portfolios)
     {
-        if (entry["id"] == id)
+        if (entry.id == id)
         {
-            portfolioFound = true;
+            portfolio = &entry;
             break;
         }
     }
+    bool portfolioFound = portfolio != nullptr;
 
     if (!portfolioFound)
     {
@@ -1986,15 +1578,6 @@ be:
         }
     }
 
-    // Load the data from the added_stocks.json file
-    json stockListsJson;
-    ifstream in3("added_stocks.json");
-    if (in3.good())
-    {
-        in3 >> stockListsJson;
-    }
-    in3.close();
-
     // display the header
     c.gotoxy(19, 8);
     cout << "ID";
@@ -2012,72 +1595,48 @@ be:
     c.gotoxy(12, 9);
     c.design(96, "\u2550");
     int i = 10;
-    for (auto &entry : portfolioJson)
-    {
-        if (entry["id"] == id)
-        {
-            for (auto &stock : entry["stocks"])
-            {
-                c.gotoxy(19, i);
-                cout << stock["stockId"];
-                c.gotoxy(27, i);
-                cout << stock["stockName"];
-                c.gotoxy(41, i);
-                cout << stock["numberOfShares"];
-                // find the market price of the stock from added_stocks.json
-                double marketPrice = 0;
-                for (auto &stockList : stockListsJson)
-                {
-                    if (stockList["stockId"] == stock["stockId"])
-                    {
-                        marketPrice = stockList["marketPrice"];
-                        break;
-                    }
-                }
-                c.gotoxy(57, i);
-                cout << marketPrice;
-                c.gotoxy(73, i);
-                cout << stock["purchasedRate"];
-
-                // calculate the total value of the stock
-                double totalValue = marketPrice * stock["numberOfShares"].get<double>();
-                c.gotoxy(90, i);
-                cout << totalValue;
-                i++;
-            }
-            break;
+    if (portfolio != nullptr)
+    {
+        for (auto &stock : portfolio->stocks)
+        {
+            c.gotoxy(19, i);
+            cout << stock.stockId;
+            c.gotoxy(27, i);
+            cout << engine.symbolName(stock.symbol);
+            c.gotoxy(41, i);
+            cout << stock.numberOfShares;
+            // find the market price of the stock from the listed stocks
+            optional<StockList> listing = engine.findStock(stock.stockId);
+            Money marketPrice = listing.has_value() ? listing->getMarketPrice() : Money();
+            c.gotoxy(57, i);
+            cout << marketPrice;
+            c.gotoxy(73, i);
+            cout << stock.purchasedRate;
+
+            // calculate the total value of the stock
+            Money totalValue = marketPrice * stock.numberOfShares;
+            c.gotoxy(90, i);
+            cout << totalValue;
+            i++;
         }
     }
 
     // count number of stocks in the portfolio
-    int numberOfStocks = 0;
-    for (auto &entry : portfolioJson)
-    {
-        if (entry["id"] == id)
-        {
-            numberOfStocks = entry["stocks"].size();
-            break;
-        }
-    }
+    int numberOfStocks = portfolio != nullptr ? portfolio->stocks.size() : 0;
 
     c.gotoxy(18, numberOfStocks + 11);
-    cout << "Enter ID of Stock to Sell     : ";
-    int stockId;
-    cin >> stockId;
+    cout << "Enter ID or Name of Stock to Sell : ";
+    long long stockId = readStockId(18);
 
     // Find the stock with the specified ID
-    bool stockFound = false;
-    float marketPrice = 0;
+    optional<StockList> stock = engine.findStock(stockId);
+    bool stockFound = stock.has_value();
+    Money marketPrice;
     string stockName;
-    for (auto &stock : stockListsJson)
+    if (stockFound)
     {
-        if (stock["stockId"] == stockId)
-        {
-            stockFound = true;
-            marketPrice = stock["marketPrice"];
-            stockName = stock["stockName"];
-            break;
-        }
+        marketPrice = stock->getMarketPrice();
+        stockName = stock->getStockName();
     }
 
     if (!stockFound)
@@ -2111,22 +1670,17 @@ be:
     cin >> numStocks;
 
     // Check if the client has the stock in their portfolio
-    int stockIndex = -1;
-    int numberOfShares = 0;
-    float purchaseRate = 0;
-    for (auto &entry : portfolioJson)
+    long long numberOfShares = 0;
+    Money purchaseRate;
+    if (portfolio != nullptr)
     {
-        if (entry["id"] == id)
+        for (auto &stock : portfolio->stocks)
         {
-            for (int i = 0; i < entry["stocks"].size(); i++)
+            if (stock.stockId == stockId)
             {
-                if (entry["stocks"][i]["stockId"] == stockId)
-                {
-                    stockIndex = i;
-                    numberOfShares = entry["stocks"][i]["numberOfShares"];
-                    purchaseRate = entry["stocks"][i]["purchasedRate"];
-                    break;
-                }
+                numberOfShares = stock.numberOfShares;
+                purchaseRate = stock.purchasedRate;
+                break;
             }
         }
     }
@@ -2156,7 +1710,7 @@ be:
     }
 
     // Calculate the total earnings from the sale
-    float totalEarnings = marketPrice * numStocks;
+    Money totalEarnings = marketPrice * numStocks;
 
     c.gotoxy(47, numberOfStocks + 14);
     cout << "The Selling Price is: " << marketPrice;
@@ -2164,7 +1718,7 @@ be:
     cout << "Purchased Stock at " << purchaseRate << " and Earned " << totalEarnings << " From the Sale";
 
     // Calculate the profit or loss
-    float profitLoss = totalEarnings - (purchaseRate * numStocks);
+    Money profitLoss = totalEarnings - (purchaseRate * numStocks);
 
     // Display the profit or loss
     c.gotoxy(51, numberOfStocks + 16);
@@ -2183,52 +1737,8 @@ be:
             displayMenuClient();
     }
 
-    // Update the client's balance
-    for (auto &entry : portfolioJson)
-    {
-        if (entry["id"] == id)
-        {
-            float balance = entry["balance"].get<float>();
-            balance += totalEarnings;
-            int balance_cents = round(balance * 100);
-            entry["balance"] = balance_cents / 100.0;
-            break;
-        }
-    }
-
-    // Update the client's portfolio
-    for (auto &entry : portfolioJson)
-    {
-        if (entry["id"] == id)
-        {
-            int numberOfShares = entry["stocks"][stockIndex]["numberOfShares"].get<int>();
-            int newNumberOfShares = numberOfShares - numStocks;
-            if (newNumberOfShares == 0)
-            {
-                // Remove the stock from the portfolio if the client no longer has any shares
-                entry["stocks"].erase(entry["stocks"].begin() + stockIndex);
-            }
-            else
-            {
-                // Update the number of shares if the client still has some left
-                entry["stocks"][stockIndex]["numberOfShares"] = newNumberOfShares;
-            }
-            break;
-        }
-    }
-
-    // Save the updated data to the portfolio.json file
-    ofstream out2("portfolio.json");
-    out2 << portfolioJson.dump(4);
-    out2.close();
-
-    // Get the current time
-    time_t t;
-    time(&t);
-    string sellTime = ctime(&t);
-
-    // // Call the sellHistory function to store the transaction in the transactions.json file
-    sellHistory(id, stockId, stockName, numStocks, marketPrice, totalEarnings, sellTime);
+    // Update the client's balance and portfolio, and store the sale transaction
+    engine.sellStock(id, stockId, numStocks);
 
     c.gotoxy(41, numberOfStocks + 19);
     c.design(42, "\u2500");
@@ -2253,189 +1763,26 @@ be:
     }
 }
 
-void NepalStockAnalyzer::buyHistory(int id, int stockId, string stockName, int numStocks, float price, float totalCost, string time)
-{
-    // Load the data from the transactions.json file
-    json transactionsJson;
-    ifstream in("transactions.json");
-    if (in.good())
-    {
-        in >> transactionsJson;
-    }
-    in.close();
-
-    // Load the data from the clients.json file
-    json clientsJson;
-    ifstream in2("added_clients.json");
-    if (in2.good())
-    {
-        in2 >> clientsJson;
-    }
-    in2.close();
-
-    // Find the client's name
-    string clientName;
-    for (auto &client : clientsJson)
-    {
-        if (client["id"] == id)
-        {
-            clientName = client["name"];
-            break;
-        }
-    }
-
-    // Check if the client already has an entry in the transactionsJson object
-    bool clientFound = false;
-    for (auto &client : transactionsJson)
-    {
-        if (client.find(clientName) != client.end())
-        {
-            clientFound = true;
-            int priceCents = round(price * 100);
-            int totalCostCents = round(totalCost * 100);
-            client[clientName].push_back({{"id", id}, {"stockId", stockId}, {"stockName", stockName}, {"numberOfShares", numStocks}, {"price", priceCents / 100.0}, {"totalCost", totalCostCents / 100.0}, {"type", "purchase"}, {"time", time}});
-            break;
-        }
-    }
-
-    if (!clientFound)
-    {
-        int priceCents = round(price * 100);
-        int totalCostCents = round(totalCost * 100);
-        // Add a new entry for the client
-        transactionsJson.push_back({{"name", clientName}, {"transactions", {{{"id", id}, {"stockId", stockId}, {"stockName", stockName}, {"numberOfShares", numStocks}, {"price", priceCents / 100.0}, {"totalCost", totalCostCents / 100.0}, {"type", "purchase"}, {"time", time}}}}});
-    }
-
-    // Save the updated data to the transactions.json file
-    ofstream out("transactions.json");
-    out << transactionsJson.dump(4);
-    out.close();
-}
-
-void NepalStockAnalyzer::sellHistory(int id, int stockId, string stockName, int numStocks, float price, float totalCost, string time)
-{
-    // Load the data from the transactions.json file
-    json transactionsJson;
-    ifstream in("transactions.json");
-    if (in.good())
-    {
-        in >> transactionsJson;
-    }
-    in.close();
-
-    // Load the data from the clients.json file
-    json clientsJson;
-    ifstream in2("added_clients.json");
-    if (in2.good())
-    {
-        in2 >> clientsJson;
-    }
-    in2.close();
-
-    // Find the client's name
-    string clientName;
-    for (auto &client : clientsJson)
-    {
-        if (client["id"] == id)
-        {
-            clientName = client["name"];
-            break;
-        }
-    }
-
-    // Check if the clientalready has an entry in the transactionsJson object
-    bool clientFound = false;
-    for (auto &entry : transactionsJson)
-    {
-        if (entry["name"] == clientName)
-        {
-            clientFound = true;
-            int priceCents = round(price * 100);
-            int totalCostCents = round(totalCost * 100);
-            // Add the sell transaction to the client's entry in the transactionsJson object
-            entry["transactions"].push_back({{"id", id}, {"stockId", stockId}, {"stockName", stockName}, {"numberOfShares", numStocks}, {"price", priceCents / 100.0}, {"totalCost", totalCostCents / 100.0}, {"type", "sell"}, {"time", time}});
-            break;
-        }
-    }
-    // If the client doesn't have an entry in the transactionsJson object, create a new entry for them
-    if (!clientFound)
-    {
-        int priceCents = round(price * 100);
-        price = priceCents / 100.0;
-        int totalCostCents = round(totalCost * 100);
-        totalCost = totalCostCents / 100.0;
-        transactionsJson.push_back({{"name", clientName}, {"transactions", {{{"id", id}, {"stockId", stockId}, {"stockName", stockName}, {"numberOfShares", numStocks}, {"price", price}, {"totalCost", totalCost}, {"type", "sell"}, {"time", time}}}}});
-    }
-    // Save the updated transactionsJson object to the transactions.json file
-    ofstream out("transactions.json");
-    out << transactionsJson.dump(4);
-    out.close();
-}
-
 void NepalStockAnalyzer::displayTransactions()
 {
 ce:
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(24, 4);
     c.design(24, "\u2592");
     cout << " SEARCH CLIENT ACCOUNT ";
     c.design(24, "\u2592");
     c.border();
     c.gotoxy(43, 7);
-    cout << "Enter The Client ID To Search: ";
-    int id;
-    cin >> id;
+    cout << "Enter The Client ID or Name To Search: ";
+    long long id = readClientId(43);
 
-    // Load the data from the transactions.json file
-    json transactionsJson;
-    ifstream in("transactions.json");
-    if (in.good())
-    {
-        in >> transactionsJson;
-    }
-    in.close();
-
-    // Load the data from the clients.json file
-    json clientsJson;
-    ifstream in2("added_clients.json");
-    if (in2.good())
-    {
-        in2 >> clientsJson;
-    }
-    in2.close();
-
-    // Find the client's name
+    // Find the client's name and their transactions
     string clientName;
-    bool clientFound = false;
-    for (auto &client : clientsJson)
-    {
-        if (client["id"] == id)
-        {
-            clientName = client["name"];
-            clientFound = true;
-            break;
-        }
-    }
+    vector<Transaction> transactions;
+    bool clientFound = engine.clientTransactions(id, clientName, transactions);
 
     // count the number of transactions for the client
-    int numTransactions = 0;
-
-    // Iterate through the top level of the JSON object
-    for (auto &client : transactionsJson)
-    {
-        // Get the transactions array for the current client
-        auto transactions = client["transactions"];
-        // Iterate through the transactions array
-        for (auto &transaction : transactions)
-        {
-            // Check if the ID of the client in the current transaction matches the user-entered ID
-            if (transaction["id"] == id)
-            {
-                // If it matches, increment the transactionCount variable
-                numTransactions++;
-            }
-        }
-    }
+    int numTransactions = transactions.size();
 
     if (!clientFound)
     {
@@ -2499,29 +1846,23 @@ ce:
     c.gotoxy(11, 12);
     c.design(98, "\u2550");
     int i = 13;
-    for (auto &client : transactionsJson)
-    {
-        for (auto &transaction : client["transactions"])
-        {
-            if (transaction["id"] == id)
-            {
-                c.gotoxy(15, i);
-                cout << transaction["stockId"];
-                c.gotoxy(22, i);
-                cout << transaction["stockName"];
-                c.gotoxy(35, i);
-                cout << transaction["numberOfShares"];
-                c.gotoxy(45, i);
-                cout << transaction["price"];
-                c.gotoxy(55, i);
-                cout << transaction["totalCost"];
-                c.gotoxy(65, i);
-                cout << transaction["type"];
-                c.gotoxy(78, i);
-                cout << transaction["time"];
-                i++;
-            }
-        }
+    for (auto &transaction : transactions)
+    {
+        c.gotoxy(15, i);
+        cout << transaction.stockId;
+        c.gotoxy(22, i);
+        cout << engine.symbolName(transaction.symbol);
+        c.gotoxy(35, i);
+        cout << transaction.numberOfShares;
+        c.gotoxy(45, i);
+        cout << transaction.price;
+        c.gotoxy(55, i);
+        cout << transaction.totalCost;
+        c.gotoxy(65, i);
+        cout << transaction.type;
+        c.gotoxy(78, i);
+        cout << formatTime(transaction.timestamp);
+        i++;
     }
     c.gotoxy(30, numTransactions + 18);
     cout << "Press 'Y' to retry or any other key to return to main menu. ";
@@ -2547,63 +1888,37 @@ ce:
 void NepalStockAnalyzer::displayClientPortfolio()
 {
 de:
-    system("CLS");
+    c.clearScreen();
     c.gotoxy(24, 4);
     c.design(24, "\u2592");
     cout << " SEARCH CLIENT ACCOUNT ";
     c.design(24, "\u2592");
     c.border();
     c.gotoxy(43, 7);
-    cout << "Enter The Client ID To Search: ";
-    int id;
-    cin >> id;
-
-    // Load the data from the portfolio.json file
-    json portfolioJson;
-    ifstream in("portfolio.json");
-    if (in.good())
-    {
-        in >> portfolioJson;
-    }
-    in.close();
-
-    json addedStocksJson;
-    ifstream addedStocksIn("added_stocks.json");
-    if (addedStocksIn.good())
-    {
-        addedStocksIn >> addedStocksJson;
-    }
-    addedStocksIn.close();
-
-    // Search for the client with the given ID
+    cout << "Enter The Client ID or Name To Search: ";
+    long long id = readClientId(43);
+
+    // An earlier date shows the portfolio as it was at the end of that day; a day its month does not
+    // have is asked for again, as the importer refuses it
+    int64_t day = 0;
+    string date;
+    do
+    {
+        c.gotoxy(43, 8);
+        cout << "Enter Date (YYYY-MM-DD) or 0 for Today : ";
+        cin >> date;
+    } while (date != "0" && !csvimport::parseDate(date, day));
+    bool asOf = date != "0";
+
+    // Search for the client with the given ID and value their holdings
     string clientName;
-    vector<pair<string, int>> stockPurchased;
-    bool clientFound = false;
-    for (auto &client : portfolioJson)
-    {
-        if (client["id"] == id)
-        {
-            clientName = client["name"];
-            for (auto &stock : client["stocks"])
-            {
-                string stockName = stock["stockName"];
-                int stockQuantity = stock["numberOfShares"];
-                stockPurchased.push_back({stockName, stockQuantity});
-            }
-            clientFound = true;
-            break;
-        }
-    }
+    Money balance;
+    vector<PortfolioLine> stockPurchased;
+    bool clientFound = asOf ? engine.clientPortfolioAsOf(id, day + 86399, clientName,
+                                                         balance, stockPurchased)
+                            : engine.clientPortfolio(id, clientName, stockPurchased);
 
-    int numStocks = 0;
-    for (auto &client : portfolioJson)
-    {
-        if (client["id"] == id)
-        {
-            numStocks = client["stocks"].size();
-            break;
-        }
-    }
+    int numStocks = stockPurchased.size();
 
     // Display the client's portfolio if they were found
     if (clientFound)
@@ -2617,6 +1932,8 @@ de:
         c.gotoxy(46, 10);
         cout << "Detail Information of ";
         transform(clientName.begin(), clientName.end(), ostream_iterator<char>(std::cout), ::toupper);
+        if (asOf)
+            cout << " on " << date;
         cout << ":" << endl;
 
         c.gotoxy(28, 11);
@@ -2626,23 +1943,16 @@ de:
         int i = 13;
         for (auto &stock : stockPurchased)
         {
-            // Find the market price of the stock
-            float marketPrice = 0;
-            for (auto &addedStock : addedStocksJson)
-            {
-                if (addedStock["stockName"] == stock.first)
-                {
-                    marketPrice = addedStock["marketPrice"];
-                    break;
-                }
-            }
-            // Calculate the value of the stock
-            float stockValue = marketPrice * stock.second;
             c.gotoxy(37, i);
-            cout << "Stock Name: " << stock.first << ", Shares: " << stock.second << ", Value: " << stockValue << endl;
+            cout << "Stock Name: " << stock.stockName << ", Shares: " << stock.numberOfShares << ", Value: " << stock.value << endl;
             // cout << stock.first << ": " << stock.second << " (" << stockValue << ")" << endl;
             i++;
         }
+        if (asOf)
+        {
+            c.gotoxy(37, i);
+            cout << "Balance: " << balance << endl;
+        }
         c.gotoxy(30, numStocks + 17);
         cout << "Press 'Y' to retry or any other key to return to main menu. ";
         char choice;
@@ -2698,6 +2008,41 @@ int main()
     // set background color to black and text color to white
     system("color 0F");
 
+    // draw through the frame buffer, one write per screen instead of one per glyph
+    screen().install();
+
+    // sync every save to the disk if durable writes are enabled in the configuration
+    json storageConfig = loadJson("configuration/storage.json");
+    durableWrites = storageConfig.is_object() && storageConfig.value("fsync", false);
+
+    // snapshot and rotate the event log in the background if compaction is enabled in the configuration
+    json compactionConfig = storageConfig.is_object() ? storageConfig["compaction"] : json();
+    bool compactionOn = compactionConfig.is_object() && compactionConfig.value("enabled", false);
+    static Compactor compactor(".", thread::hardware_concurrency(), !compactionOn || compactionConfig.value("keepArchive", true));
+    if (compactionOn)
+    {
+        compactor.start(compactionConfig.value("intervalMinutes", 60) * 60,
+                        compactionConfig.value("minJournalMegabytes", 64LL) << 20);
+    }
+
+    json diagnostics = loadJson("configuration/diagnostics.json");
+
+    // export the operation metrics in the background if they are enabled in the configuration
+    static MetricsExporter exporter;
+    json metricsConfig = diagnostics["metrics"];
+    if (metricsConfig.is_object() && metricsConfig.value("enabled", false))
+    {
+        exporter.start(metricsConfig.value("exportPath", "metrics.prom"), metricsConfig.value("intervalSeconds", 15));
+    }
+
+    // record trace spans from the start if tracing is enabled, they are saved on logout
+    json traceConfig = diagnostics["trace"];
+    if (traceConfig.is_object())
+    {
+        traceOutputPath() = traceConfig.value("output", "trace.json");
+        setTracing(traceConfig.value("enabled", false));
+    }
+
     StockAnalyzer sa;
     NepalStockAnalyzer nsa;
 
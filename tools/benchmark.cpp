@@ -0,0 +1,300 @@
+/*
+    File name: benchmark.cpp
+    Description: Benchmark suite for the stock engine. Every engine operation is run against
+                 synthetic books of increasing size and reported as ops/s, p50/p99/p999 latency
+                 and allocations per operation. Results are written as JSON so that runs of
+                 different releases can be compared.
+
+    Usage:
+        - g++ -O2 -std=c++17 tools/benchmark.cpp -o benchmark.exe
+        - benchmark.exe --sizes small,medium,large --budget 2 --out benchmark.json
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+#include <new>
+#include <cstdlib>
+
+#include "../includes/engine.hpp"
+#include "../includes/generator.hpp"
+
+using namespace std;
+
+// Global allocation counters, every operator new of the process goes through them
+static atomic<long long> allocationCount(0);
+static atomic<long long> allocationBytes(0);
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocationBytes.fetch_add(size, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+// Kept out of line so the compiler does not pair the inlined free() with new expressions
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void operator delete(void *p) noexcept { free(p); }
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Book sizes the suite can run against
+struct DatasetSize
+{
+    string name;
+    long long clients;
+    int stocks;
+    long long trades;
+};
+
+struct BenchmarkResult
+{
+    string size;
+    string operation;
+    long long iterations;
+    double opsPerSecond;
+    long long p50;
+    long long p99;
+    long long p999;
+    double allocationsPerOp;
+    double bytesPerOp;
+};
+
+// Nearest rank percentile of sorted latencies
+long long percentile(const vector<long long> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t)ceil(p * sorted.size());
+    return sorted[min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+// Runs op until the time budget is used up and summarizes its latency distribution
+BenchmarkResult measure(const string &size, const string &operation, double budget, long long maxIterations,
+                        const function<void(long long)> &op)
+{
+    vector<long long> latencies;
+    long long allocations = 0, bytes = 0;
+    Stopwatch total;
+    for (long long i = 0; i < maxIterations && (i < 3 || total.seconds() < budget); i++)
+    {
+        long long countBefore = allocationCount.load(memory_order_relaxed);
+        long long bytesBefore = allocationBytes.load(memory_order_relaxed);
+        Stopwatch sw;
+        op(i);
+        latencies.push_back(sw.nanoseconds());
+        allocations += allocationCount.load(memory_order_relaxed) - countBefore;
+        bytes += allocationBytes.load(memory_order_relaxed) - bytesBefore;
+    }
+    double elapsed = total.seconds();
+
+    sort(latencies.begin(), latencies.end());
+    long long n = latencies.size();
+    return {size, operation, n, n / elapsed, percentile(latencies, 0.50), percentile(latencies, 0.99),
+            percentile(latencies, 0.999), double(allocations) / n, double(bytes) / n};
+}
+
+vector<BenchmarkResult> runSize(const DatasetSize &size, double budget, long long maxIterations)
+{
+    // Every size gets a fresh book in its own directory, the engine works on the current directory
+    filesystem::path dir = filesystem::temp_directory_path() / ("nsa-bench-" + size.name);
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+
+    GeneratorConfig config;
+    config.clients = size.clients;
+    config.stocks = size.stocks;
+    config.trades = size.trades;
+    config.outDir = dir.string();
+    LoadGenerator generator(config);
+    generator.run();
+
+    filesystem::path home = filesystem::current_path();
+    filesystem::current_path(dir);
+
+    StockEngine engine;
+    mt19937_64 gen(7);
+    auto client = [&]() { return int(gen() % size.clients + 1); };
+    auto stock = [&]() { return int(gen() % size.stocks + 1); };
+
+    vector<BenchmarkResult> results;
+    cerr << "running " << size.name << " (" << size.clients << " clients, " << size.stocks << " stocks, " << size.trades
+         << " trades)" << endl;
+
+    results.push_back(measure(size.name, "updateStockPrices", budget, maxIterations, [&](long long) {
+        engine.updateStockPrices();
+    }));
+    results.push_back(measure(size.name, "depositMoney", budget, maxIterations, [&](long long) {
+        engine.depositMoney(client(), Money::fromPaisa(10000000));
+    }));
+
+    // Purchases remember what they bought so that the sales have shares to sell
+    vector<pair<int, int>> bought;
+    results.push_back(measure(size.name, "purchaseStock", budget, maxIterations, [&](long long) {
+        int id = client(), stockId = stock();
+        if (engine.purchaseStock(id, stockId, 10).status == TRADE_OK)
+            bought.push_back({id, stockId});
+    }));
+    results.push_back(measure(size.name, "sellStock", budget, maxIterations, [&](long long i) {
+        if (bought.empty())
+            return;
+        auto &holding = bought[i % bought.size()];
+        engine.sellStock(holding.first, holding.second, 1);
+    }));
+
+    results.push_back(measure(size.name, "buyHistory", budget, maxIterations, [&](long long) {
+        engine.buyHistory(client(), stock(), "NABIL", 10, Money::fromPaisa(50000), Money::fromPaisa(500000), 1672650000);
+    }));
+    results.push_back(measure(size.name, "clientPortfolio", budget, maxIterations, [&](long long) {
+        string name;
+        vector<PortfolioLine> lines;
+        engine.clientPortfolio(client(), name, lines);
+    }));
+    results.push_back(measure(size.name, "clientTransactions", budget, maxIterations, [&](long long) {
+        string name;
+        vector<Transaction> transactions;
+        engine.clientTransactions(client(), name, transactions);
+    }));
+    // A month of one client's trades and a day of one stock's trades
+    results.push_back(measure(size.name, "clientTradeRange", budget, maxIterations, [&](long long) {
+        engine.clientTransactionsBetween(client(), config.startTime, config.startTime + 30 * 86400);
+    }));
+    results.push_back(measure(size.name, "stockTradeRange", budget, maxIterations, [&](long long i) {
+        int64_t day = config.startTime + (i % config.days) * 86400;
+        engine.stockTransactionsBetween(stock(), day, day + 86400);
+    }));
+    results.push_back(measure(size.name, "aggregateTrades", budget, maxIterations, [&](long long i) {
+        AggregateQuery query;
+        query.groupBy = GroupBy(i % 3);
+        engine.aggregateTrades(query);
+    }));
+    results.push_back(measure(size.name, "bookValue", budget, maxIterations, [&](long long) {
+        engine.bookValue();
+    }));
+    results.push_back(measure(size.name, "screenStocks", budget, maxIterations, [&](long long) {
+        StockScreen screen;
+        screen.minPrice = 50000;
+        screen.minChangeBasisPoints = 100;
+        engine.screenStocks(screen);
+    }));
+    results.push_back(measure(size.name, "marketIndex", budget, maxIterations, [&](long long) {
+        engine.marketIndex();
+    }));
+
+    // Settles a batch of one change per hundred clients
+    results.push_back(measure(size.name, "settleBalances", budget, maxIterations, [&](long long i) {
+        vector<pair<long long, Money>> changes;
+        for (long long k = 0; k < max(1LL, size.clients / 100); k++)
+            changes.push_back({client(), Money::fromPaisa(i % 2 == 0 ? 2500 : -2500)});
+        engine.settleBalances(changes);
+    }));
+
+    filesystem::current_path(home);
+    filesystem::remove_all(dir);
+    return results;
+}
+
+void usage()
+{
+    cout << "Usage: benchmark [--sizes small,medium,large] [--budget SECONDS] [--max-iterations N] [--out FILE] [--trace FILE]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    const vector<DatasetSize> sizes = {
+        {"small", 100, 20, 1000},
+        {"medium", 10000, 100, 100000},
+        {"large", 100000, 500, 1000000},
+    };
+
+    string selected = "small,medium";
+    string outPath = "benchmark.json";
+    double budget = 2.0;
+    long long maxIterations = 100000;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--sizes")
+                selected = value;
+            else if (arg == "--budget")
+                budget = stod(value);
+            else if (arg == "--max-iterations")
+                maxIterations = stoll(value);
+            else if (arg == "--out")
+                outPath = value;
+            else if (arg == "--trace")
+            {
+                traceOutputPath() = value;
+                setTracing(true);
+            }
+            else
+                throw invalid_argument("unknown option " + arg);
+        }
+
+        vector<BenchmarkResult> results;
+        for (auto &size : sizes)
+        {
+            if (("," + selected + ",").find("," + size.name + ",") == string::npos)
+                continue;
+            for (auto &result : runSize(size, budget, maxIterations))
+                results.push_back(result);
+        }
+
+        cout << left << setw(8) << "size" << setw(20) << "operation" << right << setw(10) << "iters" << setw(12) << "ops/s"
+             << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(12) << "p999 us" << setw(12) << "allocs/op"
+             << setw(12) << "KB/op" << endl;
+
+        json report;
+        report["version"] = 1;
+        report["timestamp"] = (long long)time(nullptr);
+        report["budgetSeconds"] = budget;
+        report["results"] = json::array();
+        for (auto &r : results)
+        {
+            cout << left << setw(8) << r.size << setw(20) << r.operation << right << setw(10) << r.iterations << fixed
+                 << setprecision(1) << setw(12) << r.opsPerSecond << setw(12) << r.p50 / 1000.0 << setw(12)
+                 << r.p99 / 1000.0 << setw(12) << r.p999 / 1000.0 << setw(12) << r.allocationsPerOp << setw(12)
+                 << r.bytesPerOp / 1024.0 << endl;
+
+            report["results"].push_back({{"size", r.size},
+                                         {"operation", r.operation},
+                                         {"iterations", r.iterations},
+                                         {"opsPerSecond", r.opsPerSecond},
+                                         {"p50Ns", r.p50},
+                                         {"p99Ns", r.p99},
+                                         {"p999Ns", r.p999},
+                                         {"allocationsPerOp", r.allocationsPerOp},
+                                         {"bytesPerOp", r.bytesPerOp}});
+        }
+        saveJson(outPath, report, 2);
+        if (isTracing())
+            dumpTrace();
+    }
+    catch (const exception &e)
+    {
+        cerr << "benchmark: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}
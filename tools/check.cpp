@@ -0,0 +1,344 @@
+/*
+    File name: check.cpp
+    Description: Consistency checks for the Nepal Stock Analyzer. Every check builds a book of its own
+                 in a scratch directory, with random engine operations or the load generator, and
+                 compares two ways of getting at the same data, such as what the engine kept as it
+                 went against a rebuild from scratch. It exits with 1 if any check fails.
+                   summaries  the daily views after the operations match rebuildSummaries byte for byte
+                   ledger     the stored portfolios and client lists match a replay of the events,
+                              and a replay from a checkpoint on several threads matches a full one
+                   columnar   every table of a generated book decodes from its columnar export to
+                              the rows of its CSV export
+                   reconcile  a generated book reconciles clean, its holdings and balances still
+                              add up after engine operations on it, and a changed balance is found
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/check.cpp -o check.exe
+        - check.exe --dir check-books --operations 800
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <filesystem>
+#include <functional>
+
+#include "../includes/engine.hpp"
+#include "../includes/generator.hpp"
+#include "../includes/exporter.hpp"
+#include "../includes/reconciliation.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: check [summaries] [ledger] [columnar] [reconcile] [--dir DIR] [--operations N] [--seed N] [--keep]" << endl;
+    cout << "  --dir DIR       where the scratch books are made (check-books)" << endl;
+    cout << "  --operations N  random operations per book (800)" << endl;
+    cout << "  --keep          leave the books behind to look at" << endl;
+}
+
+// Settings every check gets
+struct CheckOptions
+{
+    string dir = "check-books";
+    int operations = 800;
+    unsigned seed = 2023;
+};
+
+// Runs the function with an empty directory as the working directory, the way the engine expects
+// its book
+void inBook(const string &dir, const function<void()> &function)
+{
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir);
+    filesystem::path previous = filesystem::current_path();
+    filesystem::current_path(dir);
+    try
+    {
+        function();
+    }
+    catch (...)
+    {
+        filesystem::current_path(previous);
+        throw;
+    }
+    filesystem::current_path(previous);
+}
+
+// A book driven by random operations: registrations, removals, deposits, purchases, sales and
+// settlements. It starts with a few stocks and clients; every few clients share a name, so sales
+// land in entries of others.
+class RandomBook
+{
+private:
+    vector<long long> stocks, clients;
+    mt19937 random;
+
+    void registerClient(StockEngine &engine)
+    {
+        int n = (int)clients.size();
+        string name = n % 7 == 0 ? "Same Name" : "Client " + to_string(n);
+        clients.push_back(engine.addClient(Client(name, 0, "Kathmandu", "01/01/1990")));
+    }
+
+public:
+    RandomBook(StockEngine &engine, unsigned seed) : random(seed)
+    {
+        for (int i = 0; i < 6; i++)
+            stocks.push_back(engine.addStock(StockList(0, "STOCK" + to_string(i), Money::fromPaisa(10000 + 2500 * i))));
+        for (int i = 0; i < 12; i++)
+            registerClient(engine);
+    }
+
+    void run(StockEngine &engine, int operations)
+    {
+        for (int i = 0; i < operations; i++)
+        {
+            long long client = clients[random() % clients.size()];
+            long long stock = stocks[random() % stocks.size()];
+            int kind = (int)(random() % 100);
+            if (kind < 3)
+                registerClient(engine);
+            else if (kind < 4)
+                engine.removeClient(client);
+            else if (kind < 20)
+                engine.depositMoney(client, Money::fromPaisa(100000 + (long long)(random() % 5000000)));
+            else if (kind < 60)
+                engine.purchaseStock(client, stock, 1 + (int)(random() % 40));
+            else if (kind < 95)
+                engine.sellStock(client, stock, 1 + (int)(random() % 20));
+            else
+            {
+                long long other = clients[random() % clients.size()];
+                engine.settleBalances({{client, Money::fromPaisa(-(long long)(random() % 20000))},
+                                       {other, Money::fromPaisa((long long)(random() % 20000))}});
+            }
+        }
+    }
+};
+
+// The daily views kept by every operation against a rebuild of them from the ledger
+bool checkSummaries(const CheckOptions &options)
+{
+    string kept, rebuilt;
+    inBook(options.dir + "/summaries", [&]() {
+        {
+            StockEngine engine;
+            RandomBook(engine, options.seed).run(engine, options.operations);
+        }
+        readWholeFile("summaries.json", kept);
+        filesystem::remove("summaries.json");
+        StockEngine engine;
+        engine.rebuildSummaries();
+        readWholeFile("summaries.json", rebuilt);
+    });
+    if (kept.empty() || kept != rebuilt)
+    {
+        cout << "summaries: the kept views (" << kept.size() << " bytes) differ from the rebuilt ones ("
+             << rebuilt.size() << " bytes)" << endl;
+        return false;
+    }
+    cout << "summaries: the kept views match a rebuild byte for byte (" << kept.size() << " bytes)" << endl;
+    return true;
+}
+
+// The stored portfolios and client lists against a replay of events.json. A checkpoint is taken
+// halfway, and the replay from it on several threads must give what a full replay on one gives.
+bool checkLedger(const CheckOptions &options)
+{
+    bool same = true;
+    inBook(options.dir + "/ledger", [&]() {
+        StockEngine engine;
+        RandomBook book(engine, options.seed);
+        book.run(engine, options.operations / 2);
+        ledger::saveCheckpoint(".", LedgerRebuild(".", 1).run());
+        book.run(engine, options.operations - options.operations / 2);
+
+        LedgerCheckpoint replayed = LedgerRebuild(".", 4).run();
+        LedgerCheckpoint full = LedgerRebuild(".", 1).run(true);
+        auto clientId = [](const Client &client) { return client.getId(); };
+        auto portfolioId = [](const Portfolio &portfolio) { return portfolio.id; };
+        vector<pair<string, vector<long long>>> differ = {
+            {"portfolio.json",
+             ledger::differences(loadRecords<Portfolio>("portfolio.json"), replayed.portfolios, portfolioId)},
+            {"added_clients.json",
+             ledger::differences(loadRecords<Client>("added_clients.json"), replayed.clients, clientId)},
+            {"removed_clients.json",
+             ledger::differences(loadRecords<Client>("removed_clients.json"), replayed.removed, clientId)},
+        };
+        for (auto &file : differ)
+        {
+            cout << "ledger: " << file.first << ", " << file.second.size() << " records differ from the replay" << endl;
+            same = same && file.second.empty();
+        }
+
+        string fromCheckpoint, fromStart;
+        records::writeValue(fromCheckpoint, replayed, 0, 0);
+        records::writeValue(fromStart, full, 0, 0);
+        cout << "ledger: " << replayed.events << " events, the replay from the checkpoint "
+             << (fromCheckpoint == fromStart ? "matches" : "differs from") << " the full replay" << endl;
+        same = same && fromCheckpoint == fromStart && replayed.events > 0;
+    });
+    return same;
+}
+
+// The columnar export of every table of a generated book against its CSV export
+bool checkColumnar(const CheckOptions &options)
+{
+    string dir = options.dir + "/columnar";
+    filesystem::remove_all(dir);
+    filesystem::create_directories(dir + "/exports");
+    GeneratorConfig config;
+    config.clients = 500;
+    config.stocks = 40;
+    config.trades = options.operations * 50LL;
+    config.seed = options.seed;
+    config.outDir = dir;
+    LoadGenerator(config).run();
+
+    bool same = true;
+    for (ExportFormat format : {CSV_FORMAT, COLUMNAR_FORMAT})
+    {
+        // small row groups, so every table has several
+        Exporter exporter(dir, format, thread::hardware_concurrency(), 1000);
+        string extension = format == CSV_FORMAT ? ".csv" : ".nsac";
+        exporter.exportTransactions(dir + "/exports/transactions" + extension);
+        exporter.exportBalances(dir + "/exports/balances" + extension);
+        exporter.exportHoldings(dir + "/exports/holdings" + extension);
+        exporter.exportPrices(dir + "/exports/prices" + extension);
+    }
+    for (const char *table : {"transactions", "balances", "holdings", "prices"})
+    {
+        string base = dir + "/exports/" + table, what;
+        long long rows = compareExports(base + ".nsac", base + ".csv", what);
+        cout << "columnar: " << table << ", " << rows << " rows " << (what.empty() ? "match the CSV" : what) << endl;
+        same = same && what.empty() && rows > 0;
+    }
+    return same;
+}
+
+// Reconciliation of a generated book, before and after the engine works on it
+bool checkReconcile(const CheckOptions &options)
+{
+    bool passed = true;
+    auto expect = [&](bool condition, const string &what) {
+        cout << "reconcile: " << what << (condition ? "" : ": FAILED") << endl;
+        passed = passed && condition;
+    };
+    inBook(options.dir + "/reconcile", [&]() {
+        GeneratorConfig config;
+        config.clients = 500;
+        config.stocks = 40;
+        config.trades = options.operations * 10LL; // every engine operation rewrites the book
+        config.seed = options.seed;
+        LoadGenerator(config).run();
+        ReconcileReport report = ReconcileJob(".", 4).run();
+        expect(report.clean() && report.accounts > 0 && report.unrecorded.empty(),
+               "the generated book of " + to_string(report.accounts) + " clients is clean");
+
+        // Sales of clients who share a name land in entries of others, so only the sums must hold
+        {
+            StockEngine engine;
+            mt19937 random(options.seed);
+            for (int i = 0; i < options.operations; i++)
+            {
+                long long client = 1 + (long long)(random() % config.clients);
+                long long stock = 1 + (long long)(random() % config.stocks);
+                int kind = (int)(random() % 4);
+                if (kind == 0)
+                    engine.depositMoney(client, Money::fromPaisa(100000 + (long long)(random() % 5000000)));
+                else if (kind == 1)
+                    engine.purchaseStock(client, stock, 1 + (int)(random() % 40));
+                else if (kind == 2)
+                    engine.sellStock(client, stock, 1 + (int)(random() % 20));
+                else
+                    engine.settleBalances({{client, Money::fromPaisa(-(long long)(random() % 20000))}});
+            }
+        }
+        report = ReconcileJob(".", 4).run();
+        expect(!report.baseline.empty() && report.holdings.empty() && report.balances.empty(),
+               "after " + to_string(options.operations) + " engine operations, holdings and balances add up from " +
+                   (report.baseline.empty() ? "nothing" : report.baseline));
+
+        vector<Portfolio> portfolios = loadRecords<Portfolio>("portfolio.json");
+        portfolios[portfolios.size() / 2].balance += Money::fromPaisa(1);
+        saveRecords("portfolio.json", portfolios, 4);
+        report = ReconcileJob(".", 4).run();
+        expect(report.balances.size() == 1 && report.balances[0].clientId == portfolios[portfolios.size() / 2].id,
+               "a balance changed by a paisa is found");
+    });
+    return passed;
+}
+
+int main(int argc, char *argv[])
+{
+    CheckOptions options;
+    vector<string> names;
+    bool keep = false;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (arg == "--keep")
+            {
+                keep = true;
+                continue;
+            }
+            if (arg[0] != '-')
+            {
+                names.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                options.dir = value;
+            else if (arg == "--operations")
+                options.operations = stoi(value);
+            else if (arg == "--seed")
+                options.seed = (unsigned)stoul(value);
+            else
+                throw invalid_argument("unknown option " + arg);
+        }
+
+        vector<pair<string, function<bool(const CheckOptions &)>>> checks = {
+            {"summaries", checkSummaries},
+            {"ledger", checkLedger},
+            {"columnar", checkColumnar},
+            {"reconcile", checkReconcile},
+        };
+        if (names.empty())
+        {
+            for (auto &check : checks)
+                names.push_back(check.first);
+        }
+
+        bool passed = true;
+        for (auto &name : names)
+        {
+            auto check = find_if(checks.begin(), checks.end(), [&](const auto &one) { return one.first == name; });
+            if (check == checks.end())
+                throw invalid_argument("no check called " + name);
+            passed = check->second(options) && passed;
+        }
+        if (!keep)
+            filesystem::remove_all(options.dir);
+        cout << (passed ? "all checks passed" : "some checks failed") << endl;
+        return passed ? 0 : 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "check: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+}
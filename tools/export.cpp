@@ -0,0 +1,131 @@
+/*
+    File name: export.cpp
+    Description: Exports the transactions, balances, holdings and prices of a book to CSV or to the
+                 compact columnar format described in includes/exporter.hpp. The storage files are
+                 streamed, so memory stays bounded whatever the size of the book. With --verify it
+                 exports nothing and instead checks that the columnar and the CSV export of each
+                 table in the output directory hold the same rows.
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/export.cpp -o export.exe
+        - export.exe --dir data --format columnar --tables transactions,prices --out exports
+        - export.exe --verify --tables transactions,prices --out exports
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <filesystem>
+
+#include "../includes/exporter.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: export [--dir DIR] [--format csv|columnar] [--tables transactions,balances,holdings,prices]"
+            " [--threads N] [--row-group N] [--out DIR] [--verify]" << endl;
+    cout << "  --verify  decode the .nsac of each table in DIR and compare its rows with the .csv" << endl;
+}
+
+// Compares the two exports of every table, false if any differ
+bool verify(const string &outDir, const string &tables)
+{
+    bool same = true;
+    stringstream list(tables);
+    string table, what;
+    while (getline(list, table, ','))
+    {
+        string base = outDir + "/" + table;
+        long long rows = compareExports(base + ".nsac", base + ".csv", what);
+        cout << left << setw(14) << table << right << setw(14) << rows << " rows " << (what.empty() ? "match" : what)
+             << endl;
+        same = same && what.empty();
+    }
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = ".", outDir = "exports", tables = "transactions,balances,holdings,prices";
+    ExportFormat format = CSV_FORMAT;
+    unsigned threads = thread::hardware_concurrency();
+    size_t rowGroupRows = 65536;
+    bool verifyOnly = false;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (arg == "--verify")
+            {
+                verifyOnly = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                dir = value;
+            else if (arg == "--format" && (value == "csv" || value == "columnar"))
+                format = value == "csv" ? CSV_FORMAT : COLUMNAR_FORMAT;
+            else if (arg == "--tables")
+                tables = value;
+            else if (arg == "--threads")
+                threads = (unsigned)stoul(value);
+            else if (arg == "--row-group")
+                rowGroupRows = stoull(value);
+            else if (arg == "--out")
+                outDir = value;
+            else
+                throw invalid_argument("bad option " + arg + " " + value);
+        }
+
+        if (verifyOnly)
+            return verify(outDir, tables) ? 0 : 1;
+
+        filesystem::create_directories(outDir);
+        Exporter exporter(dir, format, threads, rowGroupRows);
+        string extension = format == CSV_FORMAT ? ".csv" : ".nsac";
+
+        cout << left << setw(14) << "table" << right << setw(14) << "rows" << setw(10) << "seconds" << setw(14) << "rows/s"
+             << setw(12) << "MB" << setw(10) << "MB/s" << endl;
+
+        stringstream list(tables);
+        string table;
+        while (getline(list, table, ','))
+        {
+            string out = outDir + "/" + table + extension;
+            ExportReport r;
+            if (table == "transactions")
+                r = exporter.exportTransactions(out);
+            else if (table == "balances")
+                r = exporter.exportBalances(out);
+            else if (table == "holdings")
+                r = exporter.exportHoldings(out);
+            else if (table == "prices")
+                r = exporter.exportPrices(out);
+            else
+                throw invalid_argument("unknown table " + table);
+
+            double mb = r.bytes / 1048576.0;
+            double secs = max(r.seconds, 1e-9);
+            cout << left << setw(14) << r.table << right << setw(14) << r.rows << fixed << setprecision(2) << setw(10)
+                 << r.seconds << setw(14) << setprecision(0) << r.rows / secs << setprecision(1) << setw(12) << mb
+                 << setw(10) << mb / secs << endl;
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << "export: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+/*
+    File name: import.cpp
+    Description: Bulk import of clients, stocks and daily price history from CSV files into the books
+                 in a directory. The files are parsed on every core and checked row by row; a file
+                 with a bad row is rejected whole, with the lines at fault, and a good one is saved
+                 in one write.
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/import.cpp -o import.exe
+        - import.exe --dir data --clients clients.csv --stocks stocks.csv
+        - import.exe --dir data --prices history/          (every .csv file in the folder)
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <filesystem>
+
+#include "../includes/importer.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: import [--dir DIR] [--clients FILE] [--stocks FILE] [--prices FILE|FOLDER,...] [--threads N]" << endl;
+    cout << "  clients: name,address,dob (DD/MM/YYYY)    stocks: name,price" << endl;
+    cout << "  prices:  date,open,high,low,close,volume[,symbol], the symbol is the file name if there is no column" << endl;
+}
+
+// Prints the report and returns false if the file was rejected
+bool show(const ImportReport &r)
+{
+    if (r.errorCount > 0)
+    {
+        cout << r.table << ": rejected, " << r.errorCount << " bad rows, nothing was imported" << endl;
+        for (auto &error : r.errors)
+            cout << "  " << error.file << ":" << error.line << ": " << error.message << endl;
+        if (r.errorCount > r.errors.size())
+            cout << "  ..." << endl;
+        return false;
+    }
+    double secs = max(r.seconds, 1e-9);
+    cout << left << setw(10) << r.table << right << setw(12) << r.rows << setw(12) << r.firstId << setw(10) << r.skipped
+         << fixed << setprecision(2) << setw(10) << r.seconds << setw(14) << setprecision(0) << r.rows / secs << endl;
+    if (!r.unknownSymbols.empty())
+    {
+        cout << "  not listed:";
+        for (auto &symbol : r.unknownSymbols)
+            cout << " " << symbol;
+        cout << endl;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = ".", clientsPath, stocksPath;
+    vector<string> pricePaths;
+    unsigned threads = thread::hardware_concurrency();
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                dir = value;
+            else if (arg == "--clients")
+                clientsPath = filesystem::absolute(value).string();
+            else if (arg == "--stocks")
+                stocksPath = filesystem::absolute(value).string();
+            else if (arg == "--prices")
+            {
+                // a folder stands for the .csv files in it, taken in name order
+                stringstream list(value);
+                string item;
+                while (getline(list, item, ','))
+                {
+                    filesystem::path path = filesystem::absolute(item);
+                    if (!filesystem::is_directory(path))
+                    {
+                        pricePaths.push_back(path.string());
+                        continue;
+                    }
+                    vector<string> files;
+                    for (auto &entry : filesystem::directory_iterator(path))
+                    {
+                        if (entry.is_regular_file() && entry.path().extension() == ".csv")
+                            files.push_back(entry.path().string());
+                    }
+                    sort(files.begin(), files.end());
+                    pricePaths.insert(pricePaths.end(), files.begin(), files.end());
+                }
+            }
+            else if (arg == "--threads")
+                threads = (unsigned)stoul(value);
+            else
+                throw invalid_argument("bad option " + arg + " " + value);
+        }
+        if (clientsPath.empty() && stocksPath.empty() && pricePaths.empty())
+            throw invalid_argument("nothing to import");
+
+        // The engine works on the files of the current directory
+        filesystem::current_path(dir);
+        StockEngine engine;
+        Importer importer(engine, threads);
+
+        cout << left << setw(10) << "table" << right << setw(12) << "rows" << setw(12) << "first id" << setw(10)
+             << "skipped" << setw(10) << "seconds" << setw(14) << "rows/s" << endl;
+        bool ok = true;
+        if (!stocksPath.empty())
+            ok = show(importer.importStocks(stocksPath)) && ok;
+        if (!clientsPath.empty())
+            ok = show(importer.importClients(clientsPath)) && ok;
+        if (!pricePaths.empty())
+            ok = show(importer.importPrices(pricePaths)) && ok;
+        return ok ? 0 : 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "import: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+}
@@ -0,0 +1,217 @@
+/*
+    File name: ledger.cpp
+    Description: Rebuilds the client registry and every portfolio of a book from its event log
+                 (events.json) and the latest checkpoint, replaying the clients on every core. It
+                 can check the stored files against the rebuilt state, repair them, or write a new
+                 checkpoint so that later rebuilds start from there; run it with "checkpoint"
+                 regularly (nightly, say) while the book is not being written. It also answers
+                 what a client held, and what it was worth, at the end of a past day, from the
+                 checkpoints and the client's own events. "compact" writes a binary snapshot,
+                 starts a new events.json after it and archives the old one, which the app can
+                 also do in the background (see "compaction" in configuration/storage.json).
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/ledger.cpp -o ledger.exe
+        - ledger.exe verify --dir data
+        - ledger.exe rebuild --dir data --full
+        - ledger.exe asof --dir data --client 57 --date 2024-03-31
+        - ledger.exe compact --dir data
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#include "../includes/ledger.hpp"
+#include "../includes/compactor.hpp"
+#include "../includes/point_in_time.hpp"
+#include "../includes/price_history.hpp"
+#include "../includes/symbols.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: ledger verify|rebuild|checkpoint|compact [--dir DIR] [--threads N] [--full] [--keep N] [--drop-archive]" << endl;
+    cout << "       ledger asof --client ID --date YYYY-MM-DD [--dir DIR]" << endl;
+    cout << "  verify      compare portfolio.json, added_clients.json and removed_clients.json with the events" << endl;
+    cout << "  rebuild     rewrite those files from the events, then write a checkpoint" << endl;
+    cout << "  checkpoint  write a checkpoint of the state the events give" << endl;
+    cout << "  compact     snapshot the state, start a new events.json after it and archive the old one" << endl;
+    cout << "  asof        the client's balance and holdings at the end of the day, valued at its closes" << endl;
+    cout << "  --full      replay from the first checkpoint instead of the latest" << endl;
+    cout << "  --keep N    checkpoints to keep besides the first, older ones make as-of queries cheaper (3)" << endl;
+    cout << "  --drop-archive  compact without keeping the old events, as-of queries then start at the snapshot" << endl;
+}
+
+// Prints the client as they were at the time
+int asOf(const string &dir, long long clientId, int64_t time)
+{
+    ClientAsOf state;
+    if (!PointInTime(dir).query(clientId, time, state))
+        throw runtime_error("the ledger of " + dir + " does not go back to " + formatDate(time));
+    if (!state.client.has_value() && !state.portfolio.has_value())
+    {
+        cout << "client " << clientId << " had not registered by " << formatDate(time) << endl;
+        return 1;
+    }
+
+    SymbolTable symbols;
+    symbols.load(dir + "/symbols.json");
+    PriceHistory history;
+    history.load(dir + "/price_history.json");
+    string name = state.client.has_value() ? state.client->getName() : state.portfolio->name;
+    cout << "client " << clientId << " (" << name << ")" << (state.removed ? ", removed," : "") << " at the end of "
+         << formatDate(time) << ", from the checkpoint at event " << state.snapshotEvents << " and "
+         << state.eventsApplied << " later events" << endl;
+    if (!state.portfolio.has_value())
+    {
+        cout << "no portfolio" << endl;
+        return 0;
+    }
+
+    Money total;
+    cout << left << setw(16) << "stock" << right << setw(10) << "shares" << setw(14) << "cost rate" << setw(14)
+         << "close" << setw(16) << "value" << endl;
+    for (auto &holding : state.portfolio->stocks)
+    {
+        const PriceBar *bar = history.onOrBefore(holding.stockId, dayOf(time));
+        Money value = bar != nullptr ? bar->close * holding.numberOfShares : Money();
+        total += value;
+        string stock = holding.stockName.has_value()
+                           ? *holding.stockName
+                           : (holding.symbol < symbols.size() ? symbols.name(holding.symbol) : to_string(holding.stockId));
+        cout << left << setw(16) << stock << right << setw(10) << holding.numberOfShares << setw(14)
+             << holding.purchasedRate.toString() << setw(14) << (bar != nullptr ? bar->close.toString() : "-")
+             << setw(16) << value.toString() << endl;
+    }
+    cout << left << setw(54) << "holdings" << right << setw(16) << total.toString() << endl;
+    cout << left << setw(54) << "balance" << right << setw(16) << state.portfolio->balance.toString() << endl;
+    return 0;
+}
+
+bool report(const string &file, const vector<long long> &ids)
+{
+    cout << left << setw(22) << file << right << setw(10) << ids.size() << " differ";
+    for (size_t i = 0; i < ids.size() && i < 10; i++)
+        cout << (i == 0 ? ": " : ", ") << ids[i];
+    cout << (ids.size() > 10 ? ", ..." : "") << endl;
+    return ids.empty();
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = ".", command;
+    unsigned threads = thread::hardware_concurrency();
+    bool full = false, keepArchive = true;
+    size_t keep = 3;
+    long long clientId = -1;
+    int64_t date = 0;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (arg == "--full")
+            {
+                full = true;
+                continue;
+            }
+            if (arg == "--drop-archive")
+            {
+                keepArchive = false;
+                continue;
+            }
+            if (arg[0] != '-' && command.empty())
+            {
+                command = arg;
+                continue;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                dir = value;
+            else if (arg == "--threads")
+                threads = (unsigned)stoul(value);
+            else if (arg == "--keep")
+                keep = (size_t)stoul(value);
+            else if (arg == "--client")
+                clientId = stoll(value);
+            else if (arg == "--date")
+            {
+                int year, month, day;
+                if (sscanf(value.c_str(), "%d-%d-%d", &year, &month, &day) != 3 || month < 1 || month > 12 || day < 1 ||
+                    day > 31)
+                    throw invalid_argument("the date must be given as YYYY-MM-DD");
+                date = epochOfDate(year, month, day);
+            }
+            else
+                throw invalid_argument("bad option " + arg + " " + value);
+        }
+        if (command != "verify" && command != "rebuild" && command != "checkpoint" && command != "asof" &&
+            command != "compact")
+            throw invalid_argument("no command");
+        ledger::finishCompaction(dir);
+        if (endOfRecords(dir + "/events.json") < 0)
+            throw runtime_error("no events.json in " + dir + ", the book has not recorded any events yet");
+        if (command == "compact")
+        {
+            CompactionReport compaction = Compactor(dir, threads, keepArchive).run();
+            if (!compaction.compacted)
+                cout << "nothing to compact" << endl;
+            else
+                cout << "snapshot at event " << compaction.events << " (" << compaction.snapshotBytes << " bytes), "
+                     << compaction.archived << " events " << (keepArchive ? "archived" : "dropped") << ", "
+                     << compaction.kept << " kept, in " << fixed << setprecision(2) << compaction.seconds << "s" << endl;
+            return 0;
+        }
+        if (command == "asof")
+        {
+            if (clientId < 0 || date == 0)
+                throw invalid_argument("asof needs --client and --date");
+            return asOf(dir, clientId, date + 86399);
+        }
+
+        auto start = chrono::steady_clock::now();
+        LedgerCheckpoint state = LedgerRebuild(dir, threads).run(full);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "replayed to event " << state.events << " in " << fixed << setprecision(2) << seconds << "s: "
+             << state.clients.size() << " clients, " << state.removed.size() << " removed, " << state.portfolios.size()
+             << " portfolios" << endl;
+
+        if (command == "verify")
+        {
+            auto clientId = [](const Client &client) { return client.getId(); };
+            auto portfolioId = [](const Portfolio &portfolio) { return portfolio.id; };
+            bool same = report("portfolio.json", ledger::differences(loadRecords<Portfolio>(dir + "/portfolio.json"),
+                                                                     state.portfolios, portfolioId));
+            same = report("added_clients.json", ledger::differences(loadRecords<Client>(dir + "/added_clients.json"),
+                                                                    state.clients, clientId)) && same;
+            same = report("removed_clients.json", ledger::differences(loadRecords<Client>(dir + "/removed_clients.json"),
+                                                                      state.removed, clientId)) && same;
+            return same ? 0 : 1;
+        }
+        if (command == "rebuild")
+        {
+            saveRecords(dir + "/portfolio.json", state.portfolios, 4);
+            saveRecords(dir + "/added_clients.json", state.clients, 4);
+            saveRecords(dir + "/removed_clients.json", state.removed, 4);
+            cout << "rewrote portfolio.json, added_clients.json and removed_clients.json" << endl;
+        }
+        ledger::saveCheckpoint(dir, state, keep);
+        cout << "wrote checkpoint at event " << state.events << endl;
+    }
+    catch (const exception &e)
+    {
+        cerr << "ledger: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+/*
+    File name: reconcile.cpp
+    Description: Reconciliation job for the Nepal Stock Analyzer. It checks that the holdings in
+                 portfolio.json are the net of each client's purchases and sales in transactions.json,
+                 that balances are their deposits and settlements less purchases plus sales, and that
+                 every trade is filed under its own client, joining the files by client and stock
+                 id on every core. The expected state starts from the book as the first ledger
+                 checkpoint has it, so money a client had before any cash movement was recorded
+                 counts. It exits with 1 if anything is out of line.
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/reconcile.cpp -o reconcile.exe
+        - reconcile.exe --dir data --out discrepancies.csv
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+
+#include "../includes/reconciliation.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: reconcile [--dir DIR] [--threads N] [--show N] [--out FILE]" << endl;
+    cout << "  --show N    discrepancies of each kind to print (10)" << endl;
+    cout << "  --out FILE  write every discrepancy as CSV: kind,clientId,stockId,stored,expected" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = ".", outPath;
+    unsigned threads = thread::hardware_concurrency();
+    size_t show = 10;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                dir = value;
+            else if (arg == "--threads")
+                threads = (unsigned)stoul(value);
+            else if (arg == "--show")
+                show = (size_t)stoul(value);
+            else if (arg == "--out")
+                outPath = value;
+            else
+                throw invalid_argument("unknown option " + arg);
+        }
+
+        ReconcileReport r = ReconcileJob(dir, threads).run();
+        double secs = max(r.seconds, 1e-9);
+        cout << r.transactions << " transactions, " << r.movements << " cash movements and " << r.portfolios
+             << " portfolios of " << r.accounts << " clients in " << fixed << setprecision(2) << r.seconds << " s ("
+             << setprecision(1) << r.transactions / secs / 1e6 << "M transactions per second)" << endl;
+
+        if (r.baseline.empty())
+            cout << "no first ledger checkpoint, so everything is added up from nothing" << endl;
+        else
+            cout << "starting from " << r.baseline << ", with the trades and cash movements since "
+                 << (r.since == INT64_MAX ? "(none yet)" : formatTime(r.since)) << endl;
+
+        cout << r.holdings.size() << " holdings differ from the net of the trades" << endl;
+        for (size_t i = 0; i < r.holdings.size() && i < show; i++)
+            cout << "  client " << r.holdings[i].clientId << ", stock " << r.holdings[i].stockId << ": holds "
+                 << r.holdings[i].stored << ", trades give " << r.holdings[i].expected << endl;
+        cout << r.balances.size() << " balances differ from the cash movements and trades" << endl;
+        for (size_t i = 0; i < r.balances.size() && i < show; i++)
+            cout << "  client " << r.balances[i].clientId << ": balance " << r.balances[i].stored << ", expected "
+                 << r.balances[i].expected << endl;
+        if (!r.unrecorded.empty())
+            cout << r.unrecorded.size() << " balances of clients without cash movements cannot be checked" << endl;
+        for (size_t i = 0; i < r.unrecorded.size() && i < show; i++)
+            cout << "  client " << r.unrecorded[i].clientId << ": balance " << r.unrecorded[i].stored << ", trades give "
+                 << r.unrecorded[i].expected << endl;
+        cout << r.misfiled << " trades are filed under another client" << endl;
+        for (size_t i = 0; i < r.misfiledExamples.size() && i < show; i++)
+            cout << "  " << r.misfiledExamples[i].type << " of client " << r.misfiledExamples[i].clientId << " on "
+                 << formatDate(r.misfiledExamples[i].time) << " under \"" << r.misfiledExamples[i].entryName << "\"" << endl;
+
+        if (!outPath.empty())
+        {
+            ofstream out(outPath);
+            out << "kind,clientId,stockId,stored,expected\n";
+            for (auto &one : r.holdings)
+                out << "holding," << one.clientId << ',' << one.stockId << ',' << one.stored << ',' << one.expected << '\n';
+            for (auto &one : r.balances)
+                out << "balance," << one.clientId << ",," << one.stored << ',' << one.expected << '\n';
+            for (auto &one : r.unrecorded)
+                out << "unrecorded," << one.clientId << ",," << one.stored << ',' << one.expected << '\n';
+            if (!out)
+                throw runtime_error("cannot write " + outPath);
+        }
+        return r.clean() ? 0 : 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "reconcile: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+    File name: statements.cpp
+    Description: Month-end statement job for the Nepal Stock Analyzer. It writes the statement of every
+                 client for one month (balances, deposits, trades, holdings and P&L) into one text file,
+                 reading each storage file once and rendering the statements on every core.
+
+    Usage:
+        - g++ -O2 -std=c++17 -pthread tools/statements.cpp -o statements.exe
+        - statements.exe --dir data --month 2023-07 --out statements.txt
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#include "../includes/statements.hpp"
+
+using namespace std;
+
+void usage()
+{
+    cout << "Usage: statements --month YYYY-MM [--dir DIR] [--threads N] [--out FILE]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = ".", outPath = "statements.txt", month;
+    unsigned threads = thread::hardware_concurrency();
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                usage();
+                return 0;
+            }
+            if (i + 1 >= argc)
+                throw invalid_argument("missing value for " + arg);
+            string value = argv[++i];
+            if (arg == "--dir")
+                dir = value;
+            else if (arg == "--month")
+                month = value;
+            else if (arg == "--threads")
+                threads = (unsigned)stoul(value);
+            else if (arg == "--out")
+                outPath = value;
+            else
+                throw invalid_argument("unknown option " + arg);
+        }
+
+        int year = 0, number = 0;
+        if (sscanf(month.c_str(), "%d-%d", &year, &number) != 2 || number < 1 || number > 12)
+            throw invalid_argument("the month must be given as YYYY-MM");
+        int64_t from = epochOfDate(year, number, 1);
+        int64_t to = number == 12 ? epochOfDate(year + 1, 1, 1) : epochOfDate(year, number + 1, 1);
+
+        StatementJob job(dir, from, to, threads);
+        StatementReport r = job.run(outPath);
+        double secs = max(r.seconds, 1e-9);
+        cout << r.statements << " statements, " << fixed << setprecision(1) << r.bytes / 1048576.0 << " MB in "
+             << setprecision(2) << r.seconds << " s (" << setprecision(0) << r.statements / secs * 60
+             << " statements per minute)" << endl;
+    }
+    catch (const exception &e)
+    {
+        cerr << "statements: " << e.what() << endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}